@@ -104,12 +104,12 @@ static void newFrame(bool mouseCaptured)
     ImGui::NewFrame();
 }
 
-static void presentFrame(GLuint transitionFramebuffer, int windowWidth, int windowHeight, int frameWidth, int frameHeight)
+// Area of the window where the frame is displayed, with black bars to keep its aspect ratio
+static void getPresentRect(int windowWidth, int windowHeight, int frameWidth, int frameHeight, int& dstX0, int& dstY0, int& dstX1, int& dstY1)
 {
     const float frameAspect = static_cast<float>(frameWidth) / static_cast<float>(frameHeight);
     const float windowAspect = static_cast<float>(windowWidth) / static_cast<float>(windowHeight);
     
-    int dstX0, dstY0, dstX1, dstY1;
     if (windowAspect > frameAspect)
     {
         const int dstW = int(windowHeight * frameAspect);
@@ -128,6 +128,12 @@ static void presentFrame(GLuint transitionFramebuffer, int windowWidth, int wind
         dstX1 = dstW;
         dstY1 = dstY0 + dstH;
     }
+}
+
+static void presentFrame(GLuint transitionFramebuffer, int windowWidth, int windowHeight, int frameWidth, int frameHeight)
+{
+    int dstX0, dstY0, dstX1, dstY1;
+    getPresentRect(windowWidth, windowHeight, frameWidth, frameHeight, dstX0, dstY0, dstX1, dstY1);
 
     glBindFramebuffer(GL_READ_FRAMEBUFFER, transitionFramebuffer);
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
@@ -252,6 +258,7 @@ int main(int argc, char* argv[])
 
         // Render scene
         scnSetCameraPosition(scene, camera.position.e);
+        scnSetCameraMatrices(scene, camera.getProjection().e, camera.getViewMatrix().e);
         scnUpdate(scene, deltaTime, renderer);
 
         // Upload texture
@@ -311,6 +318,27 @@ int main(int argc, char* argv[])
             glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
         }
 
+        // Left click on the frame to edit the object under the cursor
+        if (!mouseCaptured && ImGui::IsMouseClicked(ImGuiMouseButton_Left) && !ImGui::GetIO().WantCaptureMouse)
+        {
+            int windowWidth = 0;
+            int windowHeight = 0;
+            glfwGetWindowSize(window, &windowWidth, &windowHeight);
+
+            // The black bars have the same size on both sides, so the rect is the same from the top of the window
+            int dstX0, dstY0, dstX1, dstY1;
+            getPresentRect(windowWidth, windowHeight, framebuffer.getWidth(), framebuffer.getHeight(), dstX0, dstY0, dstX1, dstY1);
+
+            float ndcX = remap((float)mouseX, (float)dstX0, (float)dstX1, -1.f, 1.f);
+            float ndcY = remap((float)mouseY, (float)dstY0, (float)dstY1, 1.f, -1.f);
+
+            if (fabsf(ndcX) <= 1.f && fabsf(ndcY) <= 1.f)
+            {
+                float3 rayDirection = camera.getRayDirection(ndcX, ndcY);
+                scnPickObject(scene, camera.position.e, rayDirection.e);
+            }
+        }
+
         //ImGui::ShowDemoWindow();
         ImGui::ShowMetricsWindow();
         endFrame(window, transitionFramebuffer, framebuffer);
@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <rdr/renderer.h>
+
+#include <common/maths.hpp>
+#include <common/camera.hpp>
+#include <common/benchmark_scenes.hpp>
+#include <common/headless_app.hpp>
+
+// Renders fixed workloads (scene, camera path and renderer settings) and writes their timings as JSON
+// Each workload gets a new renderer, so the settings of a workload don't leak into the next ones
+
+struct Workload
+{
+    const char* name;
+    BenchmarkSceneType scene;
+
+    int msaaSampleCount = 4;
+    bool msaa = true;
+    rdrTextureFilter textureFilter = FT_NEAREST;
+    int postProcess = -1;           // rdrPostProcess enabled for the workload, -1 for none
+};
+
+static std::vector<Workload> getWorkloads()
+{
+    std::vector<Workload> workloads;
+
+    auto add = [&](const char* name, BenchmarkSceneType scene) -> Workload&
+    {
+        workloads.push_back({ name, scene });
+        return workloads.back();
+    };
+
+    add("christmas", BenchmarkSceneType::CHRISTMAS);
+    add("christmas_msaa_off", BenchmarkSceneType::CHRISTMAS).msaa = false;
+    add("christmas_msaa_16x", BenchmarkSceneType::CHRISTMAS).msaaSampleCount = 16;
+    add("overdraw_transparency", BenchmarkSceneType::OVERDRAW);
+    add("many_lights", BenchmarkSceneType::MANY_LIGHTS);
+    add("tiny_triangles", BenchmarkSceneType::TINY_TRIANGLES);
+    add("filter_nearest", BenchmarkSceneType::TEXTURED_FLOOR).textureFilter = FT_NEAREST;
+    add("filter_bilinear", BenchmarkSceneType::TEXTURED_FLOOR).textureFilter = FT_BILINEAR;
+    add("filter_trilinear", BenchmarkSceneType::TEXTURED_FLOOR).textureFilter = FT_TRILINEAR;
+    add("post_box_blur", BenchmarkSceneType::CHRISTMAS).postProcess = PP_BOX_BLUR;
+    add("post_gaussian_blur", BenchmarkSceneType::CHRISTMAS).postProcess = PP_GAUSSIAN_BLUR;
+    add("post_light_bloom", BenchmarkSceneType::CHRISTMAS).postProcess = PP_LIGHT_BLOOM;
+
+    return workloads;
+}
+
+struct BenchmarkOptions
+{
+    int width = 1280;
+    int height = 720;
+    int frameCount = 60;
+    int warmupFrameCount = 5;
+    float deltaTime = 1.f / 60.f;
+
+    const char* outputFilename = nullptr;   // Standard output if null
+    const char* label = "";                 // Free text copied to the results (commit, machine...)
+    std::vector<std::string> filters;       // Only the workloads containing one of these names are run
+};
+
+// Sums of the measured frames of a workload
+struct WorkloadResult
+{
+    const Workload* workload;
+
+    int frameCount = 0;
+    double totalMs = 0.0;
+    double minMs = 0.0;
+    double maxMs = 0.0;
+    double stageMs[PS_COUNT] = {};
+
+    double triangles = 0.0;
+    double trianglesRasterized = 0.0;
+    double fragmentsTested = 0.0;
+    double fragmentsShaded = 0.0;
+};
+
+static const char* stageNames[PS_COUNT] = { "vertexShading", "clipping", "culling", "binning", "rasterization", "fragmentShading", "msaaResolve", "postProcess", "output" };
+
+static void printUsage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --size <width> <height>     Frame buffer size (1280 720)\n"
+        "  --frames <count>            Measured frames per workload (60)\n"
+        "  --warmup <count>            Frames rendered before the measure (5)\n"
+        "  --output <file>             JSON results (standard output by default)\n"
+        "  --label <text>              Text copied to the results, e.g. a commit or a machine name\n"
+        "  --only <name>               Only run the workloads containing the name (can be repeated)\n"
+        "  --list                      Print the names of the workloads\n"
+        "Run from the app directory, the christmas scene loads its assets from 'assets/'.\n",
+        program);
+}
+
+static bool parseOptions(int argc, char* argv[], BenchmarkOptions& options)
+{
+    CommandLine commandLine(argc, argv);
+    while (commandLine.next())
+    {
+        if (commandLine.isOption("--size", 2))
+        {
+            options.width = commandLine.nextInt();
+            options.height = commandLine.nextInt();
+        }
+        else if (commandLine.isOption("--frames", 1))
+        {
+            options.frameCount = commandLine.nextInt();
+        }
+        else if (commandLine.isOption("--warmup", 1))
+        {
+            options.warmupFrameCount = max(0, commandLine.nextInt());
+        }
+        else if (commandLine.isOption("--output", 1))
+        {
+            options.outputFilename = commandLine.nextString();
+        }
+        else if (commandLine.isOption("--label", 1))
+        {
+            options.label = commandLine.nextString();
+        }
+        else if (commandLine.isOption("--only", 1))
+        {
+            options.filters.push_back(commandLine.nextString());
+        }
+        else if (commandLine.isOption("--list"))
+        {
+            for (const Workload& workload : getWorkloads())
+                printf("%s\n", workload.name);
+            exit(0);
+        }
+        else
+            commandLine.unknownOption();
+    }
+
+    if (commandLine.hasFailed())
+        return false;
+
+    if (options.width <= 0 || options.height <= 0 || options.frameCount <= 0)
+    {
+        fprintf(stderr, "The size and the frame count have to be positive\n");
+        return false;
+    }
+
+    return true;
+}
+
+static WorkloadResult runWorkload(const Workload& workload, const BenchmarkOptions& options)
+{
+    WorkloadResult result;
+    result.workload = &workload;
+
+    const int pixelCount = options.width * options.height;
+
+    std::vector<float4> colorBuffer(pixelCount);
+    std::vector<float>  depthBuffer(pixelCount);
+    float4* colorBufferPtr = colorBuffer.data();
+
+    rdrImpl* renderer = rdrInit(reinterpret_cast<float**>(&colorBufferPtr), depthBuffer.data(), options.width, options.height);
+    rdrEnableProfiler(renderer, true);
+    rdrSetMSAASampleCount(renderer, workload.msaaSampleCount);
+    rdrSetUniformBool(renderer, UT_MSAA, workload.msaa);
+    rdrSetUniformInt(renderer, UT_TEXTURE_FILTER, workload.textureFilter);
+    if (workload.postProcess >= 0)
+        rdrEnablePostProcess(renderer, (rdrPostProcess)workload.postProcess, true);
+
+    BenchmarkScene scene;
+    scene.create(workload.scene, renderer);
+    if (scene.getFailedLoadCount() > 0)
+        fprintf(stderr, "Warning: %d assets of %s could not be loaded, it is measured without them\n", scene.getFailedLoadCount(), workload.name);
+
+    Camera camera(options.width, options.height);
+
+    // The warmup frames are still frames at the start of the path, so the measured frames are the same for any warmup
+    const int totalFrameCount = options.warmupFrameCount + options.frameCount;
+    for (int frame = 0; frame < totalFrameCount; frame++)
+    {
+        int measuredFrame = max(frame - options.warmupFrameCount, 0);
+        bool isWarmup = frame < options.warmupFrameCount;
+
+        CameraKey key = scene.cameraPath.sample(measuredFrame, options.frameCount);
+        camera.position = key.position;
+        camera.yaw = key.yaw;
+        camera.pitch = key.pitch;
+
+        float time = measuredFrame * options.deltaTime;
+        float deltaTime = isWarmup ? 0.f : options.deltaTime;
+
+        auto frameStart = std::chrono::steady_clock::now();
+
+        beginHeadlessFrame(renderer, colorBuffer, depthBuffer, camera, time, deltaTime);
+
+        scene.draw(renderer, camera, time, deltaTime);
+        rdrFinish(renderer);
+
+        double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+
+        if (isWarmup)
+            continue;
+
+        rdrStats stats;
+        rdrGetStats(renderer, &stats);
+
+        result.minMs = result.frameCount == 0 ? frameMs : min(result.minMs, frameMs);
+        result.maxMs = result.frameCount == 0 ? frameMs : max(result.maxMs, frameMs);
+        result.totalMs += frameMs;
+        result.frameCount++;
+
+        for (int i = 0; i < PS_COUNT; i++)
+            result.stageMs[i] += stats.stageMs[i];
+
+        result.triangles           += stats.triangles;
+        result.trianglesRasterized += stats.trianglesRasterized;
+        result.fragmentsTested     += stats.fragmentsTested;
+        result.fragmentsShaded     += stats.fragmentsShaded;
+    }
+
+    scene.destroy();
+    rdrShutdown(renderer);
+
+    return result;
+}
+
+static void writeJSONString(FILE* file, const char* text)
+{
+    fputc('"', file);
+    for (const char* c = text; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if ((unsigned char)*c < 0x20)
+            fprintf(file, "\\u%04x", *c);
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+static void writeResults(FILE* file, const BenchmarkOptions& options, const std::vector<WorkloadResult>& results)
+{
+    fprintf(file, "{\n");
+    fprintf(file, "  \"label\": ");
+    writeJSONString(file, options.label);
+    fprintf(file, ",\n");
+    fprintf(file, "  \"width\": %d,\n", options.width);
+    fprintf(file, "  \"height\": %d,\n", options.height);
+    fprintf(file, "  \"frames\": %d,\n", options.frameCount);
+    fprintf(file, "  \"warmupFrames\": %d,\n", options.warmupFrameCount);
+    fprintf(file, "  \"hardwareThreads\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(file, "  \"workloads\": [\n");
+
+    for (size_t w = 0; w < results.size(); w++)
+    {
+        const WorkloadResult& result = results[w];
+        const double seconds = result.totalMs * 1e-3;
+        const double perSecond = seconds > 0.0 ? 1.0 / seconds : 0.0;
+
+        fprintf(file, "    {\n");
+        fprintf(file, "      \"name\": \"%s\",\n", result.workload->name);
+        fprintf(file, "      \"fps\": %.3f,\n", result.frameCount * perSecond);
+        fprintf(file, "      \"frameMs\": { \"average\": %.4f, \"min\": %.4f, \"max\": %.4f },\n",
+            result.totalMs / result.frameCount, result.minMs, result.maxMs);
+
+        // Average per frame, the stages run by the workers give the sum of the time of each thread
+        fprintf(file, "      \"stageMs\": {");
+        for (int i = 0; i < PS_COUNT; i++)
+            fprintf(file, "%s \"%s\": %.4f", i ? "," : "", stageNames[i], result.stageMs[i] / result.frameCount);
+        fprintf(file, " },\n");
+
+        fprintf(file, "      \"trianglesPerFrame\": %.1f,\n", result.triangles / result.frameCount);
+        fprintf(file, "      \"fragmentsShadedPerFrame\": %.1f,\n", result.fragmentsShaded / result.frameCount);
+        fprintf(file, "      \"trianglesPerSecond\": %.1f,\n", result.triangles * perSecond);
+        fprintf(file, "      \"trianglesRasterizedPerSecond\": %.1f,\n", result.trianglesRasterized * perSecond);
+        fprintf(file, "      \"fragmentsTestedPerSecond\": %.1f,\n", result.fragmentsTested * perSecond);
+        fprintf(file, "      \"fragmentsShadedPerSecond\": %.1f\n", result.fragmentsShaded * perSecond);
+        fprintf(file, "    }%s\n", w + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<Workload> workloads = getWorkloads();
+    std::vector<WorkloadResult> results;
+
+    for (const Workload& workload : workloads)
+    {
+        bool isSelected = options.filters.empty();
+        for (const std::string& filter : options.filters)
+            isSelected |= strstr(workload.name, filter.c_str()) != nullptr;
+
+        if (!isSelected)
+            continue;
+
+        results.push_back(runWorkload(workload, options));
+
+        // The progress goes to the standard error, so the standard output only receives the results
+        const WorkloadResult& result = results.back();
+        fprintf(stderr, "%-24s %8.3f ms/frame\n", workload.name, result.totalMs / result.frameCount);
+    }
+
+    FILE* file = stdout;
+    if (options.outputFilename && (file = fopen(options.outputFilename, "w")) == nullptr)
+    {
+        fprintf(stderr, "Cannot write '%s'\n", options.outputFilename);
+        return 1;
+    }
+
+    writeResults(file, options, results);
+
+    if (file != stdout)
+        fclose(file);
+
+    return 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <rdr/renderer.h>
+#include <scn/scene.h>
+
+#include <common/types.hpp>
+#include <common/camera.hpp>
+#include <common/camera_path.hpp>
+
+// Scenes of the benchmark workloads, everything they draw only depends on the time
+enum class BenchmarkSceneType
+{
+    CHRISTMAS,          // Default scene of the scene library (loaded from the assets)
+    OVERDRAW,           // Stacked screen-sized transparent quads, blended back to front
+    MANY_LIGHTS,        // Grid of spheres lit by the 8 lights with the Phong model
+    TINY_TRIANGLES,     // Finely tessellated sphere, its triangles are smaller than a pixel
+    TEXTURED_FLOOR,     // Textured plane going to the horizon, for the texture filters
+};
+
+struct BenchmarkMesh
+{
+    std::vector<rdrVertex> vertices;
+    std::vector<uint32_t>  indices;
+};
+
+// Grid in the xy plane facing +z, centered on the origin, the UVs go from 0 to uvScale
+BenchmarkMesh createGridMesh(int columns, int rows, float width, float height, float uvScale, const float4& color);
+
+// UV sphere centered on the origin
+BenchmarkMesh createSphereMesh(int slices, int stacks, float radius, const float4& color);
+
+struct BenchmarkScene
+{
+    BenchmarkSceneType type = BenchmarkSceneType::CHRISTMAS;
+
+    scnImpl* christmas = nullptr;
+    std::vector<BenchmarkMesh> meshes;
+    int texture = -1;
+
+    CameraPath cameraPath;
+
+    // The renderer keeps the uploaded textures until its shutdown
+    void create(BenchmarkSceneType sceneType, rdrImpl* renderer);
+    void destroy();
+
+    // Assets that could not be loaded, the scene is drawn without them (only the christmas scene loads files)
+    int getFailedLoadCount() const;
+
+    void draw(rdrImpl* renderer, Camera& camera, float time, float deltaTime);
+};
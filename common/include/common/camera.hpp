@@ -24,6 +24,9 @@ struct Camera
     void update(float deltaTime, const CameraInputs& inputs);
     mat4x4 getViewMatrix();
     mat4x4 getProjection();
+
+    // World space direction of the ray going through the point of the screen (in NDC, y going up)
+    float3 getRayDirection(float ndcX, float ndcY);
     float3 position = {0.f, 0.f, 0.f};
 
     float aspect;
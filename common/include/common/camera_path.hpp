@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+#include <common/types.hpp>
+
+// Position and orientation of the camera (same angles as Camera)
+struct CameraKey
+{
+    float3 position = { 0.f, 0.f, 0.f };
+    float yaw = 0.f;
+    float pitch = 0.f;
+};
+
+CameraKey makeCameraKey(const float3& position, float yawDegrees, float pitchDegrees);
+
+// Deterministic camera motion over the rendered frames
+// Either an orbit around a point, or keys linearly interpolated (a single key is a still camera)
+struct CameraPath
+{
+    std::vector<CameraKey> keys = { CameraKey() };
+
+    // The keys are ignored if the radius of the orbit is not 0
+    float3 orbitCenter = { 0.f, 0.f, 0.f };
+    float  orbitRadius = 0.f;
+    float  orbitHeight = 0.f;
+    float  orbitTurns = 1.f;
+
+    // Text file with one key per line: x y z yaw pitch (angles in degrees, '#' starts a comment)
+    bool loadKeys(const char* filename);
+
+    // The keys span all the frames, the turns of the orbit loop on the frames
+    CameraKey sample(int frame, int frameCount) const;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include <rdr/renderer.h>
+
+#include <common/types.hpp>
+#include <common/camera.hpp>
+
+// Shared by the programs rendering without a window (headless, benchmark and regression)
+
+// Options of the command line, each one followed by its values:
+//   CommandLine commandLine(argc, argv);
+//   while (commandLine.next())
+//   {
+//       if (commandLine.isOption("--size", 2)) { width = commandLine.nextInt(); height = commandLine.nextInt(); }
+//       else commandLine.unknownOption();
+//   }
+//   if (commandLine.hasFailed()) ...
+class CommandLine
+{
+public:
+    CommandLine(int argc, char* argv[]);
+
+    // Move to the next option, false at the end of the arguments or after an error
+    bool next();
+
+    // True if the current option is the name, an option not followed by its values prints an error and stops the parsing
+    bool isOption(const char* name, int valueCount = 0);
+
+    // Values of the current option
+    int nextInt();
+    float nextFloat();
+    const char* nextString();
+
+    // Print the error of an option not matched by isOption and stop the parsing
+    void unknownOption();
+
+    bool hasFailed() const { return failed; }
+
+private:
+    int argc;
+    char** argv;
+    int index = 0;
+    bool failed = false;
+};
+
+// Clear the frame buffer and set the uniforms and matrices of the camera, before the draws of a frame
+void beginHeadlessFrame(rdrImpl* renderer, std::vector<float4>& colorBuffer, std::vector<float>& depthBuffer, Camera& camera, float time, float deltaTime);
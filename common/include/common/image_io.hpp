@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// The RGBA8 pixels are the ones of the renderer (red in the low byte), stored from the top row
+
+// Binary PPM (P6), the alpha is dropped
+bool writePPM(const char* filename, const uint32_t* colors8Bits, int width, int height);
+
+// PNG with 8 bits RGB channels, the alpha is dropped
+// The rows are filtered and compressed with the fixed Huffman codes of deflate, enough for the flat colors of the renderer
+bool writePNG(const char* filename, const uint32_t* colors8Bits, int width, int height);
+
+// Read a PNG (or any format of stb_image), the alpha of the pixels is the one of the file (255 without alpha)
+bool readPNG(const char* filename, std::vector<uint32_t>& colors8Bits, int& width, int& height);
+
+// RGBA8 pixels appended to a stream
+bool writeRawFrame(FILE* file, const uint32_t* colors8Bits, int width, int height);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker threads running the pushed jobs in the background, in their order
+// Unlike the ThreadPool, the calling thread doesn't wait for the jobs (it checks their results itself)
+class JobQueue
+{
+public:
+    // A thread count of 0 keeps a hardware thread for the calling thread (with at least one worker)
+    JobQueue(int threadCount = 0);
+    ~JobQueue();
+
+    JobQueue(const JobQueue&) = delete;
+    JobQueue& operator=(const JobQueue&) = delete;
+
+    int getThreadCount() const { return (int)workers.size(); }
+
+    void push(std::function<void()> job);
+
+    // Wait until all the pushed jobs are done
+    void waitIdle();
+
+    // Drop the jobs not started yet and wait for the running ones
+    void cancel();
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable idleCondition;
+
+    std::deque<std::function<void()>> jobs;
+    int runningJobs = 0;
+    bool stopping = false;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads, the calling thread also takes part in the work
+class ThreadPool
+{
+public:
+    // A thread count of 0 uses the number of hardware threads
+    ThreadPool(int threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads working on a parallelFor (workers + calling thread)
+    int getThreadCount() const { return (int)workers.size() + 1; }
+
+    // Call job(index) for each index in [0, count) and wait until all of them are done
+    // Indices are distributed dynamically, so jobs of uneven cost are balanced between threads
+    void parallelFor(int count, const std::function<void(int)>& job);
+
+private:
+    void workerLoop();
+    void runJobs();
+
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+
+    const std::function<void(int)>* currentJob = nullptr;
+    std::atomic<int> nextIndex { 0 };
+    int jobCount = 0;
+    int busyWorkers = 0;
+    unsigned int generation = 0u;
+    bool stopping = false;
+};
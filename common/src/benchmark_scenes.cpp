@@ -0,0 +1,259 @@
+#include <cmath>
+
+#include <common/maths.hpp>
+#include <common/benchmark_scenes.hpp>
+
+#define M_PI 3.14159265358979323846
+
+// Overdraw scene: layers between 1 and 2 units in front of the camera
+#define OVERDRAW_LAYER_COUNT 16
+
+// Many lights scene: spheres by side of the grid
+#define SPHERE_GRID_SIZE 5
+
+BenchmarkMesh createGridMesh(int columns, int rows, float width, float height, float uvScale, const float4& color)
+{
+    BenchmarkMesh mesh;
+
+    // Same layout as the quads of the scene: (columns + 1) x (rows + 1) vertices shared by the faces
+    for (int i = 0; i <= columns; i++)
+    {
+        float u = (float)i / columns;
+
+        for (int j = 0; j <= rows; j++)
+        {
+            float v = (float)j / rows;
+
+            //                          pos                                         normal                  color                                   uv
+            mesh.vertices.push_back({ (u - 0.5f) * width, (v - 0.5f) * height, 0.f,   0.f, 0.f, 1.f,   color.r, color.g, color.b, color.a,   u * uvScale, v * uvScale });
+        }
+    }
+
+    for (int i = 0; i < columns; i++)
+    {
+        for (int j = 0; j < rows; j++)
+        {
+            uint32_t i00 = i * (rows + 1) + j;
+            uint32_t i10 = i00 + rows + 1;
+            uint32_t i01 = i00 + 1;
+            uint32_t i11 = i10 + 1;
+
+            mesh.indices.insert(mesh.indices.end(), { i00, i10, i11 });
+            mesh.indices.insert(mesh.indices.end(), { i11, i01, i00 });
+        }
+    }
+
+    return mesh;
+}
+
+BenchmarkMesh createSphereMesh(int slices, int stacks, float radius, const float4& color)
+{
+    BenchmarkMesh mesh;
+
+    // The slices go around the y axis (from +z toward +x) and the stacks go up, so the faces have the winding of the grid
+    for (int i = 0; i <= slices; i++)
+    {
+        float u = (float)i / slices;
+        float theta = u * 2.f * (float)M_PI;
+
+        for (int j = 0; j <= stacks; j++)
+        {
+            float v = (float)j / stacks;
+            float phi = (1.f - v) * (float)M_PI;
+
+            float3 normal = { sinf(phi) * sinf(theta), cosf(phi), sinf(phi) * cosf(theta) };
+
+            mesh.vertices.push_back({ normal.x * radius, normal.y * radius, normal.z * radius,
+                                      normal.x, normal.y, normal.z,
+                                      color.r, color.g, color.b, color.a,
+                                      u, v });
+        }
+    }
+
+    for (int i = 0; i < slices; i++)
+    {
+        for (int j = 0; j < stacks; j++)
+        {
+            uint32_t i00 = i * (stacks + 1) + j;
+            uint32_t i10 = i00 + stacks + 1;
+            uint32_t i01 = i00 + 1;
+            uint32_t i11 = i10 + 1;
+
+            // The triangles of the poles have an empty side, but they are still rasterized like the others
+            mesh.indices.insert(mesh.indices.end(), { i00, i10, i11 });
+            mesh.indices.insert(mesh.indices.end(), { i11, i01, i00 });
+        }
+    }
+
+    return mesh;
+}
+
+// Checkerboard with a gradient, so the filters and the mip levels give different colors
+static int createCheckerTexture(rdrImpl* renderer, int size)
+{
+    std::vector<uint32_t> texels(size * size);
+
+    for (int t = 0; t < size; t++)
+    {
+        for (int s = 0; s < size; s++)
+        {
+            bool isWhite = ((s / 8) + (t / 8)) % 2 == 0;
+            uint32_t r = isWhite ? 255 : (s * 255) / size;
+            uint32_t g = isWhite ? 255 : (t * 255) / size;
+            uint32_t b = isWhite ? 255 : 64;
+
+            texels[t * size + s] = r | (g << 8) | (b << 16) | (255u << 24);
+        }
+    }
+
+    return rdrCreateTexture(renderer, texels.data(), size, size, TF_SRGB8);
+}
+
+void BenchmarkScene::create(BenchmarkSceneType sceneType, rdrImpl* renderer)
+{
+    type = sceneType;
+    cameraPath = CameraPath();
+
+    switch (type)
+    {
+        case BenchmarkSceneType::CHRISTMAS:
+            christmas = scnCreate();
+            scnWaitForAssets(christmas);
+            cameraPath.orbitCenter = { 0.f, 0.f, -10.f };
+            cameraPath.orbitRadius = 10.f;
+            cameraPath.orbitHeight = 2.f;
+            break;
+
+        case BenchmarkSceneType::OVERDRAW:
+            // Still camera, the layers have the size of the view at their depth (with a margin)
+            for (int i = 0; i < OVERDRAW_LAYER_COUNT; i++)
+            {
+                float4 color = { (i % 3) == 0 ? 1.f : 0.2f, (i % 3) == 1 ? 1.f : 0.2f, (i % 3) == 2 ? 1.f : 0.2f, 0.25f };
+                meshes.push_back(createGridMesh(1, 1, 1.f, 1.f, 1.f, color));
+            }
+            rdrSetUniformBool(renderer, UT_LIGHTING, false);
+            break;
+
+        case BenchmarkSceneType::MANY_LIGHTS:
+        {
+            meshes.push_back(createSphereMesh(48, 24, 0.8f, { 1.f, 1.f, 1.f, 1.f }));
+            cameraPath.orbitCenter = { 0.f, 0.f, 0.f };
+            cameraPath.orbitRadius = 9.f;
+            cameraPath.orbitHeight = 4.f;
+
+            rdrMaterial material = { { 0.1f, 0.1f, 0.1f, 1.f }, { 0.8f, 0.8f, 0.8f, 1.f }, { 1.f, 1.f, 1.f, 1.f }, { 0.f, 0.f, 0.f, 0.f }, 32.f };
+            rdrSetUniformMaterial(renderer, &material);
+            rdrSetUniformBool(renderer, UT_PHONG_MODEL, true);
+            break;
+        }
+
+        case BenchmarkSceneType::TINY_TRIANGLES:
+        {
+            meshes.push_back(createSphereMesh(512, 256, 1.5f, { 1.f, 1.f, 1.f, 1.f }));
+
+            // Directional light from the top right
+            rdrLight light = { true, { -1.f, -1.f, -1.f, 0.f }, { 0.f, 0.f, 0.f, 1.f }, { 1.f, 0.9f, 0.7f, 1.f }, { 1.f, 1.f, 1.f, 1.f }, { 1.f, 0.f, 0.f } };
+            rdrSetUniformLight(renderer, 0, &light);
+            break;
+        }
+
+        case BenchmarkSceneType::TEXTURED_FLOOR:
+            // Camera moving forward over a large plane, its far part is minified
+            meshes.push_back(createGridMesh(32, 32, 200.f, 200.f, 64.f, { 1.f, 1.f, 1.f, 1.f }));
+            texture = createCheckerTexture(renderer, 256);
+            cameraPath.keys = { makeCameraKey({ 0.f, 1.f, 0.f }, 0.f, 15.f), makeCameraKey({ 0.f, 1.f, -20.f }, 20.f, 15.f) };
+            rdrSetUniformBool(renderer, UT_LIGHTING, false);
+            break;
+    }
+}
+
+void BenchmarkScene::destroy()
+{
+    if (christmas)
+        scnDestroy(christmas);
+
+    christmas = nullptr;
+    meshes.clear();
+    texture = -1;
+}
+
+int BenchmarkScene::getFailedLoadCount() const
+{
+    return christmas ? scnGetFailedLoadCount(christmas) : 0;
+}
+
+static void drawMesh(rdrImpl* renderer, const BenchmarkMesh& mesh, const mat4x4& model)
+{
+    mat4x4 modelMatrix = model;
+    rdrSetModel(renderer, modelMatrix.e);
+    rdrDrawIndexed(renderer, mesh.vertices.data(), (int)mesh.vertices.size(), mesh.indices.data(), (int)mesh.indices.size(), IT_UINT32);
+}
+
+void BenchmarkScene::draw(rdrImpl* renderer, Camera& camera, float time, float deltaTime)
+{
+    switch (type)
+    {
+        case BenchmarkSceneType::CHRISTMAS:
+            scnSetCameraPosition(christmas, camera.position.e);
+            scnSetCameraMatrices(christmas, camera.getProjection().e, camera.getViewMatrix().e);
+            scnUpdate(christmas, deltaTime, renderer);
+            break;
+
+        case BenchmarkSceneType::OVERDRAW:
+            // From the farthest layer, each one slides a bit so the blended colors change
+            for (int i = 0; i < OVERDRAW_LAYER_COUNT; i++)
+            {
+                float depth = 2.f - (float)i / OVERDRAW_LAYER_COUNT;
+                float offset = sinf(time + i) * 0.05f * depth;
+
+                drawMesh(renderer, meshes[i], mat4::translate({ offset, 0.f, -depth }) * mat4::scale({ 3.f * depth, 1.6f * depth, 1.f }));
+            }
+            break;
+
+        case BenchmarkSceneType::MANY_LIGHTS:
+        {
+            // The 8 point lights turn over the grid
+            for (int i = 0; i < 8; i++)
+            {
+                float angle = time * 0.5f + i * (float)M_PI / 4.f;
+                float radius = i % 2 ? 3.f : 5.f;
+
+                rdrLight light = {};
+                light.enabled = true;
+                light.position[0] = cosf(angle) * radius;
+                light.position[1] = 1.5f;
+                light.position[2] = sinf(angle) * radius;
+                light.position[3] = 1.f;
+                light.diffuse[0] = light.specular[0] = (i & 1) ? 1.f : 0.3f;
+                light.diffuse[1] = light.specular[1] = (i & 2) ? 1.f : 0.3f;
+                light.diffuse[2] = light.specular[2] = (i & 4) ? 1.f : 0.3f;
+                light.diffuse[3] = light.specular[3] = 1.f;
+                light.ambient[3] = 1.f;
+                light.attenuation[0] = 1.f;
+                light.attenuation[2] = 0.05f;
+
+                rdrSetUniformLight(renderer, i, &light);
+            }
+
+            for (int x = 0; x < SPHERE_GRID_SIZE; x++)
+            {
+                for (int z = 0; z < SPHERE_GRID_SIZE; z++)
+                {
+                    float3 position = { (x - SPHERE_GRID_SIZE / 2) * 2.f, 0.f, (z - SPHERE_GRID_SIZE / 2) * 2.f };
+                    drawMesh(renderer, meshes[0], mat4::translate(position));
+                }
+            }
+            break;
+        }
+
+        case BenchmarkSceneType::TINY_TRIANGLES:
+            drawMesh(renderer, meshes[0], mat4::translate({ 0.f, 0.f, -10.f }) * mat4::rotateY(time * 0.5f));
+            break;
+
+        case BenchmarkSceneType::TEXTURED_FLOOR:
+            rdrBindTexture(renderer, texture);
+            drawMesh(renderer, meshes[0], mat4::translate({ 0.f, 0.f, -80.f }) * mat4::rotateX(-(float)M_PI / 2.f));
+            rdrBindTexture(renderer, -1);
+            break;
+    }
+}
@@ -41,6 +41,15 @@ mat4x4 Camera::getProjection()
     return mat4::perspective(fovY * M_PI / 180.f, aspect, near, far);
 }
 
+float3 Camera::getRayDirection(float ndcX, float ndcY)
+{
+    // Direction in view space, then rotated back with the inverse rotation of the view matrix
+    float top = tanf(fovY * M_PI / 180.f * 0.5f);
+    float4 viewDirection = { ndcX * top * aspect, ndcY * top, -1.f, 0.f };
+
+    return normalized((mat4::rotateY(-yaw) * mat4::rotateX(-pitch) * viewDirection).xyz);
+}
+
 void Camera::showImGuiControls()
 {
     ImGui::SliderFloat("FOV", &fovY, 0.f, 180.f);
@@ -0,0 +1,82 @@
+#include <cmath>
+#include <cstdio>
+
+#include <common/maths.hpp>
+#include <common/camera_path.hpp>
+
+#define M_PI 3.14159265358979323846
+
+CameraKey makeCameraKey(const float3& position, float yawDegrees, float pitchDegrees)
+{
+    CameraKey key;
+    key.position = position;
+    key.yaw   = yawDegrees   * (float)M_PI / 180.f;
+    key.pitch = pitchDegrees * (float)M_PI / 180.f;
+    return key;
+}
+
+bool CameraPath::loadKeys(const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Cannot open camera path '%s'\n", filename);
+        return false;
+    }
+
+    std::vector<CameraKey> newKeys;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '#')
+            continue;
+
+        float3 position;
+        float yawDegrees, pitchDegrees;
+        if (sscanf(line, "%f %f %f %f %f", &position.x, &position.y, &position.z, &yawDegrees, &pitchDegrees) != 5)
+            continue;
+
+        newKeys.push_back(makeCameraKey(position, yawDegrees, pitchDegrees));
+    }
+    fclose(file);
+
+    if (newKeys.empty())
+    {
+        fprintf(stderr, "No camera key in '%s'\n", filename);
+        return false;
+    }
+
+    keys = newKeys;
+    orbitRadius = 0.f;
+    return true;
+}
+
+CameraKey CameraPath::sample(int frame, int frameCount) const
+{
+    CameraKey key;
+
+    if (orbitRadius != 0.f)
+    {
+        // Look at the center from the circle, the last frame is one step before the first frame of the next turn
+        float angle = 2.f * (float)M_PI * orbitTurns * frame / max(frameCount, 1);
+
+        key.position = { orbitCenter.x - sinf(angle) * orbitRadius, orbitCenter.y + orbitHeight, orbitCenter.z + cosf(angle) * orbitRadius };
+        key.yaw = angle;
+        key.pitch = atan2f(orbitHeight, fabsf(orbitRadius));
+        return key;
+    }
+
+    if (keys.size() == 1 || frameCount <= 1)
+        return keys[0];
+
+    float t = (float)frame / (frameCount - 1) * (keys.size() - 1);
+    int index = min((int)t, (int)keys.size() - 2);
+    float fraction = t - index;
+
+    const CameraKey& key0 = keys[index];
+    const CameraKey& key1 = keys[index + 1];
+    key.position = key0.position + (key1.position - key0.position) * fraction;
+    key.yaw   = key0.yaw   + (key1.yaw   - key0.yaw)   * fraction;
+    key.pitch = key0.pitch + (key1.pitch - key0.pitch) * fraction;
+    return key;
+}
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <common/headless_app.hpp>
+
+CommandLine::CommandLine(int argc, char* argv[])
+    : argc(argc), argv(argv)
+{
+}
+
+bool CommandLine::next()
+{
+    if (failed || index + 1 >= argc)
+        return false;
+
+    index++;
+    return true;
+}
+
+bool CommandLine::isOption(const char* name, int valueCount)
+{
+    if (failed || strcmp(argv[index], name) != 0)
+        return false;
+
+    if (argc - index - 1 < valueCount)
+    {
+        fprintf(stderr, "%s expects %d values\n", name, valueCount);
+        failed = true;
+        return false;
+    }
+    return true;
+}
+
+int CommandLine::nextInt()
+{
+    return atoi(nextString());
+}
+
+float CommandLine::nextFloat()
+{
+    return (float)atof(nextString());
+}
+
+const char* CommandLine::nextString()
+{
+    // isOption checked the values of the option
+    return argv[++index];
+}
+
+void CommandLine::unknownOption()
+{
+    // The option matched but its values were missing, the error is already printed
+    if (failed)
+        return;
+
+    fprintf(stderr, "Unknown option '%s'\n", argv[index]);
+    failed = true;
+}
+
+void beginHeadlessFrame(rdrImpl* renderer, std::vector<float4>& colorBuffer, std::vector<float>& depthBuffer, Camera& camera, float time, float deltaTime)
+{
+    const float4 clearColor = { 0.f, 0.f, 0.f, 1.f };
+    std::fill(colorBuffer.begin(), colorBuffer.end(), clearColor);
+    std::fill(depthBuffer.begin(), depthBuffer.end(), 0.f);
+
+    rdrSetUniformFloatV(renderer, UT_CAMERA_POS, camera.position.e);
+    rdrSetUniformFloatV(renderer, UT_DELTATIME, &deltaTime);
+    rdrSetUniformFloatV(renderer, UT_TIME, &time);
+
+    rdrSetProjection(renderer, camera.getProjection().e);
+    rdrSetView(renderer, camera.getViewMatrix().e);
+}
@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include <stb_image.h>
+
+#include <common/image_io.hpp>
+
+bool writePPM(const char* filename, const uint32_t* colors8Bits, int width, int height)
+{
+    FILE* file = fopen(filename, "wb");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Cannot write '%s'\n", filename);
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+    std::vector<uint8_t> row(width * 3);
+    for (int y = 0; y < height; y++)
+    {
+        const uint32_t* pixels = &colors8Bits[y * width];
+        for (int x = 0; x < width; x++)
+        {
+            row[x * 3 + 0] = (uint8_t)(pixels[x]);
+            row[x * 3 + 1] = (uint8_t)(pixels[x] >> 8);
+            row[x * 3 + 2] = (uint8_t)(pixels[x] >> 16);
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+
+    bool success = ferror(file) == 0;
+    fclose(file);
+    return success;
+}
+
+namespace
+{
+    const int DEFLATE_WINDOW_SIZE = 32768;
+    const int DEFLATE_MAX_LENGTH = 258;
+    const int DEFLATE_HASH_BITS = 15;
+    const int DEFLATE_MAX_CHAIN = 64;   // Previous positions with the same hash tested for a match
+
+    const int lengthBases[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const int lengthExtraBits[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const int distanceBases[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+                                    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const int distanceExtraBits[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    // Deflate bits are packed from the least significant bit of each byte
+    struct BitWriter
+    {
+        std::vector<uint8_t>& bytes;
+        uint32_t bits = 0;
+        int bitCount = 0;
+
+        BitWriter(std::vector<uint8_t>& output) : bytes(output) {}
+
+        void write(uint32_t value, int count)
+        {
+            bits |= value << bitCount;
+            bitCount += count;
+            while (bitCount >= 8)
+            {
+                bytes.push_back((uint8_t)bits);
+                bits >>= 8;
+                bitCount -= 8;
+            }
+        }
+
+        // Huffman codes are packed from their most significant bit
+        void writeCode(uint32_t code, int count)
+        {
+            uint32_t reversed = 0;
+            for (int i = 0; i < count; i++)
+                reversed |= ((code >> i) & 1) << (count - 1 - i);
+            write(reversed, count);
+        }
+
+        void flush()
+        {
+            if (bitCount > 0)
+                write(0, 8 - bitCount);
+        }
+    };
+
+    // Fixed Huffman codes of the literals, the lengths and the end of block
+    void writeSymbol(BitWriter& writer, int symbol)
+    {
+        if (symbol < 144)
+            writer.writeCode(0x30 + symbol, 8);
+        else if (symbol < 256)
+            writer.writeCode(0x190 + symbol - 144, 9);
+        else if (symbol < 280)
+            writer.writeCode(symbol - 256, 7);
+        else
+            writer.writeCode(0xc0 + symbol - 280, 8);
+    }
+
+    void writeMatch(BitWriter& writer, int length, int distance)
+    {
+        int lengthCode = 28;
+        while (lengthBases[lengthCode] > length)
+            lengthCode--;
+        writeSymbol(writer, 257 + lengthCode);
+        writer.write(length - lengthBases[lengthCode], lengthExtraBits[lengthCode]);
+
+        int distanceCode = 29;
+        while (distanceBases[distanceCode] > distance)
+            distanceCode--;
+        writer.writeCode(distanceCode, 5);
+        writer.write(distance - distanceBases[distanceCode], distanceExtraBits[distanceCode]);
+    }
+
+    uint32_t hash3(const uint8_t* bytes)
+    {
+        uint32_t value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+        return (value * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+    }
+
+    // Zlib stream of a single fixed Huffman block, the matches are found with chains of the positions with the same 3 next bytes
+    std::vector<uint8_t> zlibCompress(const std::vector<uint8_t>& data)
+    {
+        std::vector<uint8_t> output = { 0x78, 0x01 };
+        BitWriter writer(output);
+        writer.write(1, 1); // Last block
+        writer.write(1, 2); // Fixed Huffman codes
+
+        int size = (int)data.size();
+        std::vector<int> heads(1 << DEFLATE_HASH_BITS, -1);
+        std::vector<int> previous(size, -1);
+
+        auto insert = [&](int position)
+        {
+            if (position + 3 > size)
+                return;
+            uint32_t hash = hash3(&data[position]);
+            previous[position] = heads[hash];
+            heads[hash] = position;
+        };
+
+        for (int i = 0; i < size; )
+        {
+            int bestLength = 0, bestDistance = 0;
+            if (i + 3 <= size)
+            {
+                int maxLength = std::min(DEFLATE_MAX_LENGTH, size - i);
+                int candidate = heads[hash3(&data[i])];
+                for (int chain = 0; candidate >= 0 && i - candidate <= DEFLATE_WINDOW_SIZE && chain < DEFLATE_MAX_CHAIN; chain++)
+                {
+                    int length = 0;
+                    while (length < maxLength && data[candidate + length] == data[i + length])
+                        length++;
+
+                    if (length > bestLength)
+                    {
+                        bestLength = length;
+                        bestDistance = i - candidate;
+                        if (length == maxLength)
+                            break;
+                    }
+                    candidate = previous[candidate];
+                }
+            }
+
+            if (bestLength >= 3)
+            {
+                writeMatch(writer, bestLength, bestDistance);
+                for (int j = 0; j < bestLength; j++)
+                    insert(i + j);
+                i += bestLength;
+            }
+            else
+            {
+                writeSymbol(writer, data[i]);
+                insert(i);
+                i++;
+            }
+        }
+
+        writeSymbol(writer, 256);
+        writer.flush();
+
+        uint32_t a = 1, b = 0;
+        for (uint8_t byte : data)
+        {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        uint32_t adler = (b << 16) | a;
+        for (int shift = 24; shift >= 0; shift -= 8)
+            output.push_back((uint8_t)(adler >> shift));
+
+        return output;
+    }
+
+    uint32_t crc32(const uint8_t* bytes, size_t size, uint32_t crc = 0)
+    {
+        static uint32_t table[256] = {};
+        if (table[1] == 0)
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; bit++)
+                    value = (value & 1) ? 0xedb88320u ^ (value >> 1) : value >> 1;
+                table[i] = value;
+            }
+        }
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+            crc = table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    void writeChunk(FILE* file, const char* type, const std::vector<uint8_t>& data)
+    {
+        uint8_t header[8];
+        uint32_t size = (uint32_t)data.size();
+        for (int i = 0; i < 4; i++)
+        {
+            header[i] = (uint8_t)(size >> (24 - i * 8));
+            header[4 + i] = (uint8_t)type[i];
+        }
+
+        uint32_t crc = crc32(data.data(), data.size(), crc32(&header[4], 4));
+        uint8_t footer[4] = { (uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc };
+
+        fwrite(header, 1, sizeof(header), file);
+        fwrite(data.data(), 1, data.size(), file);
+        fwrite(footer, 1, sizeof(footer), file);
+    }
+
+    uint8_t paethPredictor(int a, int b, int c)
+    {
+        int p = a + b - c;
+        int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+        if (pa <= pb && pa <= pc)
+            return (uint8_t)a;
+        return (uint8_t)(pb <= pc ? b : c);
+    }
+}
+
+bool writePNG(const char* filename, const uint32_t* colors8Bits, int width, int height)
+{
+    FILE* file = fopen(filename, "wb");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Cannot write '%s'\n", filename);
+        return false;
+    }
+
+    // Each row starts with the filter that gives the smallest sum of the absolute (signed) differences
+    int rowSize = width * 3;
+    std::vector<uint8_t> filtered((size_t)(rowSize + 1) * height);
+    std::vector<uint8_t> previousRow(rowSize, 0), row(rowSize), candidate(rowSize);
+    for (int y = 0; y < height; y++)
+    {
+        const uint32_t* pixels = &colors8Bits[y * width];
+        for (int x = 0; x < width; x++)
+        {
+            row[x * 3 + 0] = (uint8_t)(pixels[x]);
+            row[x * 3 + 1] = (uint8_t)(pixels[x] >> 8);
+            row[x * 3 + 2] = (uint8_t)(pixels[x] >> 16);
+        }
+
+        uint8_t* output = &filtered[(size_t)y * (rowSize + 1)];
+        int bestCost = -1;
+        for (int filter = 0; filter < 5; filter++)
+        {
+            int cost = 0;
+            for (int i = 0; i < rowSize; i++)
+            {
+                int a = i >= 3 ? row[i - 3] : 0;
+                int b = previousRow[i];
+                int c = i >= 3 ? previousRow[i - 3] : 0;
+
+                uint8_t predictor = 0;
+                switch (filter)
+                {
+                case 1: predictor = (uint8_t)a; break;
+                case 2: predictor = (uint8_t)b; break;
+                case 3: predictor = (uint8_t)((a + b) / 2); break;
+                case 4: predictor = paethPredictor(a, b, c); break;
+                }
+
+                candidate[i] = (uint8_t)(row[i] - predictor);
+                cost += abs((int8_t)candidate[i]);
+            }
+
+            if (bestCost < 0 || cost < bestCost)
+            {
+                bestCost = cost;
+                output[0] = (uint8_t)filter;
+                std::copy(candidate.begin(), candidate.end(), output + 1);
+            }
+        }
+
+        std::swap(previousRow, row);
+    }
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    fwrite(signature, 1, sizeof(signature), file);
+
+    // 8 bits per channel, RGB, no interlacing
+    std::vector<uint8_t> header = { (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+                                    (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+                                    8, 2, 0, 0, 0 };
+    writeChunk(file, "IHDR", header);
+    writeChunk(file, "IDAT", zlibCompress(filtered));
+    writeChunk(file, "IEND", {});
+
+    bool success = ferror(file) == 0;
+    fclose(file);
+    return success;
+}
+
+bool readPNG(const char* filename, std::vector<uint32_t>& colors8Bits, int& width, int& height)
+{
+    // The scene flips the textures it loads, the images are kept from the top row on this thread
+    stbi_set_flip_vertically_on_load_thread(0);
+
+    int channels = 0;
+    uint8_t* pixels = stbi_load(filename, &width, &height, &channels, 4);
+    if (pixels == nullptr)
+        return false;
+
+    colors8Bits.resize((size_t)width * height);
+    for (size_t i = 0; i < colors8Bits.size(); i++)
+        colors8Bits[i] = pixels[i * 4] | (pixels[i * 4 + 1] << 8) | (pixels[i * 4 + 2] << 16) | ((uint32_t)pixels[i * 4 + 3] << 24);
+
+    stbi_image_free(pixels);
+    return true;
+}
+
+bool writeRawFrame(FILE* file, const uint32_t* colors8Bits, int width, int height)
+{
+    size_t pixelCount = (size_t)width * height;
+    return fwrite(colors8Bits, sizeof(uint32_t), pixelCount, file) == pixelCount;
+}
@@ -0,0 +1,75 @@
+#include <common/job_queue.hpp>
+
+JobQueue::JobQueue(int threadCount)
+{
+    if (threadCount <= 0)
+        threadCount = (int)std::thread::hardware_concurrency() - 1;
+
+    if (threadCount <= 0)
+        threadCount = 1;
+
+    for (int i = 0; i < threadCount; i++)
+        workers.emplace_back(&JobQueue::workerLoop, this);
+}
+
+JobQueue::~JobQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.clear();
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+void JobQueue::push(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wakeCondition.notify_one();
+}
+
+void JobQueue::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idleCondition.wait(lock, [this] { return jobs.empty() && runningJobs == 0; });
+}
+
+void JobQueue::cancel()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    jobs.clear();
+    idleCondition.wait(lock, [this] { return runningJobs == 0; });
+}
+
+void JobQueue::workerLoop()
+{
+    for (;;)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeCondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+            if (stopping)
+                return;
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            runningJobs++;
+        }
+
+        job();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            runningJobs--;
+        }
+        idleCondition.notify_all();
+    }
+}
@@ -0,0 +1,87 @@
+#include <common/thread_pool.hpp>
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    if (threadCount <= 0)
+        threadCount = (int)std::thread::hardware_concurrency();
+
+    // The calling thread is one of the threads
+    for (int i = 1; i < threadCount; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::runJobs()
+{
+    // Take indices until there is no more job
+    for (int index = nextIndex++; index < jobCount; index = nextIndex++)
+        (*currentJob)(index);
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& job)
+{
+    if (count <= 0)
+        return;
+
+    // No need to wake the workers for a single job
+    if (workers.empty() || count == 1)
+    {
+        for (int i = 0; i < count; i++)
+            job(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentJob = &job;
+        jobCount = count;
+        nextIndex = 0;
+        busyWorkers = (int)workers.size();
+        generation++;
+    }
+    wakeCondition.notify_all();
+
+    runJobs();
+
+    // Wait for the workers to finish their last job
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [this] { return busyWorkers == 0; });
+    currentJob = nullptr;
+}
+
+void ThreadPool::workerLoop()
+{
+    unsigned int lastGeneration = 0u;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeCondition.wait(lock, [&] { return stopping || generation != lastGeneration; });
+
+            if (stopping)
+                return;
+
+            lastGeneration = generation;
+        }
+
+        runJobs();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyWorkers--;
+        }
+        doneCondition.notify_one();
+    }
+}
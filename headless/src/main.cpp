@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include <rdr/renderer.h>
+#include <scn/scene.h>
+
+#include <common/maths.hpp>
+#include <common/camera.hpp>
+#include <common/camera_path.hpp>
+#include <common/image_io.hpp>
+#include <common/headless_app.hpp>
+
+// Renders the scene without a window: the frames stay in memory and are written as images or as a raw stream
+
+struct HeadlessOptions
+{
+    int width = 800;
+    int height = 400;
+    int frameCount = 1;
+    float deltaTime = 1.f / 60.f;
+    int msaaSampleCount = 0;            // 0 keeps the default of the renderer
+    bool printStages = false;
+
+    const char* ppmPattern = nullptr;   // printf pattern of the frame index
+    const char* rawFilename = nullptr;  // "-" for the standard output
+
+    CameraPath cameraPath;
+};
+
+static void printUsage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --size <width> <height>     Frame buffer size (800 400)\n"
+        "  --frames <count>            Frames to render (1)\n"
+        "  --dt <seconds>              Fixed time step of the scene (1/60)\n"
+        "  --msaa <samples>            MSAA sample count: 1, 2, 4, 8 or 16\n"
+        "  --camera <x> <y> <z> <yaw> <pitch>\n"
+        "                              Still camera (angles in degrees)\n"
+        "  --orbit <x> <y> <z> <radius> <height> <turns>\n"
+        "                              Orbit around a point during the frames\n"
+        "  --path <file>               Camera keys interpolated during the frames (x y z yaw pitch per line)\n"
+        "  --ppm <pattern>             Write each frame as a PPM image (e.g. frame_%%04d.ppm)\n"
+        "  --raw <file>                Write the frames as a raw RGBA8 stream from the top row ('-' for stdout)\n"
+        "  --stages                    Print the time of each stage of the renderer\n"
+        "Run from the app directory, the scene loads its assets from 'assets/'.\n",
+        program);
+}
+
+// The pattern is given to snprintf with the frame index: it needs exactly one %d (or %i, with flags and a width like %04d),
+// the other directives would read arguments that are not given
+static bool isFramePattern(const char* pattern)
+{
+    int conversionCount = 0;
+    for (const char* c = pattern; *c; c++)
+    {
+        if (*c != '%')
+            continue;
+
+        if (*++c == '%')
+            continue;
+
+        while (*c && strchr("-+ #0", *c))
+            c++;
+        while (*c >= '0' && *c <= '9')
+            c++;
+
+        if (*c != 'd' && *c != 'i')
+            return false;
+
+        conversionCount++;
+    }
+
+    return conversionCount == 1;
+}
+
+static bool parseOptions(int argc, char* argv[], HeadlessOptions& options)
+{
+    CommandLine commandLine(argc, argv);
+    while (commandLine.next())
+    {
+        if (commandLine.isOption("--size", 2))
+        {
+            options.width = commandLine.nextInt();
+            options.height = commandLine.nextInt();
+        }
+        else if (commandLine.isOption("--frames", 1))
+        {
+            options.frameCount = commandLine.nextInt();
+        }
+        else if (commandLine.isOption("--dt", 1))
+        {
+            options.deltaTime = commandLine.nextFloat();
+        }
+        else if (commandLine.isOption("--msaa", 1))
+        {
+            options.msaaSampleCount = commandLine.nextInt();
+        }
+        else if (commandLine.isOption("--camera", 5))
+        {
+            float values[5];
+            for (float& value : values)
+                value = commandLine.nextFloat();
+            options.cameraPath.keys = { makeCameraKey({ values[0], values[1], values[2] }, values[3], values[4]) };
+            options.cameraPath.orbitRadius = 0.f;
+        }
+        else if (commandLine.isOption("--orbit", 6))
+        {
+            options.cameraPath.orbitCenter.x = commandLine.nextFloat();
+            options.cameraPath.orbitCenter.y = commandLine.nextFloat();
+            options.cameraPath.orbitCenter.z = commandLine.nextFloat();
+            options.cameraPath.orbitRadius = commandLine.nextFloat();
+            options.cameraPath.orbitHeight = commandLine.nextFloat();
+            options.cameraPath.orbitTurns  = commandLine.nextFloat();
+        }
+        else if (commandLine.isOption("--path", 1))
+        {
+            if (!options.cameraPath.loadKeys(commandLine.nextString()))
+                return false;
+        }
+        else if (commandLine.isOption("--ppm", 1))
+        {
+            options.ppmPattern = commandLine.nextString();
+        }
+        else if (commandLine.isOption("--raw", 1))
+        {
+            options.rawFilename = commandLine.nextString();
+        }
+        else if (commandLine.isOption("--stages"))
+        {
+            options.printStages = true;
+        }
+        else
+            commandLine.unknownOption();
+    }
+
+    if (commandLine.hasFailed())
+        return false;
+
+    if (options.width <= 0 || options.height <= 0 || options.frameCount <= 0)
+    {
+        fprintf(stderr, "The size and the frame count have to be positive\n");
+        return false;
+    }
+
+    if (options.ppmPattern && !isFramePattern(options.ppmPattern))
+    {
+        fprintf(stderr, "The PPM pattern has to contain one %%d for the frame index (and %%%% for a '%%')\n");
+        return false;
+    }
+
+    // The renderer ignores the other counts
+    int samples = options.msaaSampleCount;
+    if (samples != 0 && samples != 1 && samples != 2 && samples != 4 && samples != 8 && samples != 16)
+    {
+        fprintf(stderr, "The MSAA sample count has to be 1, 2, 4, 8 or 16\n");
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    HeadlessOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // The timings go to the standard error if the standard output receives the frames
+    FILE* rawFile = nullptr;
+    FILE* log = stdout;
+    if (options.rawFilename)
+    {
+        if (strcmp(options.rawFilename, "-") == 0)
+        {
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            rawFile = stdout;
+            log = stderr;
+        }
+        else if ((rawFile = fopen(options.rawFilename, "wb")) == nullptr)
+        {
+            fprintf(stderr, "Cannot write '%s'\n", options.rawFilename);
+            return 1;
+        }
+    }
+
+    // Frame buffer in plain memory, the renderer also writes the final RGBA8 colors
+    const int pixelCount = options.width * options.height;
+
+    std::vector<float4>   colorBuffer(pixelCount);
+    std::vector<float>    depthBuffer(pixelCount);
+    std::vector<uint32_t> colorBuffer8Bits(pixelCount);
+    float4* colorBufferPtr = colorBuffer.data();
+
+    rdrImpl* renderer = rdrInit(reinterpret_cast<float**>(&colorBufferPtr), depthBuffer.data(), options.width, options.height);
+    rdrSetColorBuffer8Bits(renderer, colorBuffer8Bits.data());
+    rdrEnableProfiler(renderer, options.printStages);
+    if (options.msaaSampleCount > 0)
+        rdrSetMSAASampleCount(renderer, options.msaaSampleCount);
+
+    scnImpl* scene = scnCreate();
+    scnWaitForAssets(scene);
+    Camera camera(options.width, options.height);
+
+    static const char* stageNames[PS_COUNT] = { "vertex", "clipping", "culling", "binning", "raster", "fragment", "resolve", "post", "output" };
+
+    fprintf(log, "Rendering %d frames of %dx%d\n", options.frameCount, options.width, options.height);
+
+    double totalMs = 0.0;
+    double minMs = 0.0;
+    double maxMs = 0.0;
+    bool success = true;
+
+    for (int frame = 0; frame < options.frameCount && success; frame++)
+    {
+        CameraKey key = options.cameraPath.sample(frame, options.frameCount);
+        camera.position = key.position;
+        camera.yaw = key.yaw;
+        camera.pitch = key.pitch;
+
+        float time = frame * options.deltaTime;
+        float deltaTime = options.deltaTime;
+
+        auto frameStart = std::chrono::steady_clock::now();
+
+        beginHeadlessFrame(renderer, colorBuffer, depthBuffer, camera, time, deltaTime);
+
+        scnSetCameraPosition(scene, camera.position.e);
+        scnSetCameraMatrices(scene, camera.getProjection().e, camera.getViewMatrix().e);
+        scnUpdate(scene, deltaTime, renderer);
+        rdrFinish(renderer);
+
+        double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+
+        // Writing the frame is not part of its time
+        if (options.ppmPattern)
+        {
+            char filename[1024];
+            snprintf(filename, sizeof(filename), options.ppmPattern, frame);
+            success &= writePPM(filename, colorBuffer8Bits.data(), options.width, options.height);
+        }
+        if (rawFile)
+            success &= writeRawFrame(rawFile, colorBuffer8Bits.data(), options.width, options.height);
+
+        totalMs += frameMs;
+        minMs = frame == 0 ? frameMs : min(minMs, frameMs);
+        maxMs = frame == 0 ? frameMs : max(maxMs, frameMs);
+
+        fprintf(log, "frame %4d: %8.3f ms", frame, frameMs);
+        if (options.printStages)
+        {
+            rdrStats stats;
+            rdrGetStats(renderer, &stats);
+            for (int i = 0; i < PS_COUNT; i++)
+                fprintf(log, " | %s %.3f", stageNames[i], stats.stageMs[i]);
+        }
+        fprintf(log, "\n");
+    }
+
+    if (success)
+    {
+        double averageMs = totalMs / options.frameCount;
+        fprintf(log, "%d frames: average %.3f ms (%.1f fps), min %.3f ms, max %.3f ms\n",
+            options.frameCount, averageMs, averageMs > 0.0 ? 1000.0 / averageMs : 0.0, minMs, maxMs);
+    }
+
+    if (rawFile && rawFile != stdout)
+        fclose(rawFile);
+
+    scnDestroy(scene);
+    rdrShutdown(renderer);
+
+    return success ? 0 : 1;
+}
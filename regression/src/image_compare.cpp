@@ -0,0 +1,99 @@
+#include <cstdlib>
+
+#include <common/maths.hpp>
+
+#include "image_compare.hpp"
+
+// Size in pixels of the square windows of the structural similarity
+#define SSIM_WINDOW_SIZE 8
+
+static int getChannel(uint32_t color, int channel)
+{
+    return (color >> (channel * 8)) & 255;
+}
+
+static float getLuminance(uint32_t color)
+{
+    return 0.2126f * getChannel(color, 0) + 0.7152f * getChannel(color, 1) + 0.0722f * getChannel(color, 2);
+}
+
+// Mean of the SSIM of the windows (Wang et al. 2004), computed on the luminances in [0, 255]
+// It stays close to 1 for a noise of a few values or an edge moved by a pixel, but drops if the structure changes
+static float computeSSIM(const uint32_t* image, const uint32_t* reference, int width, int height)
+{
+    const float c1 = (0.01f * 255.f) * (0.01f * 255.f);
+    const float c2 = (0.03f * 255.f) * (0.03f * 255.f);
+
+    double ssimSum = 0.0;
+    int windowCount = 0;
+
+    for (int y0 = 0; y0 < height; y0 += SSIM_WINDOW_SIZE)
+    {
+        for (int x0 = 0; x0 < width; x0 += SSIM_WINDOW_SIZE)
+        {
+            int x1 = min(x0 + SSIM_WINDOW_SIZE, width);
+            int y1 = min(y0 + SSIM_WINDOW_SIZE, height);
+            float count = (float)((x1 - x0) * (y1 - y0));
+
+            float sumA = 0.f, sumB = 0.f, sumAA = 0.f, sumBB = 0.f, sumAB = 0.f;
+            for (int y = y0; y < y1; y++)
+            {
+                for (int x = x0; x < x1; x++)
+                {
+                    float a = getLuminance(image[y * width + x]);
+                    float b = getLuminance(reference[y * width + x]);
+
+                    sumA += a;
+                    sumB += b;
+                    sumAA += a * a;
+                    sumBB += b * b;
+                    sumAB += a * b;
+                }
+            }
+
+            float meanA = sumA / count;
+            float meanB = sumB / count;
+            float varianceA  = sumAA / count - meanA * meanA;
+            float varianceB  = sumBB / count - meanB * meanB;
+            float covariance = sumAB / count - meanA * meanB;
+
+            ssimSum += ((2.f * meanA * meanB + c1) * (2.f * covariance + c2)) /
+                       ((meanA * meanA + meanB * meanB + c1) * (varianceA + varianceB + c2));
+            windowCount++;
+        }
+    }
+
+    return windowCount > 0 ? (float)(ssimSum / windowCount) : 1.f;
+}
+
+CompareResult compareImages(const uint32_t* image, const uint32_t* reference, int width, int height,
+                            const CompareTolerance& tolerance, std::vector<uint32_t>* diffImage)
+{
+    CompareResult result;
+
+    if (diffImage)
+        diffImage->resize((size_t)width * height);
+
+    for (int i = 0; i < width * height; i++)
+    {
+        int difference = 0;
+        for (int channel = 0; channel < 3; channel++)
+            difference = max(difference, abs(getChannel(image[i], channel) - getChannel(reference[i], channel)));
+
+        bool isDifferent = difference > tolerance.channelThreshold;
+        result.differentPixelCount += isDifferent;
+        result.maxChannelDifference = max(result.maxChannelDifference, difference);
+
+        if (diffImage)
+        {
+            uint32_t gray = (uint32_t)min(difference * 4, 255);
+            (*diffImage)[i] = isDifferent ? 0xff0000ffu : gray | (gray << 8) | (gray << 16) | (255u << 24);
+        }
+    }
+
+    result.differentPixels = width * height > 0 ? (float)result.differentPixelCount / (width * height) : 0.f;
+    result.ssim = computeSSIM(image, reference, width, height);
+    result.passed = result.differentPixels <= tolerance.maxDifferentPixels && result.ssim >= tolerance.minSSIM;
+
+    return result;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Thresholds of the comparison of an image with its reference
+struct CompareTolerance
+{
+    int   channelThreshold = 8;         // A pixel differs if one of its channels differs by more (out of 255)
+    float maxDifferentPixels = 0.001f;  // Greatest fraction of different pixels
+    float minSSIM = 0.98f;              // Lowest mean structural similarity of the luminances
+};
+
+struct CompareResult
+{
+    int   differentPixelCount = 0;
+    float differentPixels = 0.f;        // Fraction of the pixels
+    int   maxChannelDifference = 0;
+    float ssim = 1.f;
+
+    bool passed = false;
+};
+
+// Compare two RGBA8 images of the same size (the alpha is ignored)
+// The diff image shows the differences amplified in gray and the different pixels in red
+CompareResult compareImages(const uint32_t* image, const uint32_t* reference, int width, int height,
+                            const CompareTolerance& tolerance, std::vector<uint32_t>* diffImage);
@@ -0,0 +1,370 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <rdr/renderer.h>
+
+#include <common/maths.hpp>
+#include <common/camera.hpp>
+#include <common/benchmark_scenes.hpp>
+#include <common/headless_app.hpp>
+#include <common/image_io.hpp>
+
+#include "image_compare.hpp"
+
+// Renders the scenes of the benchmark with combinations of the renderer features and compares them with reference images
+// The references are written by --update from a trusted version, then each optimization of the renderer is checked against them
+
+struct RegressionCase
+{
+    std::string name;
+    BenchmarkSceneType scene;
+
+    int msaaSampleCount = 4;
+    bool msaa = true;
+    bool blending = true;
+    rdrFaceToCull faceToCull = FC_BACK;
+    rdrTextureFilter textureFilter = FT_NEAREST;
+    int phongModel = -1;        // -1 keeps the shading model chosen by the scene
+
+    // Case with this feature off or set differently, the images have to differ (else the feature is not used by the renderer)
+    std::string variantOf;
+    const char* feature = nullptr;
+};
+
+// Each scene is rendered with its default settings, then with one feature changed at a time
+static std::vector<RegressionCase> getCases()
+{
+    struct SceneFeatures
+    {
+        const char* name;
+        BenchmarkSceneType scene;
+        bool hasTransparency;
+        bool isLit;
+        bool isTextured;
+        bool hasEdges;          // Triangle edges are visible in the frame (the quads of the overdraw cover it)
+    };
+
+    // The christmas scene is not a case: its tree (assets/christmas-tree/christmas-tree.obj) is not in the repository,
+    // and without it the scene doesn't show the textures and the transparency of its features
+    static const SceneFeatures scenes[] =
+    {
+        { "overdraw",       BenchmarkSceneType::OVERDRAW,       true,  false, false, false },
+        { "many_lights",    BenchmarkSceneType::MANY_LIGHTS,    false, true,  false, true  },
+        { "tiny_triangles", BenchmarkSceneType::TINY_TRIANGLES, false, true,  false, true  },
+        { "textured_floor", BenchmarkSceneType::TEXTURED_FLOOR, false, false, true,  true  },
+    };
+
+    std::vector<RegressionCase> cases;
+
+    for (const SceneFeatures& scene : scenes)
+    {
+        RegressionCase base;
+        base.name = scene.name;
+        base.scene = scene.scene;
+
+        auto add = [&](const char* suffix) -> RegressionCase&
+        {
+            cases.push_back(base);
+            cases.back().name += suffix;
+            return cases.back();
+        };
+
+        auto addVariant = [&](const char* suffix, const char* baseSuffix, const char* feature) -> RegressionCase&
+        {
+            RegressionCase& variant = add(suffix);
+            variant.variantOf = scene.name + std::string(baseSuffix);
+            variant.feature = feature;
+            return variant;
+        };
+
+        // The default sample count is 4, the other ones only change the edges
+        add("");
+        add("_msaa_off").msaa = false;
+
+        if (scene.hasEdges)
+        {
+            addVariant("_msaa_2x", "", "MSAA sample count").msaaSampleCount = 2;
+            addVariant("_msaa_16x", "", "MSAA sample count").msaaSampleCount = 16;
+        }
+        else
+        {
+            add("_msaa_2x").msaaSampleCount = 2;
+            add("_msaa_16x").msaaSampleCount = 16;
+        }
+
+        add("_cull_none").faceToCull = FC_NONE;
+        add("_cull_front").faceToCull = FC_FRONT;
+
+        if (scene.hasTransparency)
+            addVariant("_no_blending", "", "blending").blending = false;
+
+        // One of the models is the default of the scene, so they are compared with each other
+        if (scene.isLit)
+        {
+            add("_gouraud").phongModel = 0;
+            addVariant("_phong", "_gouraud", "shading model").phongModel = 1;
+        }
+
+        if (scene.isTextured)
+        {
+            addVariant("_bilinear", "", "texture filter").textureFilter = FT_BILINEAR;
+            addVariant("_trilinear", "_bilinear", "texture filter").textureFilter = FT_TRILINEAR;
+        }
+    }
+
+    return cases;
+}
+
+struct RegressionOptions
+{
+    int width = 640;
+    int height = 360;
+    bool update = false;
+
+    std::string referenceDirectory = "../regression/references";
+    std::string outputDirectory = "regression_output";
+    std::vector<std::string> filters;   // Only the cases containing one of these names are run
+
+    CompareTolerance tolerance;
+};
+
+static void printUsage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --size <width> <height>     Frame buffer size (640 360)\n"
+        "  --update                    Write the reference images instead of comparing with them\n"
+        "  --references <directory>    Reference images (../regression/references)\n"
+        "  --output <directory>        Rendered and diff images of the failed cases (regression_output)\n"
+        "  --only <name>               Only run the cases containing the name (can be repeated)\n"
+        "  --threshold <value>         Channel difference (out of 255) above which a pixel differs (8)\n"
+        "  --max-pixels <fraction>     Greatest fraction of different pixels (0.001)\n"
+        "  --min-ssim <value>          Lowest structural similarity (0.98)\n"
+        "  --list                      Print the names of the cases\n"
+        "Run from the app directory, the christmas scene loads its assets from 'assets/'.\n",
+        program);
+}
+
+static bool parseOptions(int argc, char* argv[], RegressionOptions& options)
+{
+    CommandLine commandLine(argc, argv);
+    while (commandLine.next())
+    {
+        if (commandLine.isOption("--size", 2))
+        {
+            options.width = commandLine.nextInt();
+            options.height = commandLine.nextInt();
+        }
+        else if (commandLine.isOption("--update"))
+        {
+            options.update = true;
+        }
+        else if (commandLine.isOption("--references", 1))
+        {
+            options.referenceDirectory = commandLine.nextString();
+        }
+        else if (commandLine.isOption("--output", 1))
+        {
+            options.outputDirectory = commandLine.nextString();
+        }
+        else if (commandLine.isOption("--only", 1))
+        {
+            options.filters.push_back(commandLine.nextString());
+        }
+        else if (commandLine.isOption("--threshold", 1))
+        {
+            options.tolerance.channelThreshold = commandLine.nextInt();
+        }
+        else if (commandLine.isOption("--max-pixels", 1))
+        {
+            options.tolerance.maxDifferentPixels = commandLine.nextFloat();
+        }
+        else if (commandLine.isOption("--min-ssim", 1))
+        {
+            options.tolerance.minSSIM = commandLine.nextFloat();
+        }
+        else if (commandLine.isOption("--list"))
+        {
+            for (const RegressionCase& regressionCase : getCases())
+                printf("%s\n", regressionCase.name.c_str());
+            exit(0);
+        }
+        else
+            commandLine.unknownOption();
+    }
+
+    if (commandLine.hasFailed())
+        return false;
+
+    if (options.width <= 0 || options.height <= 0)
+    {
+        fprintf(stderr, "The size has to be positive\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Render one frame of the case, at a fixed time and position of the camera path
+// failedLoadCount is the count of the assets of the scene that could not be loaded, the image is not valid without them
+static std::vector<uint32_t> renderCase(const RegressionCase& regressionCase, int width, int height, int& failedLoadCount)
+{
+    const int pixelCount = width * height;
+
+    std::vector<float4>   colorBuffer(pixelCount);
+    std::vector<float>    depthBuffer(pixelCount);
+    std::vector<uint32_t> colorBuffer8Bits(pixelCount);
+    float4* colorBufferPtr = colorBuffer.data();
+
+    rdrImpl* renderer = rdrInit(reinterpret_cast<float**>(&colorBufferPtr), depthBuffer.data(), width, height);
+    rdrSetColorBuffer8Bits(renderer, colorBuffer8Bits.data());
+
+    BenchmarkScene scene;
+    scene.create(regressionCase.scene, renderer);
+    failedLoadCount = scene.getFailedLoadCount();
+
+    // The case settings override the ones of the scene
+    rdrSetMSAASampleCount(renderer, regressionCase.msaaSampleCount);
+    rdrSetUniformBool(renderer, UT_MSAA, regressionCase.msaa);
+    rdrSetUniformBool(renderer, UT_BLENDING, regressionCase.blending);
+    rdrSetUniformInt(renderer, UT_FACE_TO_CULL, regressionCase.faceToCull);
+    rdrSetUniformInt(renderer, UT_TEXTURE_FILTER, regressionCase.textureFilter);
+    if (regressionCase.phongModel >= 0)
+        rdrSetUniformBool(renderer, UT_PHONG_MODEL, regressionCase.phongModel != 0);
+
+    Camera camera(width, height);
+    CameraKey key = scene.cameraPath.sample(1, 4);
+    camera.position = key.position;
+    camera.yaw = key.yaw;
+    camera.pitch = key.pitch;
+
+    float time = 1.f;
+    float deltaTime = 1.f;
+
+    beginHeadlessFrame(renderer, colorBuffer, depthBuffer, camera, time, deltaTime);
+
+    scene.draw(renderer, camera, time, deltaTime);
+    rdrFinish(renderer);
+
+    scene.destroy();
+    rdrShutdown(renderer);
+
+    return colorBuffer8Bits;
+}
+
+int main(int argc, char* argv[])
+{
+    RegressionOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(options.update ? options.referenceDirectory : options.outputDirectory, error);
+
+    int caseCount = 0;
+    int failedCount = 0;
+
+    // Images of the cases, the variants are compared with their base once all the cases are rendered
+    std::map<std::string, std::vector<uint32_t>> images;
+    const std::vector<RegressionCase> cases = getCases();
+
+    for (const RegressionCase& regressionCase : cases)
+    {
+        bool isSelected = options.filters.empty();
+        for (const std::string& filter : options.filters)
+            isSelected |= regressionCase.name.find(filter) != std::string::npos;
+
+        if (!isSelected)
+            continue;
+
+        caseCount++;
+        int failedLoadCount = 0;
+        std::vector<uint32_t> image = renderCase(regressionCase, options.width, options.height, failedLoadCount);
+
+        // An image without some of its assets would pass against a reference missing them too
+        if (failedLoadCount > 0)
+        {
+            failedCount++;
+            printf("FAIL   %-32s %d assets of the scene could not be loaded\n", regressionCase.name.c_str(), failedLoadCount);
+            continue;
+        }
+
+        images[regressionCase.name] = image;
+
+        std::string referenceFilename = options.referenceDirectory + "/" + regressionCase.name + ".png";
+
+        if (options.update)
+        {
+            bool written = writePNG(referenceFilename.c_str(), image.data(), options.width, options.height);
+            failedCount += !written;
+            printf("%-6s %s\n", written ? "UPDATE" : "ERROR", regressionCase.name.c_str());
+            continue;
+        }
+
+        std::vector<uint32_t> reference;
+        int referenceWidth = 0, referenceHeight = 0;
+        bool hasReference = readPNG(referenceFilename.c_str(), reference, referenceWidth, referenceHeight);
+        bool isSameSize = referenceWidth == options.width && referenceHeight == options.height;
+
+        std::vector<uint32_t> diffImage;
+        CompareResult result;
+        if (hasReference && isSameSize)
+            result = compareImages(image.data(), reference.data(), options.width, options.height, options.tolerance, &diffImage);
+
+        if (result.passed)
+        {
+            printf("PASS   %-32s different pixels %6.3f%% (max %3d), SSIM %.5f\n",
+                regressionCase.name.c_str(), result.differentPixels * 100.f, result.maxChannelDifference, result.ssim);
+            continue;
+        }
+
+        failedCount++;
+
+        if (!hasReference)
+            printf("FAIL   %-32s no reference image '%s'\n", regressionCase.name.c_str(), referenceFilename.c_str());
+        else if (!isSameSize)
+            printf("FAIL   %-32s reference size %dx%d\n", regressionCase.name.c_str(), referenceWidth, referenceHeight);
+        else
+            printf("FAIL   %-32s different pixels %6.3f%% (max %3d), SSIM %.5f\n",
+                regressionCase.name.c_str(), result.differentPixels * 100.f, result.maxChannelDifference, result.ssim);
+
+        // Keep the rendered image (and the differences) to look at the failure
+        std::string outputPrefix = options.outputDirectory + "/" + regressionCase.name;
+        writePNG((outputPrefix + "_actual.png").c_str(), image.data(), options.width, options.height);
+        if (!diffImage.empty())
+            writePNG((outputPrefix + "_diff.png").c_str(), diffImage.data(), options.width, options.height);
+    }
+
+    printf("%d/%d cases %s\n", caseCount - failedCount, caseCount, options.update ? "updated" : "passed");
+
+    // A feature ignored by the renderer would give the image of the base case (and a reference matching it)
+    int sameImageCount = 0;
+    for (const RegressionCase& variant : cases)
+    {
+        auto variantImage = images.find(variant.name);
+        auto baseImage = images.find(variant.variantOf);
+        if (variant.variantOf.empty() || variantImage == images.end() || baseImage == images.end())
+            continue;
+
+        CompareTolerance exact;
+        exact.channelThreshold = 0;
+        CompareResult result = compareImages(variantImage->second.data(), baseImage->second.data(), options.width, options.height, exact, nullptr);
+
+        if (result.differentPixelCount == 0)
+        {
+            sameImageCount++;
+            printf("FAIL   %s and %s are the same image, the %s is not used\n", variant.name.c_str(), variant.variantOf.c_str(), variant.feature);
+        }
+    }
+
+    return failedCount == 0 && sameImageCount == 0 ? 0 : 1;
+}
@@ -1,10 +1,14 @@
 #pragma once
 
+#if defined(_WIN32)
 #ifdef RDR_EXPORTS
 #define RDR_API __declspec(dllexport)
 #else
 #define RDR_API __declspec(dllimport)
 #endif
+#else
+#define RDR_API __attribute__((visibility("default")))
+#endif
 
 #ifdef __cplusplus
 extern "C"
@@ -42,9 +46,59 @@ enum rdrUniformType
     UT_GLOBAL_COLOR,     // 4 floats
     UT_DEPTH_TEST,      // 1 bool
     UT_STENCIL_TEST,    // 1 bool
+    UT_MSAA,            // 1 bool
+    UT_BLENDING,        // 1 bool
+    UT_LIGHTING,        // 1 bool
+    UT_PHONG_MODEL,     // 1 bool
+    UT_TEXTURE_FILTER,  // 1 int (rdrTextureFilter)
+    UT_FACE_TO_CULL,    // 1 int (rdrFaceToCull)
+    UT_VERTEX_ALPHA,    // 1 int (rdrVertexAlpha)
     UT_USER = 100,
 };
 
+enum rdrTextureFilter
+{
+    FT_NEAREST,
+    FT_BILINEAR,
+    FT_TRILINEAR,
+};
+
+enum rdrFaceToCull
+{
+    FC_NONE,
+    FC_BACK,
+    FC_FRONT,
+    FC_FRONT_AND_BACK,
+};
+
+// Alpha of the vertices of the next draws, the deferred shading draws the transparent ones with the forward path
+enum rdrVertexAlpha
+{
+    VA_UNKNOWN,     // Each draw reads its vertices (default)
+    VA_ONE,         // All the vertices have an alpha of 1
+    VA_UNDER_ONE,   // Some vertices have an alpha under 1
+};
+
+enum rdrPostProcess
+{
+    PP_BOX_BLUR,
+    PP_GAUSSIAN_BLUR,
+    PP_LIGHT_BLOOM,
+};
+
+enum rdrTextureFormat
+{
+    TF_RGBA32F, // 4 floats per texel, kept as floats
+    TF_RGBA8,   // 4 bytes per texel, linear
+    TF_SRGB8,   // 4 bytes per texel, sRGB encoded RGB and linear alpha
+};
+
+enum rdrIndexType
+{
+    IT_UINT16,
+    IT_UINT32,
+};
+
 typedef struct rdrMaterial
 {
     float ambientColor[4];
@@ -54,6 +108,41 @@ typedef struct rdrMaterial
     float shininess;
 } rdrMaterial;
 
+// Stages timed by the profiler
+enum rdrProfileStage
+{
+    PS_VERTEX_SHADING,
+    PS_CLIPPING,
+    PS_CULLING,         // Triangle setup, frustum and face culling
+    PS_BINNING,
+    PS_RASTERIZATION,
+    PS_FRAGMENT_SHADING,
+    PS_MSAA_RESOLVE,
+    PS_POST_PROCESS,
+    PS_OUTPUT,          // Tonemapping and gamma
+    PS_COUNT,
+};
+
+// Statistics of a frame measured by the profiler
+// The stages run by the workers give the sum of the time of each thread
+typedef struct rdrStats
+{
+    float frameMs;                  // Time between the ends of the last two rdrFinish
+    float stageMs[PS_COUNT];
+
+    int vertices;
+    int triangles;
+    int trianglesCulled;            // Outside of the frustum, back faces or clipped out
+    int trianglesClipped;
+    int trianglesRasterized;        // Counted once per tile with the tiled rendering
+    int trianglesOccluded;          // Rejected by the hierarchical Z, counted once per tile
+
+    int fragmentsTested;            // Covered by a triangle, before the depth test
+    int fragmentsDepthKilled;
+    int fragmentsShaded;
+    float overdraw;                 // Shaded fragments per pixel
+} rdrStats;
+
 // Init/Shutdown function
 // Color and depth buffer have to be valid until the shutdown of the renderer
 // Color buffer is RGBA, each component is a 32 bits float
@@ -61,12 +150,21 @@ typedef struct rdrMaterial
 RDR_API rdrImpl* rdrInit(float** colorBuffer32Bits, float* depthBuffer, int width, int height);
 RDR_API void rdrShutdown(rdrImpl* renderer);
 
+// Different for each renderer created by rdrInit (even at the address of a destroyed one), to key the resources created in it
+RDR_API unsigned int rdrGetInstanceId(rdrImpl* renderer);
+
+// Optional RGBA8 color buffer (one 32 bits value per pixel, red in the low byte), filled by rdrFinish with the final colors
+// It has to be valid until the shutdown of the renderer or until it is replaced (nullptr to disable it)
+RDR_API void rdrSetColorBuffer8Bits(rdrImpl* renderer, unsigned int* colorBuffer8Bits);
+
 // Post-process events
 RDR_API void rdrFinish(rdrImpl* renderer);
 
 // Set differents parameters for the renderer
 RDR_API void rdrSetUniformFloatV(rdrImpl* renderer, rdrUniformType type, float* value);
 RDR_API void rdrSetUniformBool(rdrImpl* renderer, rdrUniformType type, bool value);
+RDR_API void rdrSetUniformInt(rdrImpl* renderer, rdrUniformType type, int value);
+RDR_API void rdrSetMSAASampleCount(rdrImpl* renderer, int sampleCount); // 1, 2, 4, 8 or 16 samples, used from the next frame (or from this one if nothing is drawn yet)
 RDR_API void rdrSetUniformLight(rdrImpl* renderer, int index, rdrLight* light);
 RDR_API void rdrSetUniformMaterial(rdrImpl* renderer, rdrMaterial* material);
 
@@ -76,12 +174,41 @@ RDR_API void rdrSetView(rdrImpl* renderer, float* viewMatrix);
 RDR_API void rdrSetModel(rdrImpl* renderer, float* modelMatrix);
 RDR_API void rdrSetViewport(rdrImpl* renderer, int x, int y, int width, int height);
 
+// Post-process effects applied by rdrFinish
+RDR_API void rdrEnablePostProcess(rdrImpl* renderer, rdrPostProcess effect, bool enabled);
+
+// Profiler: the stages are only timed and counted when it is enabled
+RDR_API void rdrEnableProfiler(rdrImpl* renderer, bool enabled);
+RDR_API void rdrGetStats(rdrImpl* renderer, rdrStats* stats); // Statistics of the last finished frame
+
 // Texture setup
+// Triangles are rasterized in rdrFinish with tiled rendering, the texture has to be valid until then
 RDR_API void rdrSetTexture(rdrImpl* renderer, float* colors32Bits, int width, int height);
 
+// Texture upload: the texels are copied and the mipmaps are built once (needed by the trilinear filter)
+// The texels are given row by row, 8 bits formats are stored swizzled and only converted to floats by the sampler
+// The texture is owned by the renderer until its shutdown, return the id of the texture (-1 if the data is invalid)
+RDR_API int rdrCreateTexture(rdrImpl* renderer, const void* texels, int width, int height, rdrTextureFormat format);
+
+// Use an uploaded texture for the next draws (-1 to draw without texture)
+RDR_API void rdrBindTexture(rdrImpl* renderer, int texture);
+
 // Draw a list of triangles
 RDR_API void rdrDrawTriangles(rdrImpl* renderer, const rdrVertex* vertices, int vertexCount);
 
+// Draw a list of triangles given by 3 indices each, the vertices shared by the triangles are only shaded once
+RDR_API void rdrDrawIndexed(rdrImpl* renderer, const rdrVertex* vertices, int vertexCount, const void* indices, int indexCount, rdrIndexType indexType);
+
+// Draw the triangles once for each instance, with its model matrix (16 floats, like rdrSetModel) and its color (4 floats, multiplied by the global color)
+// The colors can be null, the other states (material, texture...) are shared by the instances
+RDR_API void rdrDrawTrianglesInstanced(rdrImpl* renderer, const rdrVertex* vertices, int vertexCount, const float* modelMatrices, const float* colors, int instanceCount);
+RDR_API void rdrDrawIndexedInstanced(rdrImpl* renderer, const rdrVertex* vertices, int vertexCount, const void* indices, int indexCount, rdrIndexType indexType,
+                                     const float* modelMatrices, const float* colors, int instanceCount);
+
+// Occlusion query: true if the world space box (with the current projection and view) is behind the depths drawn since the last clear
+// The triangles drawn before are rasterized first, so a query is a synchronization point between the draws
+RDR_API bool rdrIsBoxOccluded(rdrImpl* renderer, const float* boxMin, const float* boxMax);
+
 struct ImGuiContext;
 RDR_API void rdrSetImGuiContext(rdrImpl* renderer, struct ImGuiContext* context);
 RDR_API void rdrShowImGuiControls(rdrImpl* renderer);
@@ -0,0 +1,287 @@
+#include <immintrin.h>
+
+#include <common/maths.hpp>
+
+#include "post_process.hpp"
+
+void PostProcessBuffers::resize(int width, int height)
+{
+    pingPong.resize(width, height);
+    stripeSums.resize(width, (height + POST_PROCESS_STRIPE_HEIGHT - 1) / POST_PROCESS_STRIPE_HEIGHT);
+
+    for (int i = 0; i < BLOOM_LEVEL_COUNT; i++)
+    {
+        width  = max(1, (width  + 1) / 2);
+        height = max(1, (height + 1) / 2);
+
+        bloomLevels[i].resize(width, height);
+        bloomPingPongs[i].resize(width, height);
+    }
+}
+
+// Call job(yMin, yMax) for each stripe of rows of the image
+template <typename Job>
+void forEachStripe(ThreadPool& threadPool, int height, const Job& job)
+{
+    int stripeCount = (height + POST_PROCESS_STRIPE_HEIGHT - 1) / POST_PROCESS_STRIPE_HEIGHT;
+
+    threadPool.parallelFor(stripeCount, [&](int stripe)
+    {
+        int yMin = stripe * POST_PROCESS_STRIPE_HEIGHT;
+        job(yMin, min(yMin + POST_PROCESS_STRIPE_HEIGHT, height));
+    });
+}
+
+#pragma region Separable box filter
+// The pixels outside of the image have the color of the closest edge pixel
+void boxPassHorizontal(ThreadPool& threadPool, const float4* src, float4* dst, int width, int height, int radius)
+{
+    const float weight = 1.f / (2 * radius + 1);
+
+    forEachStripe(threadPool, height, [&](int yMin, int yMax)
+    {
+        for (int y = yMin; y < yMax; y++)
+        {
+            const float4* srcRow = &src[y * width];
+            float4* dstRow = &dst[y * width];
+
+            // Running sum of the pixels of the window
+            float4 sum = { 0.f, 0.f, 0.f, 0.f };
+            for (int x = -radius; x <= radius; x++)
+                sum += srcRow[min(max(x, 0), width - 1)];
+
+            for (int x = 0; x < width; x++)
+            {
+                dstRow[x] = sum * weight;
+                sum += srcRow[min(x + radius + 1, width - 1)] - srcRow[max(x - radius, 0)];
+            }
+        }
+    });
+}
+
+// The rows are read in order, each stripe keeps a running sum per column (in its row of stripeSums)
+void boxPassVertical(ThreadPool& threadPool, const float4* src, float4* dst, int width, int height, int radius, PostProcessImage& stripeSums)
+{
+    const float weight = 1.f / (2 * radius + 1);
+
+    forEachStripe(threadPool, height, [&](int yMin, int yMax)
+    {
+        float4* sums = &stripeSums.pixels[(yMin / POST_PROCESS_STRIPE_HEIGHT) * stripeSums.width];
+        for (int x = 0; x < width; x++)
+            sums[x] = { 0.f, 0.f, 0.f, 0.f };
+
+        for (int y = yMin - radius; y <= yMin + radius; y++)
+        {
+            const float4* srcRow = &src[min(max(y, 0), height - 1) * width];
+            for (int x = 0; x < width; x++)
+                sums[x] += srcRow[x];
+        }
+
+        for (int y = yMin; y < yMax; y++)
+        {
+            const float4* addedRow   = &src[min(y + radius + 1, height - 1) * width];
+            const float4* removedRow = &src[max(y - radius, 0) * width];
+            float4* dstRow = &dst[y * width];
+
+            for (int x = 0; x < width; x++)
+            {
+                dstRow[x] = sums[x] * weight;
+                sums[x] += addedRow[x] - removedRow[x];
+            }
+        }
+    });
+}
+#pragma endregion
+
+void boxBlur(ThreadPool& threadPool, float4* colors, int width, int height, int radius, PostProcessImage& pingPong, PostProcessImage& stripeSums)
+{
+    boxPassHorizontal(threadPool, colors, pingPong.pixels.data(), width, height, radius);
+    boxPassVertical(threadPool, pingPong.pixels.data(), colors, width, height, radius, stripeSums);
+}
+
+void gaussianBlur(ThreadPool& threadPool, float4* colors, int width, int height, int radius, PostProcessImage& pingPong, PostProcessImage& stripeSums)
+{
+    // Three box filters converge to a gaussian filter
+    for (int i = 0; i < 3; i++)
+        boxBlur(threadPool, colors, width, height, radius, pingPong, stripeSums);
+}
+
+#pragma region Light bloom
+// Each pixel of the destination is the average of 2x2 pixels of the source
+// The first level only keeps the part of the colors above the threshold
+void downsample(ThreadPool& threadPool, const float4* src, int srcWidth, int srcHeight, PostProcessImage& dst, float threshold, bool brightPass)
+{
+    forEachStripe(threadPool, dst.height, [&](int yMin, int yMax)
+    {
+        for (int y = yMin; y < yMax; y++)
+        {
+            const float4* srcRow0 = &src[min(2 * y,     srcHeight - 1) * srcWidth];
+            const float4* srcRow1 = &src[min(2 * y + 1, srcHeight - 1) * srcWidth];
+
+            for (int x = 0; x < dst.width; x++)
+            {
+                int x0 = min(2 * x,     srcWidth - 1);
+                int x1 = min(2 * x + 1, srcWidth - 1);
+
+                float4 color = (srcRow0[x0] + srcRow0[x1] + srcRow1[x0] + srcRow1[x1]) * 0.25f;
+
+                if (brightPass)
+                    color = { max(color.r - threshold, 0.f), max(color.g - threshold, 0.f), max(color.b - threshold, 0.f), 0.f };
+
+                dst.pixels[y * dst.width + x] = color;
+            }
+        }
+    });
+}
+
+// Add the bilinear upsampling of the source to the destination (twice larger)
+void addUpsampled(ThreadPool& threadPool, const PostProcessImage& src, float4* dst, int dstWidth, int dstHeight, float intensity)
+{
+    forEachStripe(threadPool, dstHeight, [&](int yMin, int yMax)
+    {
+        for (int y = yMin; y < yMax; y++)
+        {
+            // Position of the pixel center in the source
+            float v = max((y + 0.5f) * 0.5f - 0.5f, 0.f);
+            int y0 = min((int)v, src.height - 1);
+            int y1 = min(y0 + 1, src.height - 1);
+            float fy = v - y0;
+
+            const float4* srcRow0 = &src.pixels[y0 * src.width];
+            const float4* srcRow1 = &src.pixels[y1 * src.width];
+            float4* dstRow = &dst[y * dstWidth];
+
+            for (int x = 0; x < dstWidth; x++)
+            {
+                float u = max((x + 0.5f) * 0.5f - 0.5f, 0.f);
+                int x0 = min((int)u, src.width - 1);
+                int x1 = min(x0 + 1, src.width - 1);
+                float fx = u - x0;
+
+                float4 top    = srcRow0[x0] * (1.f - fx) + srcRow0[x1] * fx;
+                float4 bottom = srcRow1[x0] * (1.f - fx) + srcRow1[x1] * fx;
+                float4 color  = (top * (1.f - fy) + bottom * fy) * intensity;
+
+                // The alpha of the bright pass is 0, so the alpha of the destination is kept
+                dstRow[x] += color;
+            }
+        }
+    });
+}
+#pragma endregion
+
+void lightBloom(ThreadPool& threadPool, float4* colors, int width, int height, float threshold, float intensity, PostProcessBuffers& buffers)
+{
+    // Bright pass at half resolution, then successive downsamples
+    downsample(threadPool, colors, width, height, buffers.bloomLevels[0], threshold, true);
+
+    for (int i = 1; i < BLOOM_LEVEL_COUNT; i++)
+    {
+        const PostProcessImage& src = buffers.bloomLevels[i - 1];
+        downsample(threadPool, src.pixels.data(), src.width, src.height, buffers.bloomLevels[i], threshold, false);
+    }
+
+    // Blur each level, a small kernel on a small level spreads the light far on the frame buffer
+    for (int i = 0; i < BLOOM_LEVEL_COUNT; i++)
+    {
+        PostProcessImage& level = buffers.bloomLevels[i];
+        gaussianBlur(threadPool, level.pixels.data(), level.width, level.height, 1, buffers.bloomPingPongs[i], buffers.stripeSums);
+    }
+
+    // Accumulate the levels from the smallest one, then add them to the frame buffer
+    for (int i = BLOOM_LEVEL_COUNT - 1; i > 0; i--)
+    {
+        PostProcessImage& dst = buffers.bloomLevels[i - 1];
+        addUpsampled(threadPool, buffers.bloomLevels[i], dst.pixels.data(), dst.width, dst.height, 1.f);
+    }
+
+    addUpsampled(threadPool, buffers.bloomLevels[0], colors, width, height, intensity / BLOOM_LEVEL_COUNT);
+}
+
+#pragma region Output stage
+void OutputTable::build(float newGamma, bool newIsSRGB)
+{
+    gamma = newGamma;
+    isSRGB = newIsSRGB;
+
+    for (int i = 0; i <= OUTPUT_TABLE_SIZE; i++)
+    {
+        float root = (float)i / OUTPUT_TABLE_SIZE;
+        float value = root * root;
+
+        if (isSRGB)
+            values[i] = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.f / 2.4f) - 0.055f;
+        else
+            values[i] = powf(value, 1.f / gamma);
+    }
+
+    // Read by the interpolation of the last entry
+    values[OUTPUT_TABLE_SIZE + 1] = values[OUTPUT_TABLE_SIZE];
+}
+
+// A pixel is processed in one SSE register (SSE2 is always available on x64), the table is read for 3 channels
+template <ToneMapping TONE_MAPPING>
+void outputPixels(float4* colors, uint32_t* colors8Bits, int begin, int end, const OutputTable& table)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one  = _mm_set1_ps(1.f);
+    const __m128 tableSize = _mm_set1_ps((float)OUTPUT_TABLE_SIZE);
+    const float* values = table.values;
+
+    for (int i = begin; i < end; i++)
+    {
+        __m128 color = _mm_loadu_ps(colors[i].e);
+
+        if (TONE_MAPPING == ToneMapping::REINHARD)
+            color = _mm_div_ps(color, _mm_add_ps(one, color));
+
+        // Curve fitted on the ACES filmic tonemapping (Narkowicz 2015)
+        if (TONE_MAPPING == ToneMapping::ACES)
+        {
+            __m128 numerator   = _mm_mul_ps(color, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.51f), color), _mm_set1_ps(0.03f)));
+            __m128 denominator = _mm_add_ps(_mm_mul_ps(color, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.43f), color), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f));
+            color = _mm_div_ps(numerator, denominator);
+        }
+
+        // The max returns its second operand for the NaNs, so they are mapped to 0
+        color = _mm_min_ps(_mm_max_ps(color, zero), one);
+
+        // Linear interpolation between the two entries around the square root of the color
+        __m128  index    = _mm_mul_ps(_mm_sqrt_ps(color), tableSize);
+        __m128i indices  = _mm_cvttps_epi32(index);
+        __m128  fraction = _mm_sub_ps(index, _mm_cvtepi32_ps(indices));
+
+        int r = _mm_cvtsi128_si32(indices);
+        int g = _mm_cvtsi128_si32(_mm_shuffle_epi32(indices, _MM_SHUFFLE(1, 1, 1, 1)));
+        int b = _mm_cvtsi128_si32(_mm_shuffle_epi32(indices, _MM_SHUFFLE(2, 2, 2, 2)));
+
+        // The alpha is 1 in both entries
+        __m128 value0 = _mm_setr_ps(values[r],     values[g],     values[b],     1.f);
+        __m128 value1 = _mm_setr_ps(values[r + 1], values[g + 1], values[b + 1], 1.f);
+        __m128 result = _mm_add_ps(value0, _mm_mul_ps(_mm_sub_ps(value1, value0), fraction));
+
+        _mm_storeu_ps(colors[i].e, result);
+
+        if (colors8Bits)
+        {
+            __m128i quantized = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(result, _mm_set1_ps(255.f)), _mm_set1_ps(0.5f)));
+            quantized = _mm_packs_epi32(quantized, quantized);
+            quantized = _mm_packus_epi16(quantized, quantized);
+            colors8Bits[i] = (uint32_t)_mm_cvtsi128_si32(quantized);
+        }
+    }
+}
+
+void outputColors(ThreadPool& threadPool, float4* colors, uint32_t* colors8Bits, int width, int height, ToneMapping toneMapping, const OutputTable& table)
+{
+    forEachStripe(threadPool, height, [&](int yMin, int yMax)
+    {
+        switch (toneMapping)
+        {
+            case ToneMapping::REINHARD: outputPixels<ToneMapping::REINHARD>(colors, colors8Bits, yMin * width, yMax * width, table); break;
+            case ToneMapping::ACES:     outputPixels<ToneMapping::ACES>(colors, colors8Bits, yMin * width, yMax * width, table);     break;
+            default:                    outputPixels<ToneMapping::NONE>(colors, colors8Bits, yMin * width, yMax * width, table);     break;
+        }
+    });
+}
+#pragma endregion
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <common/types.hpp>
+#include <common/thread_pool.hpp>
+
+// Rows of the images processed by a job of the thread pool
+#define POST_PROCESS_STRIPE_HEIGHT 16
+
+// Bright pass levels of the bloom, each one half the size of the previous (the first is half the frame buffer)
+#define BLOOM_LEVEL_COUNT 5
+
+// Intervals of the encoding table of the output stage
+#define OUTPUT_TABLE_SIZE 1024
+
+enum class ToneMapping
+{
+    NONE,       // The colors are clamped to [0, 1]
+    REINHARD,
+    ACES
+};
+
+// Image stored row by row
+struct PostProcessImage
+{
+    int width = 0;
+    int height = 0;
+    std::vector<float4> pixels;
+
+    void resize(int newWidth, int newHeight)
+    {
+        width = newWidth;
+        height = newHeight;
+        pixels.resize(width * height);
+    }
+};
+
+// Intermediate images of the post-process effects, allocated once for the size of the frame buffer
+struct PostProcessBuffers
+{
+    // Result of the horizontal passes, read by the vertical passes
+    PostProcessImage pingPong;
+
+    // Running sums of the columns of the vertical passes, one row for each stripe (the bloom levels have less stripes than the frame buffer)
+    PostProcessImage stripeSums;
+
+    // Downsampled bright pass of the bloom and the ping-pong image of each level
+    PostProcessImage bloomLevels[BLOOM_LEVEL_COUNT];
+    PostProcessImage bloomPingPongs[BLOOM_LEVEL_COUNT];
+
+    void resize(int width, int height);
+};
+
+// Gamma or sRGB encoding of the linear values in [0, 1], indexed by the square root of the value:
+// the curve is almost linear in this space, so the linear interpolation between two entries stays precise
+struct OutputTable
+{
+    float gamma = 0.f;
+    bool  isSRGB = false;
+    float values[OUTPUT_TABLE_SIZE + 2];
+
+    void build(float newGamma, bool newIsSRGB);
+};
+
+// The blurs are separable: a horizontal pass writes the ping-pong image, then a vertical pass writes back the colors
+// Box filters use running sums, so the cost of a pixel doesn't depend on the radius
+void boxBlur(ThreadPool& threadPool, float4* colors, int width, int height, int radius, PostProcessImage& pingPong, PostProcessImage& stripeSums);
+
+// Approximated by three box filters of the radius, the kernel spans 3 * radius pixels on each side
+void gaussianBlur(ThreadPool& threadPool, float4* colors, int width, int height, int radius, PostProcessImage& pingPong, PostProcessImage& stripeSums);
+
+// Add the blurred colors above the threshold to the frame buffer
+void lightBloom(ThreadPool& threadPool, float4* colors, int width, int height, float threshold, float intensity, PostProcessBuffers& buffers);
+
+// Output stage, the last writer of the frame buffer: tonemap and encode the colors in place (with an alpha of 1)
+// If colors8Bits is not null, the colors are also quantized to RGBA8 in it
+void outputColors(ThreadPool& threadPool, float4* colors, uint32_t* colors8Bits, int width, int height, ToneMapping toneMapping, const OutputTable& table);
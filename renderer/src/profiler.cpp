@@ -0,0 +1,35 @@
+#include "profiler.hpp"
+
+void Profiler::endFrame(int pixelCount)
+{
+    int64_t frameEnd = getProfilerTime();
+
+    rdrStats& stats = lastFrame;
+    stats.frameMs = lastFrameEnd ? (frameEnd - lastFrameEnd) * 1e-6f : 0.f;
+    lastFrameEnd = frameEnd;
+
+    for (int i = 0; i < PS_COUNT; i++)
+        stats.stageMs[i] = stageTimes[i].exchange(0) * 1e-6f;
+
+    int64_t values[PC_COUNT];
+    for (int i = 0; i < PC_COUNT; i++)
+        values[i] = counters[i].exchange(0);
+
+    stats.vertices              = (int)values[PC_VERTICES];
+    stats.triangles             = (int)values[PC_TRIANGLES];
+    stats.trianglesCulled       = (int)(values[PC_TRIANGLES] - values[PC_TRIANGLES_ACCEPTED]);
+    stats.trianglesClipped      = (int)values[PC_TRIANGLES_CLIPPED];
+    stats.trianglesRasterized   = (int)values[PC_TRIANGLES_RASTERIZED];
+    stats.trianglesOccluded     = (int)values[PC_TRIANGLES_OCCLUDED];
+    stats.fragmentsTested       = (int)values[PC_FRAGMENTS_TESTED];
+    stats.fragmentsDepthKilled  = (int)values[PC_FRAGMENTS_DEPTH_KILLED];
+    stats.fragmentsShaded       = (int)values[PC_FRAGMENTS_SHADED];
+    stats.overdraw              = pixelCount > 0 ? (float)stats.fragmentsShaded / pixelCount : 0.f;
+
+    // The history is a ring buffer
+    frameHistory[historyIndex] = stats.frameMs;
+    for (int i = 0; i < PS_COUNT; i++)
+        stageHistory[i][historyIndex] = stats.stageMs[i];
+
+    historyIndex = (historyIndex + 1) % PROFILER_HISTORY_SIZE;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <rdr/renderer.h>
+
+// Frames kept in the history of the profiler
+#define PROFILER_HISTORY_SIZE 120
+
+enum ProfileCounter
+{
+    PC_VERTICES,
+    PC_TRIANGLES,
+    PC_TRIANGLES_ACCEPTED,  // Not culled, the other triangles are culled
+    PC_TRIANGLES_CLIPPED,
+    PC_TRIANGLES_RASTERIZED,
+    PC_TRIANGLES_OCCLUDED,
+    PC_FRAGMENTS_TESTED,
+    PC_FRAGMENTS_DEPTH_KILLED,
+    PC_FRAGMENTS_SHADED,
+    PC_COUNT,
+};
+
+inline int64_t getProfilerTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Times (in nanoseconds) and counters of the current frame, written by all the threads
+struct Profiler
+{
+    bool enabled = false;
+
+    std::atomic<int64_t> stageTimes[PS_COUNT] = {};
+    std::atomic<int64_t> counters[PC_COUNT] = {};
+
+    // Statistics of the last finished frame, and the times of the previous frames
+    rdrStats lastFrame = {};
+    float frameHistory[PROFILER_HISTORY_SIZE] = {};
+    float stageHistory[PS_COUNT][PROFILER_HISTORY_SIZE] = {};
+    int   historyIndex = 0;
+    int64_t lastFrameEnd = 0;
+
+    void count(ProfileCounter counter, int64_t value) { counters[counter] += value; }
+
+    // Gather the statistics of the frame and reset the counters
+    void endFrame(int pixelCount);
+};
+
+// Add the time of its scope to a stage, nothing is measured if the profiler is disabled
+// A scope nested in the scope of another stage can remove its time from this parent stage
+struct ProfileScope
+{
+    Profiler* profiler;
+    rdrProfileStage stage;
+    int     parentStage;
+    int64_t start;
+
+    ProfileScope(Profiler* profiler, rdrProfileStage stage, int parentStage = -1)
+        : profiler(profiler && profiler->enabled ? profiler : nullptr), stage(stage), parentStage(parentStage),
+          start(this->profiler ? getProfilerTime() : 0)
+    {}
+
+    ~ProfileScope() { stop(); }
+
+    void stop()
+    {
+        if (!profiler)
+            return;
+
+        int64_t duration = getProfilerTime() - start;
+        profiler->stageTimes[stage] += duration;
+
+        if (parentStage >= 0)
+            profiler->stageTimes[parentStage] -= duration;
+
+        profiler = nullptr;
+    }
+};
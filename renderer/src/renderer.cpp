@@ -2,16 +2,36 @@
 #include <cstdio>
 #include <cstring>
 #include <cassert>
+#include <cfloat>
+#include <cstdint>
 
 #include <imgui.h>
 
 #include <common/maths.hpp>
 
 #include "renderer_impl.hpp"
+#include "shading.hpp"
+#include "post_process.hpp"
 
 #include <algorithm>
+#include <atomic>
 
-#define NB_SAMPLES 4
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Precision of the rasterizer: vertices are snapped to 1/256 of pixel
+#define SUBPIXEL_BITS 8
+#define SUBPIXEL_SCALE (1 << SUBPIXEL_BITS)
+
+// Distance in pixels between the screen and the guard band planes, the vertices stay precise enough to be snapped
+#define GUARD_BAND_SIZE 4096
+
+// Clip codes of the planes (see computeClipOutcodes)
+#define CLIP_RIGHT  (1 << 0)
+#define CLIP_TOP    (1 << 1)
+#define CLIP_LEFT   (1 << 4)
+#define CLIP_BOTTOM (1 << 5)
 
 struct clipPoint
 {
@@ -19,139 +39,286 @@ struct clipPoint
     float3 weights = { 0.f, 0.f, 0.f };
 };
 
+// Edge function in fixed point, stepped incrementally across the pixels
+struct EdgeFunction
+{
+    int64_t dx, dy;         // Edge vector (oriented to be positive inside the triangle)
+    int64_t stepX, stepY;   // Value added when moving of one pixel on x or on y
+    int64_t bias;           // -1 if the edge is not a top or a left edge, to apply the top-left rule
+};
+
 rdrImpl* rdrInit(float** colorBuffer32Bits, float* depthBuffer, int width, int height)
 {
     rdrImpl* renderer = new rdrImpl();
 
+    // The ids start at 1 and are never reused
+    static std::atomic<unsigned int> nextInstanceId { 1u };
+    renderer->instanceId = nextInstanceId++;
+
     renderer->fb.colorBufferRef = reinterpret_cast<float4**>(colorBuffer32Bits);
     renderer->fb.depthBuffer = depthBuffer;
-    renderer->fb.msaaColorBuffer = new float4[width * height * NB_SAMPLES]();
-    renderer->fb.msaaDepthBuffer = new float[width * height * NB_SAMPLES]();
     renderer->fb.width = width;
     renderer->fb.height = height;
 
+    // No pixel is split into samples until a triangle edge covers it
+    renderer->fb.msaaEdgeIndices = new int[width * height];
+    std::fill(renderer->fb.msaaEdgeIndices, renderer->fb.msaaEdgeIndices + width * height, -1);
+    renderer->fb.msaaSampleCount = renderer->msaaSampleCount;
+    renderer->fb.msaaTileSamples = new MsaaTileSamples[getHiZTileCountX(renderer->fb) * getHiZTileCountY(renderer->fb)];
+
+    // Depth ranges are computed from the depth buffer when they are first needed
+    renderer->fb.hiZBlocks = new DepthRange[getHiZBlockCountX(renderer->fb) * getHiZBlockCountY(renderer->fb)]();
+    renderer->fb.hiZTiles = new DepthRange[getHiZTileCountX(renderer->fb) * getHiZTileCountY(renderer->fb)]();
+
     renderer->viewport = Viewport{ 0, 0, width, height };
+    renderer->uniform.scissor = { 0, 0, width, height };
+
+    // Shade with the widest SIMD path supported by the CPU
+    renderer->uniform.shadingPath = getBestShadingPath();
+    renderer->uniform.shadingMismatches = &renderer->shadingMismatches;
+    renderer->uniform.profiler = &renderer->profiler;
+
+    // Create the workers and a bin for each tile of the frame buffer
+    renderer->threadPool = new ThreadPool(renderer->threadCount);
+    renderer->threadCount = renderer->threadPool->getThreadCount();
+
+    renderer->tileCountX = (width  + TILE_SIZE - 1) / TILE_SIZE;
+    renderer->tileCountY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    renderer->tileBins.resize(renderer->tileCountX * renderer->tileCountY);
+
+    renderer->postProcess.resize(width, height);
 
     return renderer;
 }
 
-void gammaCorrection(float4& color, float iGamma)
+ShadingPath getBestShadingPath()
 {
-    // Return color gamma corrected
-    color =
-    {
-        powf(color.r, iGamma),
-        powf(color.g, iGamma),
-        powf(color.b, iGamma),
-        1.f
-    };
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool sse41   = info[2] & (1 << 19);
+    bool fma     = info[2] & (1 << 12);
+    bool osxsave = info[2] & (1 << 27);
+    bool avx     = info[2] & (1 << 28);
+
+    __cpuidex(info, 7, 0);
+    bool avx2 = info[1] & (1 << 5);
+
+    // The OS has to save the AVX registers
+    if (osxsave && avx && avx2 && fma && (_xgetbv(0) & 6) == 6)
+        return ShadingPath::AVX2;
+
+    if (sse41)
+        return ShadingPath::SSE41;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return ShadingPath::AVX2;
+
+    if (__builtin_cpu_supports("sse4.1"))
+        return ShadingPath::SSE41;
+#endif
+
+    return ShadingPath::SCALAR;
+}
+
+#pragma region Compressed MSAA
+bool isValidSampleCount(int sampleCount)
+{
+    return sampleCount == 1 || sampleCount == 2 || sampleCount == 4 || sampleCount == 8 || sampleCount == 16;
 }
 
-void boxBlur(Framebuffer fb, float4* colorBuffer)
+// Get the samples of a pixel, null if they all have the color and the depth of the pixel
+MsaaEdgePixel getMsaaEdgePixel(const Framebuffer& fb, int fbIndex)
 {
-    // Return the 'normalized' sum of a 3x3 pixels grid
-    float4 sum =
-        colorBuffer[ fb.width - 1]   + // Low left
-        colorBuffer[ fb.width]       + // Low center
-        colorBuffer[ fb.width + 1]   + // Low right
-        colorBuffer[-1]             + // Mid left
-        colorBuffer[0]              + // Current pixel
-        colorBuffer[+1]             + // Mid right
-        colorBuffer[-fb.width - 1]  + // Top left
-        colorBuffer[-fb.width]      + // Top center
-        colorBuffer[-fb.width + 1];   // Top right
+    int edgeIndex = fb.msaaEdgeIndices[fbIndex];
+    if (edgeIndex < 0)
+        return { nullptr, nullptr };
 
-    *colorBuffer = sum / 9.f;
+    MsaaTileSamples& samples = fb.msaaTileSamples[getPixelTileIndex(fb, fbIndex)];
+    return { &samples.colors[edgeIndex * fb.msaaSampleCount], &samples.depths[edgeIndex * fb.msaaSampleCount] };
 }
 
-void gaussianBlur(Framebuffer fb, float4* colorBuffer)
+// Split a pixel into samples, they start with the color and the depth of the pixel
+MsaaEdgePixel addMsaaEdgePixel(const Framebuffer& fb, int fbIndex)
 {
-    // Return the 'normalized' sum of a 3x3 pixels grid applied with some coefficients
-    float4 sum =
-              colorBuffer[ fb.width - 1]    + // Low left
-        2.f * colorBuffer[ fb.width]        + // Low center
-              colorBuffer[ fb.width + 1]    + // Low right
-        2.f * colorBuffer[-1]               + // Mid left
-        4.f * colorBuffer[0]                + // Current pixel
-        2.f * colorBuffer[+1]               + // Mid right
-              colorBuffer[-fb.width - 1]    + // Top left
-        2.f * colorBuffer[-fb.width]        + // Top center
-              colorBuffer[-fb.width + 1];     // Top right
+    MsaaTileSamples& samples = fb.msaaTileSamples[getPixelTileIndex(fb, fbIndex)];
+    fb.msaaEdgeIndices[fbIndex] = (int)samples.fbIndices.size();
 
-    *colorBuffer = sum / 16.f;
+    samples.fbIndices.push_back(fbIndex);
+    samples.colors.insert(samples.colors.end(), fb.msaaSampleCount, (*fb.colorBufferRef)[fbIndex]);
+    samples.depths.insert(samples.depths.end(), fb.msaaSampleCount, fb.depthBuffer[fbIndex]);
+
+    return getMsaaEdgePixel(fb, fbIndex);
 }
 
+// The sample count is a template parameter, so the loops over the samples are unrolled
+template <int SAMPLE_COUNT>
 void resolveMSAA(Framebuffer& fb)
 {
-    // For each pixel of the frame buffer, interpolate the samples values (color and depth)
-    for (int i = 0; i < fb.width * fb.height; i++)
+    // Only the edge pixels have samples to average, the other pixels already have their color and depth
+    for (int tileIndex = 0; tileIndex < getHiZTileCountX(fb) * getHiZTileCountY(fb); tileIndex++)
     {
-        float4 colorSum = { 0.f, 0.f, 0.f, 0.f };
-        float depthSum = 0.f;
-
-        int msaaIndex = i * NB_SAMPLES;
+        MsaaTileSamples& samples = fb.msaaTileSamples[tileIndex];
 
-        for (int k = 0; k < NB_SAMPLES; k++)
+        for (int i = 0; i < (int)samples.fbIndices.size(); i++)
         {
-            colorSum += fb.msaaColorBuffer[msaaIndex + k];
-            depthSum += fb.msaaDepthBuffer[msaaIndex + k];
+            const float4* colors = &samples.colors[i * SAMPLE_COUNT];
+            const float*  depths = &samples.depths[i * SAMPLE_COUNT];
+
+            float4 colorSum = { 0.f, 0.f, 0.f, 0.f };
+            float depthSum = 0.f;
+
+            for (int k = 0; k < SAMPLE_COUNT; k++)
+            {
+                colorSum += colors[k];
+                depthSum += depths[k];
+            }
+
+            int fbIndex = samples.fbIndices[i];
+            (*fb.colorBufferRef)[fbIndex] = colorSum / SAMPLE_COUNT;
+            fb.depthBuffer[fbIndex] = depthSum / SAMPLE_COUNT;
+
+            // Lazy clear: the pixel is only merged again for the next frame
+            fb.msaaEdgeIndices[fbIndex] = -1;
         }
 
-        (*fb.colorBufferRef)[i] = colorSum / NB_SAMPLES;
-        fb.depthBuffer[i] = depthSum / NB_SAMPLES;
+        samples.fbIndices.clear();
+        samples.colors.clear();
+        samples.depths.clear();
+    }
+}
+
+void resolveMSAA(Framebuffer& fb)
+{
+    switch (fb.msaaSampleCount)
+    {
+        case 2:  resolveMSAA<2>(fb);  break;
+        case 4:  resolveMSAA<4>(fb);  break;
+        case 8:  resolveMSAA<8>(fb);  break;
+        case 16: resolveMSAA<16>(fb); break;
+        default: break; // No pixel is split with a single sample
     }
+}
+
+// Change the sample count when no pixel is split, the sample buffers are reallocated with the new stride
+void setMsaaSampleCount(Framebuffer& fb, int sampleCount)
+{
+    if (sampleCount == fb.msaaSampleCount)
+        return;
+
+    for (int tileIndex = 0; tileIndex < getHiZTileCountX(fb) * getHiZTileCountY(fb); tileIndex++)
+        fb.msaaTileSamples[tileIndex] = MsaaTileSamples();
+
+    fb.msaaSampleCount = sampleCount;
+}
+#pragma endregion
 
-    // Clear samples buffers
-    memset(fb.msaaColorBuffer, 0.f, fb.width * fb.height * NB_SAMPLES * sizeof(float4));
-    memset(fb.msaaDepthBuffer, 0.f, fb.width * fb.height * NB_SAMPLES * sizeof(float));
+void flushTiles(rdrImpl* renderer);
+
+// Triangles are binned and rasterized in rdrFinish with the tiled rendering and the deferred shading
+bool isBinningEnabled(const rdrImpl* renderer)
+{
+    return renderer->tiledRendering || renderer->deferredShading;
+}
+
+// The deferred shading doesn't use the MSAA samples buffers
+bool isMSAAEnabled(const rdrImpl* renderer)
+{
+    return renderer->uniform.msaa && !renderer->deferredShading;
 }
+void invalidateAllDepthRanges(const Framebuffer& fb);
 
 void rdrFinish(rdrImpl* renderer)
 { 
     float4* color = *renderer->fb.colorBufferRef;
 
+    #pragma region Rasterize binned triangles
+
+    if (!renderer->binnedTriangles.empty() || !renderer->binnedLines.empty())
+        flushTiles(renderer);
+
+    #pragma endregion
+
     #pragma region Resolve MSAA
 
-    if (renderer->uniform.msaa)
+    // Only the edge pixels are resolved, so it is cheap even if the MSAA was disabled during the frame
+    {
+        ProfileScope scope(&renderer->profiler, PS_MSAA_RESOLVE);
         resolveMSAA(renderer->fb);
+    }
+
+    // No pixel is split anymore, so the sample count can change for the next frame
+    setMsaaSampleCount(renderer->fb, renderer->msaaSampleCount);
+    renderer->isFrameEmpty = true;
 
     #pragma endregion
 
+    // The depth buffer is cleared outside of the renderer between the frames
+    invalidateAllDepthRanges(renderer->fb);
+
     #pragma region Box blur, gaussian blur and light bloom post-process effects
-    const int offset = 1;
+    // Separable passes by stripes of rows, the bloom is applied on the sharp image
+    ThreadPool& threadPool = *renderer->threadPool;
+    int width  = renderer->fb.width;
+    int height = renderer->fb.height;
 
-    for (int i = offset; i < renderer->fb.width - offset; i++)
-    {
-        for (int j = offset; j < renderer->fb.height - offset; j++)
-        {
-            int index = i + renderer->fb.width * j;
+    ProfileScope postProcessScope(&renderer->profiler, PS_POST_PROCESS);
 
-            if (renderer->boxBlur)
-                boxBlur(renderer->fb, &color[index]);
+    if (renderer->lightBloom)
+        lightBloom(threadPool, color, width, height, renderer->bloomThreshold, renderer->bloomIntensity, renderer->postProcess);
 
-            // Gaussian blur and light bloom
-            else if (renderer->gaussianBlur || color[index].a > 2.5f && renderer->lightBloom)
-                gaussianBlur(renderer->fb, &color[index]);
-        }
-    }
+    if (renderer->boxBlur)
+        boxBlur(threadPool, color, width, height, renderer->blurRadius, renderer->postProcess.pingPong, renderer->postProcess.stripeSums);
+
+    else if (renderer->gaussianBlur)
+        gaussianBlur(threadPool, color, width, height, renderer->blurRadius, renderer->postProcess.pingPong, renderer->postProcess.stripeSums);
+
+    postProcessScope.stop();
     #pragma endregion
 
-    #pragma region Gamma correction
+    #pragma region Output stage
+
+    // Tonemap and encode each pixel of the frame buffer, the table is only rebuilt if the gamma changes
+    OutputTable& outputTable = renderer->outputTable;
+    if (outputTable.gamma != renderer->gamma || outputTable.isSRGB != renderer->sRGBOutput)
+        outputTable.build(renderer->gamma, renderer->sRGBOutput);
 
-    // Correct gamma for each pixel of the frame buffer
-    for (int i = 0; i < renderer->fb.width * renderer->fb.height; i++)
-        gammaCorrection(color[i], renderer->iGamma);
+    {
+        ProfileScope scope(&renderer->profiler, PS_OUTPUT);
+        outputColors(threadPool, color, renderer->colorBuffer8Bits, width, height, renderer->toneMapping, outputTable);
+    }
 
     #pragma endregion
+
+    if (renderer->profiler.enabled)
+        renderer->profiler.endFrame(width * height);
 }
 
 void rdrShutdown(rdrImpl* renderer)
 {
-    delete[] renderer->fb.msaaColorBuffer;
-    delete[] renderer->fb.msaaDepthBuffer;
+    delete[] renderer->fb.msaaEdgeIndices;
+    delete[] renderer->fb.msaaTileSamples;
+    delete[] renderer->fb.hiZBlocks;
+    delete[] renderer->fb.hiZTiles;
+    delete[] renderer->gBuffer;
+
+    for (TextureStorage* storage : renderer->textures)
+    {
+        delete[] storage->texels;
+        delete[] storage->packedTexels;
+        delete storage;
+    }
+    delete renderer->threadPool;
     delete renderer;
 }
 
+unsigned int rdrGetInstanceId(rdrImpl* renderer)
+{
+    return renderer->instanceId;
+}
+
 void rdrSetUniformFloatV(rdrImpl* renderer, rdrUniformType type, float* value)
 {
     // Set uniform float in function of the input type
@@ -172,10 +339,79 @@ void rdrSetUniformBool(rdrImpl* renderer, rdrUniformType type, bool value)
     switch (type)
     {
         case UT_DEPTH_TEST:      renderer->uniform.depthTest = value; break;
+        case UT_MSAA:            renderer->uniform.msaa = value; break;
+        case UT_BLENDING:        renderer->uniform.blending = value; break;
+        case UT_LIGHTING:        renderer->uniform.lighting = value; break;
+        case UT_PHONG_MODEL:     renderer->uniform.phongModel = value; break;
+        default:;
+    }
+}
+
+void rdrSetUniformInt(rdrImpl* renderer, rdrUniformType type, int value)
+{
+    // The enums of the API have the order of the internal ones
+    switch (type)
+    {
+        case UT_TEXTURE_FILTER:
+            if (value >= FT_NEAREST && value <= FT_TRILINEAR)
+                renderer->uniform.textureFilter = FilterType(value);
+            break;
+
+        case UT_FACE_TO_CULL:
+            if (value >= FC_NONE && value <= FC_FRONT_AND_BACK)
+                renderer->uniform.faceToCull = FaceType(value);
+            break;
+
+        case UT_VERTEX_ALPHA:
+            if (value >= VA_UNKNOWN && value <= VA_UNDER_ONE)
+                renderer->uniform.vertexAlpha = VertexAlpha(value);
+            break;
+
+        default:;
+    }
+}
+
+void rdrEnablePostProcess(rdrImpl* renderer, rdrPostProcess effect, bool enabled)
+{
+    switch (effect)
+    {
+        case PP_BOX_BLUR:       renderer->boxBlur = enabled; break;
+        case PP_GAUSSIAN_BLUR:  renderer->gaussianBlur = enabled; break;
+        case PP_LIGHT_BLOOM:    renderer->lightBloom = enabled; break;
         default:;
     }
 }
 
+void rdrSetMSAASampleCount(rdrImpl* renderer, int sampleCount)
+{
+    if (!isValidSampleCount(sampleCount))
+        return;
+
+    // The frame buffer keeps its sample count until the end of the frame, unless no pixel can be split yet
+    renderer->msaaSampleCount = sampleCount;
+    if (renderer->isFrameEmpty)
+        setMsaaSampleCount(renderer->fb, sampleCount);
+}
+
+void rdrSetColorBuffer8Bits(rdrImpl* renderer, unsigned int* colorBuffer8Bits)
+{
+    renderer->colorBuffer8Bits = colorBuffer8Bits;
+}
+
+void rdrEnableProfiler(rdrImpl* renderer, bool enabled)
+{
+    // The time of the first profiled frame starts at its end
+    if (enabled && !renderer->profiler.enabled)
+        renderer->profiler.lastFrameEnd = 0;
+
+    renderer->profiler.enabled = enabled;
+}
+
+void rdrGetStats(rdrImpl* renderer, rdrStats* stats)
+{
+    *stats = renderer->profiler.lastFrame;
+}
+
 void rdrSetUniformLight(rdrImpl* renderer, int index, rdrLight* light)
 {
     if (index < 0 || index >= IM_ARRAYSIZE(renderer->uniform.lights))
@@ -205,6 +441,26 @@ void rdrSetViewport(rdrImpl* renderer, int x, int y, int width, int height)
     renderer->viewport.y = y;
     renderer->viewport.width = width;
     renderer->viewport.height = height;
+
+    // The viewport maps the NDC to [x, width] and [y, height]
+    renderer->uniform.scissor =
+    {
+        max(0, x),
+        max(0, y),
+        min(renderer->fb.width,  width),
+        min(renderer->fb.height, height)
+    };
+}
+
+bool hasTexelAlpha(const float4* texels, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (texels[i].a < 1.f)
+            return true;
+    }
+
+    return false;
 }
 
 void rdrSetTexture(rdrImpl* renderer, float* colors32Bits, int width, int height)
@@ -215,6 +471,203 @@ void rdrSetTexture(rdrImpl* renderer, float* colors32Bits, int width, int height
         height,
         (float4*)colors32Bits
     };
+
+    // The texels stay owned by the caller and can change between two calls, so they are read each time
+    if (isTextureValid(renderer->uniform.texture))
+        renderer->uniform.texture.hasAlpha = hasTexelAlpha(renderer->uniform.texture.data, width * height);
+}
+
+#pragma region Texture formats
+const float* getSRGBToLinearTable()
+{
+    struct SRGBTable
+    {
+        float values[256];
+
+        SRGBTable()
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                float c = i / 255.f;
+                values[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+            }
+        }
+    };
+
+    static const SRGBTable table;
+    return table.values;
+}
+
+float4 unpackTexel(uint32_t texel, bool isSRGB)
+{
+    float4 color =
+    {
+        (float)(texel & 0xff),
+        (float)((texel >> 8) & 0xff),
+        (float)((texel >> 16) & 0xff),
+        (float)(texel >> 24)
+    };
+
+    if (!isSRGB)
+        return color * (1.f / 255.f);
+
+    // Only the RGB channels are sRGB encoded
+    const float* table = getSRGBToLinearTable();
+    return { table[(int)color.r], table[(int)color.g], table[(int)color.b], color.a * (1.f / 255.f) };
+}
+
+uint32_t packChannel(float value, bool isSRGB)
+{
+    value = min(max(value, 0.f), 1.f);
+
+    if (isSRGB)
+        value = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.f / 2.4f) - 0.055f;
+
+    return (uint32_t)(value * 255.f + 0.5f);
+}
+
+uint32_t packTexel(const float4& color, bool isSRGB)
+{
+    return packChannel(color.r, isSRGB) | packChannel(color.g, isSRGB) << 8 | packChannel(color.b, isSRGB) << 16 | packChannel(color.a, false) << 24;
+}
+
+// Get a texel of a level, whatever the texture format
+float4 getTexel(const rdrTexture& texture, int offset, int width, int s, int t)
+{
+    if (!texture.packedData)
+        return texture.data[offset + t * width + s];
+
+    return unpackTexel(texture.packedData[offset + getSwizzledIndex(s, t, width)], texture.isSRGB);
+}
+#pragma endregion
+
+int rdrCreateTexture(rdrImpl* renderer, const void* texels, int width, int height, rdrTextureFormat format)
+{
+    if (!texels || width <= 0 || height <= 0)
+        return -1;
+
+    TextureStorage* storage = new TextureStorage();
+    MipChain& mips = storage->mips;
+
+    bool isPacked = format != TF_RGBA32F;
+    storage->isSRGB = format == TF_SRGB8;
+
+    #pragma region Get levels sizes
+    // Each level is half the size of the previous one, until 1x1
+    int texelCount = 0, packedTexelCount = 0;
+    int floatOffsets[MAX_MIP_LEVELS]; // Index of the first texel of each level while the levels are built
+    mips.levelCount = 0;
+
+    for (int w = width, h = height; mips.levelCount < MAX_MIP_LEVELS; w = max(1, w / 2), h = max(1, h / 2))
+    {
+        mips.widths[mips.levelCount]  = w;
+        mips.heights[mips.levelCount] = h;
+        mips.offsets[mips.levelCount] = isPacked ? packedTexelCount : texelCount;
+        floatOffsets[mips.levelCount] = texelCount;
+        mips.levelCount++;
+
+        texelCount       += w * h;
+        packedTexelCount += getSwizzledTexelCount(w, h);
+        if (w == 1 && h == 1)
+            break;
+    }
+    #pragma endregion
+
+    #pragma region Build levels
+    // The levels are always filtered with linear floats
+    float4* levels = new float4[texelCount];
+
+    if (isPacked)
+    {
+        for (int i = 0; i < width * height; i++)
+            levels[i] = unpackTexel(((const uint32_t*)texels)[i], storage->isSRGB);
+    }
+    else
+    {
+        memcpy(levels, texels, width * height * sizeof(float4));
+    }
+
+    // The averages of the other levels only have an alpha under 1 if the first one does
+    storage->hasAlpha = hasTexelAlpha(levels, width * height);
+
+    for (int level = 1; level < mips.levelCount; level++)
+    {
+        const float4* src = &levels[floatOffsets[level - 1]];
+        float4*       dst = &levels[floatOffsets[level]];
+
+        int srcWidth  = mips.widths[level - 1];
+        int srcHeight = mips.heights[level - 1];
+
+        // Each texel is the average of 2x2 texels of the previous level (the last row/column is repeated for odd sizes)
+        for (int y = 0; y < mips.heights[level]; y++)
+        {
+            int y0 = min(2 * y, srcHeight - 1), y1 = min(2 * y + 1, srcHeight - 1);
+
+            for (int x = 0; x < mips.widths[level]; x++)
+            {
+                int x0 = min(2 * x, srcWidth - 1), x1 = min(2 * x + 1, srcWidth - 1);
+
+                dst[y * mips.widths[level] + x] = (src[y0 * srcWidth + x0] + src[y0 * srcWidth + x1] +
+                                                   src[y1 * srcWidth + x0] + src[y1 * srcWidth + x1]) * 0.25f;
+            }
+        }
+    }
+    #pragma endregion
+
+    #pragma region Pack levels
+    if (isPacked)
+    {
+        // 8 bits textures are 4 times smaller, the padding texels of the last blocks are never read
+        storage->packedTexels = new uint32_t[packedTexelCount]();
+
+        for (int level = 0; level < mips.levelCount; level++)
+        {
+            int levelWidth = mips.widths[level];
+            uint32_t* dst  = &storage->packedTexels[mips.offsets[level]];
+
+            for (int y = 0; y < mips.heights[level]; y++)
+            {
+                for (int x = 0; x < levelWidth; x++)
+                {
+                    // The first level is copied as is to keep the exact texels
+                    dst[getSwizzledIndex(x, y, levelWidth)] = level == 0 ? ((const uint32_t*)texels)[y * width + x] :
+                                                              packTexel(levels[floatOffsets[level] + y * levelWidth + x], storage->isSRGB);
+                }
+            }
+        }
+
+        delete[] levels;
+    }
+    else
+    {
+        storage->texels = levels;
+    }
+    #pragma endregion
+
+    renderer->textures.push_back(storage);
+    return renderer->textures.size() - 1;
+}
+
+void rdrBindTexture(rdrImpl* renderer, int texture)
+{
+    if (texture < 0 || texture >= (int)renderer->textures.size())
+    {
+        renderer->uniform.texture = rdrTexture();
+        return;
+    }
+
+    const TextureStorage* storage = renderer->textures[texture];
+
+    renderer->uniform.texture =
+    {
+        storage->mips.widths[0],
+        storage->mips.heights[0],
+        storage->texels,
+        storage->packedTexels,
+        storage->isSRGB,
+        &storage->mips,
+        storage->hasAlpha
+    };
 }
 
 void rdrSetUniformMaterial(rdrImpl* renderer, rdrMaterial* material)
@@ -241,13 +694,14 @@ void drawLine(const Framebuffer& fb, int x0, int y0, int x1, int y1, const float
         {
             int index = y0 * fb.width + x0;
 
-            if (MSAA)
+            MsaaEdgePixel edgePixel = MSAA ? getMsaaEdgePixel(fb, index) : MsaaEdgePixel{ nullptr, nullptr };
+            if (edgePixel.colors)
             {
-                for (int k = 0; k < NB_SAMPLES; k++)
-                    fb.msaaColorBuffer[index * NB_SAMPLES + k] = color;
+                for (int k = 0; k < fb.msaaSampleCount; k++)
+                    edgePixel.colors[k] = color;
             }
             else
-                *fb.colorBufferRef[index] = color;
+                (*fb.colorBufferRef)[index] = color;
         }
 
         if (x0 == x1 && y0 == y1) break;
@@ -342,29 +796,53 @@ void getLightColor(const Uniform& uniform, Varying& varying)
     #pragma endregion
 }
 
-float4 textureFiltering(const rdrTexture& texture, float2 texel)
+float4 textureFiltering(const rdrTexture& texture, int offset, int width, int height, float2 texel)
 {
     int si = int(texel.s), ti = int(texel.t);
 
-    int index = ti * texture.width + si;
+    // Neighbour texels wrap like the UVs
+    int nextS = si + 1 == width  ? 0 : si + 1;
+    int nextT = ti + 1 == height ? 0 : ti + 1;
 
     // Get nearest texels to interpolate their colors
     const float4 colors[4] =
     {
-        texture.data[index],                        // Top-left
-        texture.data[index + 1],                    // Top-right
-        texture.data[index + texture.width],        // Bottom-left
-        texture.data[index + texture.width + 1],    // Bottom-right
+        getTexel(texture, offset, width, si,    ti),       // Top-left
+        getTexel(texture, offset, width, nextS, ti),       // Top-right
+        getTexel(texture, offset, width, si,    nextT),    // Bottom-left
+        getTexel(texture, offset, width, nextS, nextT),    // Bottom-right
     };
 
     // Interpolate the colors array
     return bilinear(texel.s - si, texel.t - ti, colors);
 }
 
-float4 getTextureColor(const Varying& fragVars, const Uniform& uniform)
+float4 getMipmapColor(const rdrTexture& texture, float u, float v, float lod)
+{
+    const MipChain& mips = *texture.mips;
+
+    // Get the two levels around the level of detail
+    float levelLod = min(max(lod, 0.f), (float)(mips.levelCount - 1));
+    int   levels[2] = { (int)levelLod, min((int)levelLod + 1, mips.levelCount - 1) };
+
+    // Filter each level like the bilinear filter of the level 0
+    float4 colors[2];
+    for (int i = 0; i < 2; i++)
+    {
+        int width  = mips.widths[levels[i]];
+        int height = mips.heights[levels[i]];
+
+        colors[i] = textureFiltering(texture, mips.offsets[levels[i]], width, height, float2(width * u - u, height * v - v));
+    }
+
+    // Interpolate the two levels
+    return lerp(colors[0], colors[1], levelLod - levels[0]);
+}
+
+float4 getTextureColor(const Varying& fragVars, const Uniform& uniform, float lod)
 {
     // If there is no texture return a white color
-    if (!uniform.texture.data || uniform.texture.height <= 0 || uniform.texture.width <= 0)
+    if (!isTextureValid(uniform.texture))
         return { 1.f, 1.f, 1.f, 1.f };
 
     const rdrTexture& texture = uniform.texture;
@@ -378,32 +856,39 @@ float4 getTextureColor(const Varying& fragVars, const Uniform& uniform)
     float t = texture.height * v;
 
     // Get texel color with tex coords
-    if (uniform.textureFilter == FilterType::BILINEAR)
+    if (uniform.textureFilter == FilterType::TRILINEAR && texture.mips)
+    {
+        // Get the texel after bilinear filtering of two mipmap levels
+        return getMipmapColor(texture, u, v, lod);
+    }
+    else if (uniform.textureFilter != FilterType::NEAREST)
     {
         // Get the texel after bilinear filtering
-        return textureFiltering(texture, float2(s - u, t - v));
+        return textureFiltering(texture, 0, texture.width, texture.height, float2(s - u, t - v));
     }
     else
     {
         // Get the nearest texel
-        return texture.data[int(t) * texture.width + int(s)];
+        return getTexel(texture, 0, texture.width, int(s), int(t));
     }
 }
 
-bool fragmentShader(Varying& fragVars, const Uniform& uniform, float4& outColor)
+bool isDiscardedByPixelEffect(const Varying& fragVars, const Uniform& uniform)
 {
-    if (uniform.pixelEffect)
-    {
-        if (fmodf(abs(fragVars.coords.x), 1.f) < 0.25f ||
-            fmodf(abs(fragVars.coords.y + sin(uniform.time + fragVars.coords.x)), 0.5f) < 0.1f ||
-            fmodf(abs(fragVars.coords.z), 1.f) < 0.2f)
-            return false;
-    }
+    return fmodf(abs(fragVars.coords.x), 1.f) < 0.25f ||
+           fmodf(abs(fragVars.coords.y + sin(uniform.time + fragVars.coords.x)), 0.5f) < 0.1f ||
+           fmodf(abs(fragVars.coords.z), 1.f) < 0.2f;
+}
+
+bool fragmentShader(Varying& fragVars, const Uniform& uniform, float4& outColor, float lod = 0.f)
+{
+    if (uniform.pixelEffect && isDiscardedByPixelEffect(fragVars, uniform))
+        return false;
 
     // If there is no lighting, return the color with no more modification
     if (!uniform.lighting)
     {
-        outColor = getTextureColor(fragVars, uniform) * fragVars.color;
+        outColor = getTextureColor(fragVars, uniform, lod) * fragVars.color;
         return true;
     }
 
@@ -413,7 +898,7 @@ bool fragmentShader(Varying& fragVars, const Uniform& uniform, float4& outColor)
         getLightColor(uniform, fragVars);
 
     // Get the new color with lighting modifications
-    outColor = getTextureColor(fragVars, uniform) * fragVars.color * fragVars.shadedColor +
+    outColor = getTextureColor(fragVars, uniform, lod) * fragVars.color * fragVars.shadedColor +
                fragVars.specularColor;
 
     return true;
@@ -441,27 +926,6 @@ Varying interpolateVarying(const Varying varyings[3], const float3& weight)
     return result;
 }
 
-bool getBarycentric(const float4 screenCoords[3], const float2 edges[3], const float2& pixelCoords, float inversedArea, float3& inWeights)
-{
-    // Check if the pixel is in the triangle foreach segment
-    // Using top-left rule to avoid segment overlapping
-
-    inWeights.x = getWeight(screenCoords[1].xy, screenCoords[2].xy, pixelCoords) * inversedArea;
-    if (inWeights.x == 0.f ? (edges[0].y < 0.f || edges[0].x <= 0.f && edges[0].y == 0.f) : inWeights.x < 0.f)
-        return false;
-
-    inWeights.y = getWeight(screenCoords[2].xy, screenCoords[0].xy, pixelCoords) * inversedArea;
-    if (inWeights.y == 0.f ? (edges[1].y < 0.f || edges[1].x <= 0.f && edges[1].y == 0.f) : inWeights.y < 0.f)
-        return false;
-
-    // Avoid a costly operation by using the latest results
-    inWeights.z = 1.f - inWeights.x - inWeights.y;
-    if (inWeights.z == 0.f ? (edges[2].y < 0.f || edges[2].x <= 0.f && edges[2].y == 0.f) : inWeights.z < 0.f)
-        return false;
-
-    return true;
-}
-
 bool alphaTest(const Uniform& uniform, float alpha)
 {
     return alpha >= uniform.cutout;
@@ -478,187 +942,760 @@ void blend(float4& src, const float4& dest)
     src = src * max(src.a, 0.f) + dest * (1.f - min(src.a, 1.f));
 }
 
-void rasterTriangle(const Framebuffer& fb, const float4 screenCoords[3], const Varying varying[3], const Uniform& uniform)
+// SAMPLE_COUNT is 1 if the MSAA is disabled
+template <int SAMPLE_COUNT>
+void writeFragment(const Framebuffer& fb, const Uniform& uniform, int fbIndex, float z, uint16_t sampleBit, float4 fragColor)
 {
-    #pragma region Get bounding boxes
-    int xMin = min(screenCoords[0].x, min(screenCoords[1].x, screenCoords[2].x));
-    int xMax = max(screenCoords[0].x, max(screenCoords[1].x, screenCoords[2].x));
-    if (xMin == xMax)
-        return;
-
-    int yMin = min(screenCoords[0].y, min(screenCoords[1].y, screenCoords[2].y));
-    int yMax = max(screenCoords[0].y, max(screenCoords[1].y, screenCoords[2].y));
-    if (yMin == yMax)
-        return;
-    #pragma endregion
-
-    #pragma region Get area
-    float inversedArea;
+    // With MSAA, a pixel is only split into samples if a fragment doesn't cover all of them
+    MsaaEdgePixel edgePixel = { nullptr, nullptr };
+    if (SAMPLE_COUNT > 1)
     {
-        float area = getWeight(screenCoords[0].xy, screenCoords[1].xy, screenCoords[2].xy);
-
-        if (area == 0.f)
-            return;
-
-        inversedArea = 1.f / area;
+        edgePixel = getMsaaEdgePixel(fb, fbIndex);
+        if (!edgePixel.colors && sampleBit != (1 << SAMPLE_COUNT) - 1)
+            edgePixel = addMsaaEdgePixel(fb, fbIndex);
     }
-    #pragma endregion
 
-    #pragma region Get edges for top-left rule
-    float2 edge[3] =
+    #pragma region Set the depth and the fragment color to valid samples
+    if (edgePixel.colors)
     {
-        screenCoords[2].xy - screenCoords[1].xy,
-        screenCoords[0].xy - screenCoords[2].xy,
-        screenCoords[1].xy - screenCoords[0].xy
-    };
-#pragma endregion
+        float*  msaaZBuffer = edgePixel.depths;
+        float4* msaaColorBuffer = edgePixel.colors;
 
-    float2 fragment;
-    float3 weight;
-    float3 currentSampleWeight;
-
-    // Foreach pixel in the bounding box
-    for (int i = xMin; i <= xMax; i++)
-    {
-        fragment.x = i + 0.5f;
-        for (int j = yMin; j <= yMax; j++)
+        // For each covered sample set the depth, get the blended color and set it to the current sample
+        for (int k = 0, mask = 1; k < SAMPLE_COUNT; k++, mask <<= 1)
         {
-            fragment.y = j + 0.5f;
-
-            #pragma region Compute samples validity
-            unsigned char sampleBit = 0;
-
-            // Check for each sample if it is in the triangle or not, and put these informations on a bitmask
-            if (uniform.msaa)
+            if (sampleBit & mask)
             {
-                float3 sampleWeight[NB_SAMPLES];
-                
-                // Get samples offset on a 4x4 grid (2x2 RGSS)
-                //    +-----------+
-                //    |  |  |A |  |
-                //    |--|--|--|--|
-                //    |D |  |  |  |
-                //    |--|--X--|--|
-                //    |  |  |  |B |
-                //    |--|--|--|--|
-                //    |  |C |  |  |
-                //    +-----------+
-                float2 sampleOffset[NB_SAMPLES] =
-                {
-                    { -3.f / 8.f,-1.f / 8.f }, { 1.f / 8.f,-3.f / 8.f },
-                    { -1.f / 8.f, 3.f / 8.f }, { 3.f / 8.f, 1.f / 8.f }
-                };
+                // Set the sample color, to avoid changes on the fragment color during blending
+                float4 sampleColor = fragColor;
 
-                // For each sample of the current pixel, check if it is covered, if it is set the mask and the current weight
-                for (int k = 0, mask = 1; k < NB_SAMPLES; k++, mask <<= 1)
+                // If there is blending, get the last sample in the sampleColorBuffer and add it to the sample color
+                if (uniform.blending && sampleColor.a < 1.f)
+                    blend(sampleColor, msaaColorBuffer[k]);
+
+                if (uniform.depthTest)
                 {
-                    if (!getBarycentric(screenCoords, edge, fragment + sampleOffset[k], inversedArea, sampleWeight[k]))
+                    // Check if there is already a closer sample
+                    if (msaaZBuffer[k] >= z)
                         continue;
 
-                    sampleBit |= mask;
-                    currentSampleWeight = sampleWeight[k];
+                    if (alphaTest(uniform, sampleColor.a))
+                        msaaZBuffer[k] = z;
                 }
 
-                // If there is no sample covered, leave this pixel
-                if (!sampleBit)
-                    continue;
+                msaaColorBuffer[k] = sampleColor;
             }
-            #pragma endregion
+        }
+    }
+    #pragma endregion
 
-            #pragma region Compute centroid validity
-            // Check if the centroid is in the triangle, if MSAA is active, set the new fragment weight else leave the pixel
-            if (!getBarycentric(screenCoords, edge, fragment, inversedArea, weight))
-            {
-                if (!uniform.msaa)
-                    continue;
+    #pragma region Set the depth and the fragment color to the valid pixel
+    else
+    {
+        float4* colorBuffer = &(*fb.colorBufferRef)[fbIndex];
 
-                weight = currentSampleWeight;
+        // If there is blending, get the last pixel in the colorBuffer and add it to the fragment color
+        if (uniform.blending && fragColor.a < 1.f)
+            blend(fragColor, *colorBuffer);
+
+        // If the cutout permit it, write in the depthBuffer
+        if (uniform.depthTest && alphaTest(uniform, fragColor.a))
+            fb.depthBuffer[fbIndex] = z;
+
+        *colorBuffer = fragColor;
+
+        // The pixel is not lit by the deferred pass anymore
+        if (fb.gBuffer)
+            fb.gBuffer[fbIndex].drawState = nullptr;
+    }
+    #pragma endregion
+}
+
+unsigned int shadeBatchScalar(const FragmentBatch& batch, const Varying varyings[3], const Uniform& uniform, float4 outColors[MAX_BATCH_LANES])
+{
+    unsigned int shadedMask = 0u;
+
+    for (int l = 0; l < batch.count; l++)
+    {
+        if (!(batch.liveMask & (1u << l)))
+            continue;
+
+        // Get the varying of the current pixel
+        Varying fragVarying = interpolateVarying(varyings, { batch.w0[l], batch.w1[l], batch.w2[l] });
+
+        if (fragmentShader(fragVarying, uniform, outColors[l], batch.lod[l]))
+            shadedMask |= 1u << l;
+    }
+
+    return shadedMask;
+}
+
+void writeGBuffer(const Framebuffer& fb, const FragmentBatch& batch, const Varying varyings[3], const Uniform& uniform)
+{
+    for (int l = 0; l < batch.count; l++)
+    {
+        if (!(batch.liveMask & (1u << l)))
+            continue;
+
+        // Get the varying of the current pixel
+        Varying fragVarying = interpolateVarying(varyings, { batch.w0[l], batch.w1[l], batch.w2[l] });
+
+        if (uniform.pixelEffect && isDiscardedByPixelEffect(fragVarying, uniform))
+            continue;
+
+        // Deferred draws are opaque, so the depth is always written
+        if (uniform.depthTest)
+            fb.depthBuffer[batch.fbIndex[l]] = batch.depth[l];
+
+        fb.gBuffer[batch.fbIndex[l]] =
+        {
+            fragVarying.coords,
+            fragVarying.normal,
+            fragVarying.color,
+            fragVarying.uv,
+            batch.lod[l],
+            &uniform
+        };
+    }
+}
+
+void computeQuadLods(FragmentBatch& batch, const Varying varyings[3], const Uniform& uniform)
+{
+    const rdrTexture& texture = uniform.texture;
+
+    if (uniform.textureFilter != FilterType::TRILINEAR || !texture.mips)
+    {
+        for (int l = 0; l < batch.count; l++)
+            batch.lod[l] = 0.f;
+        return;
+    }
+
+    const float3 us = { varyings[0].uv.u, varyings[1].uv.u, varyings[2].uv.u };
+    const float3 vs = { varyings[0].uv.v, varyings[1].uv.v, varyings[2].uv.v };
+
+    for (int q = 0; q < batch.count; q += 4)
+    {
+        // Get the texel coords of the top-left, top-right and bottom-left pixels of the quad (helpers included)
+        float2 texels[3];
+        for (int l = 0; l < 3; l++)
+        {
+            float3 weight = { batch.w0[q + l], batch.w1[q + l], batch.w2[q + l] };
+            texels[l] = { interpolateFloat(us, weight) * texture.width, interpolateFloat(vs, weight) * texture.height };
+        }
+
+        // The level of detail is the log2 of the greatest texel footprint of a pixel, along x or y
+        float2 dx = texels[1] - texels[0];
+        float2 dy = texels[2] - texels[0];
+        float  sqFootprint = max(dx.x * dx.x + dx.y * dx.y, dy.x * dy.x + dy.y * dy.y);
+
+        // Degenerated (or not a number) footprints use the level 0
+        if (!(sqFootprint > 1.f))
+            sqFootprint = 1.f;
+
+        float lod = 0.5f * log2f(sqFootprint);
+        for (int l = 0; l < 4; l++)
+            batch.lod[q + l] = lod;
+    }
+}
+
+// SIMD results can differ from the scalar path ones by rounding (approximated pow, fused operations)
+bool isWithinTolerance(float value, float reference)
+{
+    return fabsf(value - reference) <= 1e-3f * max(1.f, fabsf(reference));
+}
+
+// Number of lanes set in a mask of a batch
+inline int countLanes(unsigned int mask)
+{
+    int count = 0;
+    for (; mask; mask &= mask - 1)
+        count++;
+
+    return count;
+}
+
+// Return the number of fragments shaded
+template <int SAMPLE_COUNT>
+int shadeBatch(const Framebuffer& fb, FragmentBatch& batch, const Varying varyings[3], const Uniform& uniform)
+{
+    computeQuadLods(batch, varyings, uniform);
+
+    // Deferred draws only keep the inputs of the fragment shader, they are lit in rdrFinish
+    if (uniform.deferredLighting)
+    {
+        writeGBuffer(fb, batch, varyings, uniform);
+        return countLanes(batch.liveMask);
+    }
+
+    float4 fragColors[MAX_BATCH_LANES];
+    unsigned int shadedMask;
+
+    #pragma region Get fragments colors
+    // The pixel effect can discard fragments, it is only supported by the scalar path
+    ShadingPath path = uniform.pixelEffect ? ShadingPath::SCALAR : uniform.shadingPath;
+
+    switch (path)
+    {
+        case ShadingPath::AVX2:  shadedMask = shadeBatchAVX2(batch, varyings, uniform, fragColors); break;
+        case ShadingPath::SSE41: shadedMask = shadeBatchSSE41(batch, varyings, uniform, fragColors); break;
+        default:                 shadedMask = shadeBatchScalar(batch, varyings, uniform, fragColors); break;
+    }
+    #pragma endregion
+
+    #pragma region Reference check
+    // Compare the SIMD colors with the scalar path ones, and show the wrong fragments in magenta
+    if (uniform.shadingReferenceCheck && path != ShadingPath::SCALAR)
+    {
+        float4 referenceColors[MAX_BATCH_LANES];
+        shadedMask &= shadeBatchScalar(batch, varyings, uniform, referenceColors);
+
+        for (int l = 0; l < batch.count; l++)
+        {
+            if (!(shadedMask & (1u << l)))
+                continue;
+
+            for (int c = 0; c < 4; c++)
+            {
+                if (!isWithinTolerance(fragColors[l].e[c], referenceColors[l].e[c]))
+                {
+                    fragColors[l] = { 1.f, 0.f, 1.f, 1.f };
+                    (*uniform.shadingMismatches)++;
+                    break;
+                }
             }
-            #pragma endregion
+        }
+    }
+    #pragma endregion
+
+    // Write the fragments in the order of the lanes
+    for (int l = 0; l < batch.count; l++)
+    {
+        if (shadedMask & (1u << l))
+            writeFragment<SAMPLE_COUNT>(fb, uniform, batch.fbIndex[l], batch.depth[l], batch.sampleBits[l], fragColors[l]);
+    }
 
-            int fbIndex = j * fb.width + i;
+    return countLanes(shadedMask);
+}
+
+#pragma region Hierarchical Z
+DepthRange& getBlockDepthRange(const Framebuffer& fb, bool msaa, int blockX, int blockY, bool refreshMin = false)
+{
+    DepthRange& range = fb.hiZBlocks[blockY * getHiZBlockCountX(fb) + blockX];
+    if (range.isValid && !(refreshMin && range.isMinStale))
+        return range;
+
+    // Get the min and max depths of the pixels (or the samples) of the block
+    int xEnd = min((blockX + 1) * HIZ_BLOCK_SIZE, fb.width);
+    int yEnd = min((blockY + 1) * HIZ_BLOCK_SIZE, fb.height);
+
+    range.minZ =  FLT_MAX;
+    range.maxZ = -FLT_MAX;
+
+    for (int y = blockY * HIZ_BLOCK_SIZE; y < yEnd; y++)
+    {
+        for (int x = blockX * HIZ_BLOCK_SIZE; x < xEnd; x++)
+        {
+            int fbIndex = y * fb.width + x;
 
-            #pragma region Depth test
-            // Keep z in memory to set it after alpha test
-            float z;
-            if (uniform.depthTest)
+            // The MSAA edge pixels have a depth per sample
+            MsaaEdgePixel edgePixel = msaa ? getMsaaEdgePixel(fb, fbIndex) : MsaaEdgePixel{ nullptr, nullptr };
+            int sampleCount = edgePixel.depths ? fb.msaaSampleCount : 1;
+            const float* depths = edgePixel.depths ? edgePixel.depths : &fb.depthBuffer[fbIndex];
+
+            for (int k = 0; k < sampleCount; k++)
             {
-                z = interpolateFloat({ screenCoords[0].z, screenCoords[1].z, screenCoords[2].z }, weight);
+                range.minZ = min(range.minZ, depths[k]);
+                range.maxZ = max(range.maxZ, depths[k]);
+            }
+        }
+    }
 
-                // If there is a closer pixel drawn at the same screen coords, discard
-                if (fb.depthBuffer[fbIndex] >= z)
-                    continue;
+    range.isValid = true;
+    range.isMinStale = false;
+    return range;
+}
+
+DepthRange& getTileDepthRange(const Framebuffer& fb, bool msaa, int tileX, int tileY, bool refreshMin = false)
+{
+    DepthRange& range = fb.hiZTiles[tileY * getHiZTileCountX(fb) + tileX];
+    if (range.isValid && !(refreshMin && range.isMinStale))
+        return range;
+
+    // Merge the ranges of the blocks of the tile
+    const int blocksPerTile = TILE_SIZE / HIZ_BLOCK_SIZE;
+    int blockXEnd = min((tileX + 1) * blocksPerTile, getHiZBlockCountX(fb));
+    int blockYEnd = min((tileY + 1) * blocksPerTile, getHiZBlockCountY(fb));
+
+    range.minZ =  FLT_MAX;
+    range.maxZ = -FLT_MAX;
+
+    for (int blockY = tileY * blocksPerTile; blockY < blockYEnd; blockY++)
+    {
+        for (int blockX = tileX * blocksPerTile; blockX < blockXEnd; blockX++)
+        {
+            // The block ranges are not refreshed, their stale min is still a lower bound
+            const DepthRange& blockRange = getBlockDepthRange(fb, msaa, blockX, blockY);
+            range.minZ = min(range.minZ, blockRange.minZ);
+            range.maxZ = max(range.maxZ, blockRange.maxZ);
+        }
+    }
+
+    range.isValid = true;
+    range.isMinStale = false;
+    return range;
+}
+
+void updateDepthRange(const Framebuffer& fb, int blockX, int blockY, float writtenMaxZ)
+{
+    // The max is kept up to date, the min is only refreshed from the depth buffer when a rejection test needs it
+    DepthRange& blockRange = fb.hiZBlocks[blockY * getHiZBlockCountX(fb) + blockX];
+    blockRange.maxZ = max(blockRange.maxZ, writtenMaxZ);
+    blockRange.isMinStale = true;
+
+    DepthRange& tileRange = fb.hiZTiles[(blockY * HIZ_BLOCK_SIZE / TILE_SIZE) * getHiZTileCountX(fb) + blockX * HIZ_BLOCK_SIZE / TILE_SIZE];
+    tileRange.maxZ = max(tileRange.maxZ, writtenMaxZ);
+    tileRange.isMinStale = true;
+}
+
+void invalidateAllDepthRanges(const Framebuffer& fb)
+{
+    for (int i = 0; i < getHiZBlockCountX(fb) * getHiZBlockCountY(fb); i++)
+        fb.hiZBlocks[i].isValid = false;
+
+    for (int i = 0; i < getHiZTileCountX(fb) * getHiZTileCountY(fb); i++)
+        fb.hiZTiles[i].isValid = false;
+}
+
+bool isRectOccluded(const Framebuffer& fb, bool msaa, int xMin, int yMin, int xMax, int yMax, float maxZ)
+{
+    // The rect is occluded if its greatest depth is behind the depths of all the tiles it overlaps
+    for (int tileY = yMin / TILE_SIZE; tileY <= yMax / TILE_SIZE; tileY++)
+    {
+        for (int tileX = xMin / TILE_SIZE; tileX <= xMax / TILE_SIZE; tileX++)
+        {
+            const DepthRange& range = getTileDepthRange(fb, msaa, tileX, tileY);
+            if (maxZ <= range.minZ)
+                continue;
+
+            // A stale min is only refreshed if the tile has depths in front of the rect
+            if (maxZ > range.maxZ || maxZ > getTileDepthRange(fb, msaa, tileX, tileY, true).minZ)
+                return false;
+        }
+    }
+
+    return true;
+}
+#pragma endregion
+
+// Convert a screen coordinate to a fixed point coordinate on the sub-pixel grid
+inline int64_t toFixed(float value)
+{
+    return (int64_t)floorf(value * SUBPIXEL_SCALE + 0.5f);
+}
+
+// Get the standard sample pattern of the sample count, the offsets are in 1/16 of pixel relative to the pixel center
+const int (*getSamplePattern(int sampleCount))[2]
+{
+    static const int pattern1[1][2] = { { 0, 0 } };
+    static const int pattern2[2][2] = { { 4, 4 }, { -4, -4 } };
+
+    // 2x2 RGSS, on a 4x4 grid
+    //    +-----------+
+    //    |  |  |A |  |
+    //    |--|--|--|--|
+    //    |D |  |  |  |
+    //    |--|--X--|--|
+    //    |  |  |  |B |
+    //    |--|--|--|--|
+    //    |  |C |  |  |
+    //    +-----------+
+    static const int pattern4[4][2] = { { -6, -2 }, { 2, -6 }, { -2, 6 }, { 6, 2 } };
+
+    static const int pattern8[8][2] =
+    {
+        {  1, -3 }, { -1,  3 }, {  5,  1 }, { -3, -5 },
+        { -5,  5 }, { -7, -1 }, {  3,  7 }, {  7, -7 }
+    };
+
+    static const int pattern16[16][2] =
+    {
+        {  1,  1 }, { -1, -3 }, { -3,  2 }, {  4, -1 },
+        { -5, -2 }, {  2,  5 }, {  5,  3 }, {  3, -5 },
+        { -2,  6 }, {  0, -7 }, { -4, -6 }, { -6,  4 },
+        { -8,  0 }, {  7, -4 }, {  6,  7 }, { -7, -8 }
+    };
+
+    switch (sampleCount)
+    {
+        case 2:  return pattern2;
+        case 4:  return pattern4;
+        case 8:  return pattern8;
+        case 16: return pattern16;
+        default: return pattern1;
+    }
+}
+
+// Counts of the rasterization of a triangle, added to the profiler once per triangle
+struct RasterStats
+{
+    bool isProfiled = false;
+    bool isOccluded = false;
+
+    int fragmentsTested = 0;
+    int fragmentsDepthKilled = 0;
+    int fragmentsShaded = 0;
+
+    int64_t shadingTime = 0;
+};
+
+// Shade the quads of the batch and empty it, the time of the fragment shading is kept apart from the rasterization
+template <int SAMPLE_COUNT>
+void flushBatch(const Framebuffer& fb, FragmentBatch& batch, const Varying varying[3], const Uniform& uniform, RasterStats& stats)
+{
+    int64_t start = stats.isProfiled ? getProfilerTime() : 0;
+
+    stats.fragmentsShaded += shadeBatch<SAMPLE_COUNT>(fb, batch, varying, uniform);
+
+    if (stats.isProfiled)
+        stats.shadingTime += getProfilerTime() - start;
+
+    batch.count = 0;
+    batch.liveMask = 0u;
+}
+
+// SAMPLE_COUNT is 1 if the MSAA is disabled
+template <int SAMPLE_COUNT>
+void rasterTriangle(const Framebuffer& fb, const float4 screenCoords[3], const Varying varying[3], const Uniform& uniform, const ClipRect& clipRect, RasterStats& stats)
+{
+    #pragma region Snap vertices to the sub-pixel grid
+    int64_t vx[3], vy[3];
+    for (int i = 0; i < 3; i++)
+    {
+        vx[i] = toFixed(screenCoords[i].x);
+        vy[i] = toFixed(screenCoords[i].y);
+    }
+    #pragma endregion
+
+    #pragma region Get bounding boxes
+    // Only rasterize the part of the bounding box inside the clip rect and the viewport (the guard band keeps triangles outside of it)
+    int xMin = max((int)(min(vx[0], min(vx[1], vx[2])) >> SUBPIXEL_BITS), max(clipRect.xMin, uniform.scissor.xMin));
+    int yMin = max((int)(min(vy[0], min(vy[1], vy[2])) >> SUBPIXEL_BITS), max(clipRect.yMin, uniform.scissor.yMin));
+    int xMax = min((int)(max(vx[0], max(vx[1], vx[2])) >> SUBPIXEL_BITS), min(clipRect.xMax, uniform.scissor.xMax) - 1);
+    int yMax = min((int)(max(vy[0], max(vy[1], vy[2])) >> SUBPIXEL_BITS), min(clipRect.yMax, uniform.scissor.yMax) - 1);
+    if (xMin > xMax || yMin > yMax)
+        return;
+    #pragma endregion
+
+    #pragma region Get area
+    // Get the double of the signed area, with its sign edge functions are positive inside the triangle
+    int64_t area = (vx[2] - vx[0]) * (vy[1] - vy[0]) - (vy[2] - vy[0]) * (vx[1] - vx[0]);
+    if (area == 0)
+        return;
+
+    int64_t orientation = area > 0 ? 1 : -1;
+    float inversedArea = 1.f / (float)(area * orientation);
+    #pragma endregion
+
+    #pragma region Set up edge functions
+    // Edge k is the one opposite to the vertex k, its function is the (not normalized) weight of this vertex
+    // The functions are evaluated at the center of the first pixel, then only stepped by additions
+    EdgeFunction edges[3];
+    int64_t blockRowValues[3];
+
+    // Blocks are aligned on the hierarchical Z blocks, the first pixel is the top-left one of the first block
+    int blockXMin = xMin & ~(HIZ_BLOCK_SIZE - 1);
+    int blockYMin = yMin & ~(HIZ_BLOCK_SIZE - 1);
+
+    // Quads are aligned on even pixels
+    int quadXMin = xMin & ~1;
+    int quadYMin = yMin & ~1;
+
+    int64_t firstPixelX = ((int64_t)blockXMin << SUBPIXEL_BITS) + SUBPIXEL_SCALE / 2;
+    int64_t firstPixelY = ((int64_t)blockYMin << SUBPIXEL_BITS) + SUBPIXEL_SCALE / 2;
+
+    for (int k = 0; k < 3; k++)
+    {
+        int a = (k + 1) % 3, b = (k + 2) % 3;
+
+        int64_t dx = vx[b] - vx[a];
+        int64_t dy = vy[b] - vy[a];
+
+        // Using top-left rule to avoid segment overlapping: pixels exactly on the other edges are rejected
+        edges[k].bias  = (dy > 0 || (dy == 0 && dx > 0)) ? 0 : -1;
+        edges[k].dx    = dx * orientation;
+        edges[k].dy    = dy * orientation;
+        edges[k].stepX =  edges[k].dy * SUBPIXEL_SCALE;
+        edges[k].stepY = -edges[k].dx * SUBPIXEL_SCALE;
+
+        blockRowValues[k] = ((firstPixelX - vx[a]) * edges[k].dy - (firstPixelY - vy[a]) * edges[k].dx) + edges[k].bias;
+    }
+
+    // Get the weights of a point with its edge function values (without the top-left bias)
+    auto getWeights = [&](int64_t v0, int64_t v1, int64_t v2)
+    {
+        return float3
+        {
+            (float)(v0 - edges[0].bias) * inversedArea,
+            (float)(v1 - edges[1].bias) * inversedArea,
+            (float)(v2 - edges[2].bias) * inversedArea
+        };
+    };
+    #pragma endregion
+
+    #pragma region Get samples offsets
+    const int (*samplePattern)[2] = getSamplePattern(SAMPLE_COUNT);
+
+    // Offset of each edge function for each sample, relative to the pixel center
+    int64_t sampleDelta[SAMPLE_COUNT][3];
+    int64_t sampleMargin[3] = { 0, 0, 0 };
+    if (SAMPLE_COUNT > 1)
+    {
+        for (int k = 0; k < SAMPLE_COUNT; k++)
+        {
+            int64_t offsetX = samplePattern[k][0] * SUBPIXEL_SCALE / 16;
+            int64_t offsetY = samplePattern[k][1] * SUBPIXEL_SCALE / 16;
+
+            for (int e = 0; e < 3; e++)
+            {
+                sampleDelta[k][e] = offsetX * edges[e].dy - offsetY * edges[e].dx;
+                sampleMargin[e] = max(sampleMargin[e], sampleDelta[k][e]);
             }
-            #pragma endregion
+        }
+    }
+    #pragma endregion
+
+    #pragma region Get blocks extents
+    // Greatest offset of each edge function inside a block, if the block origin value plus this offset
+    // is negative then no pixel (nor sample) of the block is in the triangle
+    int64_t blockMaxDelta[3];
+    for (int k = 0; k < 3; k++)
+        blockMaxDelta[k] = max(int64_t(0), (HIZ_BLOCK_SIZE - 1) * edges[k].stepX) + max(int64_t(0), (HIZ_BLOCK_SIZE - 1) * edges[k].stepY) + sampleMargin[k];
+    #pragma endregion
+
+    #pragma region Get quad lanes
+    // Lanes of a 2x2 quad: top-left, top-right, bottom-left, bottom-right
+    const int laneX[4] = { 0, 1, 0, 1 };
+    const int laneY[4] = { 0, 0, 1, 1 };
 
-            #pragma region Perspective correction
+    // Offset of each edge function for each lane, relative to the top-left pixel of the quad
+    int64_t laneDelta[4][3];
+    for (int l = 0; l < 4; l++)
+    {
+        for (int k = 0; k < 3; k++)
+            laneDelta[l][k] = laneX[l] * edges[k].stepX + laneY[l] * edges[k].stepY;
+    }
+    #pragma endregion
 
-            if (uniform.perspectiveCorrection)
-                perspectiveCorrection({ screenCoords[0].w, screenCoords[1].w, screenCoords[2].w }, weight);
+    const float3 depths    = { screenCoords[0].z, screenCoords[1].z, screenCoords[2].z };
+    const float3 invertedW = { screenCoords[0].w, screenCoords[1].w, screenCoords[2].w };
 
-            #pragma endregion
+    #pragma region Hierarchical Z triangle rejection
+    // The depths are interpolated linearly on the screen, so they stay in the range of the vertices depths
+    const float triangleMinZ = min(depths.x, min(depths.y, depths.z));
+    const float triangleMaxZ = max(depths.x, max(depths.y, depths.z));
 
-            #pragma region Get fragment color
-            // Get the varying of the current pixel
-            Varying fragVarying = interpolateVarying(varying, weight);
+    const bool useHiZ = uniform.depthTest && uniform.hierarchicalZ;
 
-            float4 fragColor;
-            if (!fragmentShader(fragVarying, uniform, fragColor))
+    // Discard the triangle if it is behind all the depths of the tiles it overlaps
+    if (useHiZ && isRectOccluded(fb, SAMPLE_COUNT > 1, xMin, yMin, xMax, yMax, triangleMaxZ))
+    {
+        stats.isOccluded = true;
+        return;
+    }
+    #pragma endregion
+
+    FragmentBatch batch;
+    const int batchLaneCount = getLaneCount(uniform.shadingPath);
+
+    // Foreach 8x8 block in the bounding box
+    for (int by = blockYMin; by <= yMax; by += HIZ_BLOCK_SIZE)
+    {
+        int64_t blockValues[3] = { blockRowValues[0], blockRowValues[1], blockRowValues[2] };
+
+        for (int bx = blockXMin; bx <= xMax; bx += HIZ_BLOCK_SIZE, blockValues[0] += HIZ_BLOCK_SIZE * edges[0].stepX, blockValues[1] += HIZ_BLOCK_SIZE * edges[1].stepX, blockValues[2] += HIZ_BLOCK_SIZE * edges[2].stepX)
+        {
+            // Skip the blocks fully outside of an edge
+            if (blockValues[0] + blockMaxDelta[0] < 0 || blockValues[1] + blockMaxDelta[1] < 0 || blockValues[2] + blockMaxDelta[2] < 0)
                 continue;
+
+            #pragma region Hierarchical Z block rejection
+            int blockX = bx / HIZ_BLOCK_SIZE;
+            int blockY = by / HIZ_BLOCK_SIZE;
+
+            // If the triangle is in front of all the depths of the block, the depth buffer doesn't need to be read
+            bool depthTestPassed = false;
+
+            if (useHiZ)
+            {
+                const DepthRange& blockRange = getBlockDepthRange(fb, SAMPLE_COUNT > 1, blockX, blockY);
+
+                // If the triangle is behind all the depths of the block, discard the whole block
+                // A stale min is only refreshed if the block has depths in front of the triangle
+                if (triangleMaxZ <= blockRange.minZ)
+                    continue;
+
+                if (triangleMaxZ <= blockRange.maxZ && triangleMaxZ <= getBlockDepthRange(fb, SAMPLE_COUNT > 1, blockX, blockY, true).minZ)
+                    continue;
+
+                depthTestPassed = triangleMinZ > blockRange.maxZ;
+            }
             #pragma endregion
 
-            #pragma region Set the depth and the fragment color to valid samples
-            if (uniform.msaa)
+            int quadX0 = max(bx, quadXMin);
+            int quadY0 = max(by, quadYMin);
+            int quadX1 = min(bx + HIZ_BLOCK_SIZE - 1, xMax);
+            int quadY1 = min(by + HIZ_BLOCK_SIZE - 1, yMax);
+
+            int64_t rowValues[3];
+            for (int k = 0; k < 3; k++)
+                rowValues[k] = blockValues[k] + (quadX0 - bx) * edges[k].stepX + (quadY0 - by) * edges[k].stepY;
+
+            bool isBlockWritten = false;
+
+            // Foreach 2x2 quad in the block
+            for (int j = quadY0; j <= quadY1; j += 2)
             {
-                int     msaaIndex = fbIndex * NB_SAMPLES;
-                float*  msaaZBuffer = &fb.msaaDepthBuffer[msaaIndex];
-                float4* msaaColorBuffer = &fb.msaaColorBuffer[msaaIndex];
+                int64_t values[3] = { rowValues[0], rowValues[1], rowValues[2] };
 
-                // For each covered sample set the depth, get the blended color and set it to the current sample
-                for (int k = 0, mask = 1; k < NB_SAMPLES; k++, mask <<= 1)
+                for (int i = quadX0; i <= quadX1; i += 2, values[0] += 2 * edges[0].stepX, values[1] += 2 * edges[1].stepX, values[2] += 2 * edges[2].stepX)
                 {
-                    if (sampleBit & mask)
+                    unsigned int quadMask = 0u;
+
+                    for (int l = 0; l < 4; l++)
                     {
-                        // Set the sample color, to avoid changes on the fragment color during blending
-                        float4 sampleColor = fragColor;
+                        int x = i + laneX[l];
+                        int y = j + laneY[l];
 
-                        // If there is blending, get the last sample in the sampleColorBuffer and add it to the sample color
-                        if (uniform.blending && sampleColor.a < 1.f)
-                            blend(sampleColor, msaaColorBuffer[k]);
+                        int64_t laneValues[3] = { values[0] + laneDelta[l][0], values[1] + laneDelta[l][1], values[2] + laneDelta[l][2] };
 
-                        if (uniform.depthTest)
+                        // Lanes not covered are still interpolated at their center as helpers of the quad
+                        float3 weight = getWeights(laneValues[0], laneValues[1], laneValues[2]);
+                        uint16_t sampleBit = 0;
+                        bool isCovered = false;
+
+                        if (x >= xMin && x <= xMax && y >= yMin && y <= yMax)
                         {
-                            // Check if there is already a closer sample
-                            if (msaaZBuffer[k] >= z)
-                                continue;
+                            #pragma region Compute samples validity
+                            // Check for each sample if it is in the triangle or not, and put these informations on a bitmask
+                            if (SAMPLE_COUNT > 1)
+                            {
+                                int lastSample = 0;
+                                for (int k = 0, mask = 1; k < SAMPLE_COUNT; k++, mask <<= 1)
+                                {
+                                    // The sample is covered if all its edge function values are positive
+                                    if (((laneValues[0] + sampleDelta[k][0]) | (laneValues[1] + sampleDelta[k][1]) | (laneValues[2] + sampleDelta[k][2])) < 0)
+                                        continue;
+
+                                    sampleBit |= mask;
+                                    lastSample = k;
+                                }
+
+                                // If the centroid is not in the triangle, use the last covered sample weight
+                                isCovered = sampleBit != 0;
+                                if (isCovered && (laneValues[0] | laneValues[1] | laneValues[2]) < 0)
+                                    weight = getWeights(laneValues[0] + sampleDelta[lastSample][0], laneValues[1] + sampleDelta[lastSample][1], laneValues[2] + sampleDelta[lastSample][2]);
+                            }
+                            #pragma endregion
+
+                            #pragma region Compute centroid validity
+                            else
+                                isCovered = (laneValues[0] | laneValues[1] | laneValues[2]) >= 0;
+                            #pragma endregion
+                        }
 
-                            if (alphaTest(uniform, sampleColor.a))
-                                msaaZBuffer[k] = z;
+                        int fbIndex = y * fb.width + x;
+
+                        #pragma region Depth test
+                        // Keep z in memory to set it after alpha test
+                        float z = interpolateFloat(depths, weight);
+
+                        // If there is a closer pixel drawn at the same screen coords, discard
+                        stats.fragmentsTested += isCovered;
+
+                        if (isCovered && uniform.depthTest && !depthTestPassed && fb.depthBuffer[fbIndex] >= z)
+                        {
+                            isCovered = false;
+                            stats.fragmentsDepthKilled++;
                         }
+                        #pragma endregion
+
+                        #pragma region Perspective correction
+
+                        if (uniform.perspectiveCorrection)
+                            perspectiveCorrection(invertedW, weight);
+
+                        #pragma endregion
+
+                        int lane = batch.count + l;
+                        batch.w0[lane] = weight.x;
+                        batch.w1[lane] = weight.y;
+                        batch.w2[lane] = weight.z;
+                        batch.fbIndex[lane] = fbIndex;
+                        batch.depth[lane] = z;
+                        batch.sampleBits[lane] = sampleBit;
 
-                        msaaColorBuffer[k] = sampleColor;
+                        if (isCovered)
+                            quadMask |= 1u << l;
                     }
-                }
-            }
-            #pragma endregion
 
-            #pragma region Set the depth and the fragment color to the valid pixel
-            else
-            {
-                float4* colorBuffer = fb.colorBufferRef[fbIndex];
+                    // Leave the quads without any fragment to shade
+                    if (!quadMask)
+                        continue;
 
-                // If there is blending, get the last pixel in the colorBuffer and add it to the fragment color
-                if (uniform.blending && fragColor.a < 1.f)
-                    blend(fragColor, *colorBuffer);
+                    batch.liveMask |= quadMask << batch.count;
+                    batch.count += 4;
+                    isBlockWritten = true;
 
-                // If the cutout permit it, write in the depthBuffer
-                if (uniform.depthTest && alphaTest(uniform, fragColor.a))
-                    fb.depthBuffer[fbIndex] = z;
+                    if (batch.count == batchLaneCount)
+                        flushBatch<SAMPLE_COUNT>(fb, batch, varying, uniform, stats);
+                }
 
-                *colorBuffer = fragColor;
+                for (int k = 0; k < 3; k++)
+                    rowValues[k] += 2 * edges[k].stepY;
             }
-            #pragma endregion
+
+            // Shade the last quads of the block, so its depths are written before the next blocks
+            if (batch.count)
+                flushBatch<SAMPLE_COUNT>(fb, batch, varying, uniform, stats);
+
+            // The depths of the block may have grown
+            if (isBlockWritten && uniform.depthTest)
+                updateDepthRange(fb, blockX, blockY, triangleMaxZ);
         }
+
+        for (int k = 0; k < 3; k++)
+            blockRowValues[k] += HIZ_BLOCK_SIZE * edges[k].stepY;
+    }
+}
+
+void rasterTriangle(const Framebuffer& fb, const float4 screenCoords[3], const Varying varying[3], const Uniform& uniform, const ClipRect& clipRect)
+{
+    Profiler* profiler = uniform.profiler && uniform.profiler->enabled ? uniform.profiler : nullptr;
+    int64_t start = profiler ? getProfilerTime() : 0;
+
+    RasterStats stats;
+    stats.isProfiled = profiler != nullptr;
+
+    // Use the rasterizer specialized for the sample count of the frame buffer
+    switch (uniform.msaa ? fb.msaaSampleCount : 1)
+    {
+        case 2:  rasterTriangle<2>(fb, screenCoords, varying, uniform, clipRect, stats);  break;
+        case 4:  rasterTriangle<4>(fb, screenCoords, varying, uniform, clipRect, stats);  break;
+        case 8:  rasterTriangle<8>(fb, screenCoords, varying, uniform, clipRect, stats);  break;
+        case 16: rasterTriangle<16>(fb, screenCoords, varying, uniform, clipRect, stats); break;
+        default: rasterTriangle<1>(fb, screenCoords, varying, uniform, clipRect, stats);  break;
+    }
+
+    if (profiler)
+    {
+        profiler->stageTimes[PS_RASTERIZATION]    += getProfilerTime() - start - stats.shadingTime;
+        profiler->stageTimes[PS_FRAGMENT_SHADING] += stats.shadingTime;
+
+        profiler->count(PC_TRIANGLES_RASTERIZED, 1);
+        profiler->count(PC_TRIANGLES_OCCLUDED, stats.isOccluded);
+        profiler->count(PC_FRAGMENTS_TESTED, stats.fragmentsTested);
+        profiler->count(PC_FRAGMENTS_DEPTH_KILLED, stats.fragmentsDepthKilled);
+        profiler->count(PC_FRAGMENTS_SHADED, stats.fragmentsShaded);
     }
 }
 
@@ -740,6 +1777,19 @@ unsigned char computeClipOutcodes(const float4 clipCoords)
     return code;
 }
 
+// Get the clip codes of the guard band: x and y planes are moved away from the screen, near, far and w planes are the same
+unsigned char computeGuardBandOutcodes(const float4& clipCoords, float guardBandX, float guardBandY)
+{
+    unsigned char code = computeClipOutcodes(clipCoords) & ~(CLIP_RIGHT | CLIP_TOP | CLIP_LEFT | CLIP_BOTTOM);
+
+    if (clipCoords.x >=  guardBandX * clipCoords.w) code |= CLIP_RIGHT;
+    if (clipCoords.y >=  guardBandY * clipCoords.w) code |= CLIP_TOP;
+    if (clipCoords.x <= -guardBandX * clipCoords.w) code |= CLIP_LEFT;
+    if (clipCoords.y <= -guardBandY * clipCoords.w) code |= CLIP_BOTTOM;
+
+    return code;
+}
+
 int clipTriangle(clipPoint outputCoords[9], unsigned char outputCodes)
 {
     // Fast exit if all points are in the screen
@@ -767,16 +1817,16 @@ int clipTriangle(clipPoint outputCoords[9], unsigned char outputCodes)
         int axisSign = sign(i - 3);
         #pragma endregion
 
-        // Compute previous clipcode for the first point and the current axis value
-        unsigned char   prevCode  = computeClipOutcodes(previousVertex->coords) & plane;
+        // Compute the current axis value and the previous clipcode for the first point (outside if the value is negative)
         float           prevValue = previousVertex->coords.w + axisSign * previousVertex->coords.e[axis];
+        bool            prevCode  = prevValue <= 0.f;
 
         #pragma region Traverse the points of the triangle
         while (currentVertex != &outputCoords[finalPointCount])
         {
-            // Compute current clipcode and the current axis value
-            unsigned char   currCode  = computeClipOutcodes(currentVertex->coords) & plane;
+            // Compute the current axis value and the current clipcode (same as computeClipOutcodes for this plane)
             float           currValue = currentVertex->coords.w + axisSign * currentVertex->coords.e[axis];
+            bool            currCode  = currValue <= 0.f;
 
             #pragma region Get intersection
             // Check if only one point is outside the plane
@@ -818,19 +1868,169 @@ int clipTriangle(clipPoint outputCoords[9], unsigned char outputCodes)
     return finalPointCount;
 }
 
-void drawTriangle(rdrImpl* renderer, const rdrVertex vertices[3])
+void binTriangle(rdrImpl* renderer, const float4 screenCoords[3], const Varying varyings[3])
+{
+    ProfileScope scope(&renderer->profiler, PS_BINNING);
+
+    #pragma region Get overlapped tiles
+    const ClipRect& scissor = renderer->uniform.scissor;
+
+    int xMin = max(scissor.xMin, (int)min(screenCoords[0].x, min(screenCoords[1].x, screenCoords[2].x)));
+    int yMin = max(scissor.yMin, (int)min(screenCoords[0].y, min(screenCoords[1].y, screenCoords[2].y)));
+    int xMax = min(scissor.xMax - 1, (int)max(screenCoords[0].x, max(screenCoords[1].x, screenCoords[2].x)));
+    int yMax = min(scissor.yMax - 1, (int)max(screenCoords[0].y, max(screenCoords[1].y, screenCoords[2].y)));
+    if (xMin > xMax || yMin > yMax)
+        return;
+    #pragma endregion
+
+    int triangleIndex = renderer->binnedTriangles.size();
+
+    RasterTriangle triangle;
+    triangle.stateIndex = renderer->drawStates.size() - 1;
+    for (int i = 0; i < 3; i++)
+    {
+        triangle.screenCoords[i] = screenCoords[i];
+        triangle.varyings[i] = varyings[i];
+    }
+    renderer->binnedTriangles.push_back(triangle);
+
+    // Add the triangle to the bin of each tile covered by its bounding box
+    for (int ty = yMin / TILE_SIZE; ty <= yMax / TILE_SIZE; ty++)
+    {
+        for (int tx = xMin / TILE_SIZE; tx <= xMax / TILE_SIZE; tx++)
+            renderer->tileBins[ty * renderer->tileCountX + tx].push_back(triangleIndex);
+    }
+}
+
+void rasterTile(rdrImpl* renderer, int tileIndex, const ClipRect& tileRect, bool transparentPass)
+{
+    for (int triangleIndex : renderer->tileBins[tileIndex])
+    {
+        const RasterTriangle& triangle = renderer->binnedTriangles[triangleIndex];
+        const Uniform& drawState = renderer->drawStates[triangle.stateIndex];
+
+        if (drawState.isTransparent == transparentPass)
+            rasterTriangle(renderer->fb, triangle.screenCoords, triangle.varyings, drawState, tileRect);
+    }
+}
+
+void shadeGBuffer(const Framebuffer& fb, const ClipRect& rect)
+{
+    // Light each pixel of the rect with the inputs of its closest fragment
+    for (int y = rect.yMin; y < rect.yMax; y++)
+    {
+        for (int x = rect.xMin; x < rect.xMax; x++)
+        {
+            int fbIndex = y * fb.width + x;
+            const GBufferTexel& texel = fb.gBuffer[fbIndex];
+
+            if (!texel.drawState)
+                continue;
+
+            Varying fragVars;
+            fragVars.coords = texel.coords;
+            fragVars.normal = texel.normal;
+            fragVars.color  = texel.color;
+            fragVars.uv     = texel.uv;
+
+            // The pixel effect has already been applied during the rasterization
+            float4 fragColor;
+            fragmentShader(fragVars, *texel.drawState, fragColor, texel.lod);
+
+            float4* colorBuffer = &(*fb.colorBufferRef)[fbIndex];
+
+            if (texel.drawState->blending && fragColor.a < 1.f)
+                blend(fragColor, *colorBuffer);
+
+            *colorBuffer = fragColor;
+        }
+    }
+}
+
+void flushTiles(rdrImpl* renderer)
+{
+    Framebuffer& fb = renderer->fb;
+
+    #pragma region Set G-buffer
+    if (renderer->deferredShading)
+    {
+        // The G-buffer is only allocated when the deferred shading is used
+        if (!renderer->gBuffer)
+            renderer->gBuffer = new GBufferTexel[fb.width * fb.height];
+
+        fb.gBuffer = renderer->gBuffer;
+    }
+    #pragma endregion
+
+    // Rasterize each tile on the workers, a tile keeps the draw order of its triangles
+    renderer->threadPool->parallelFor(renderer->tileBins.size(), [renderer, &fb](int tileIndex)
+    {
+        int tx = tileIndex % renderer->tileCountX;
+        int ty = tileIndex / renderer->tileCountX;
+
+        ClipRect tileRect =
+        {
+            tx * TILE_SIZE,
+            ty * TILE_SIZE,
+            min((tx + 1) * TILE_SIZE, fb.width),
+            min((ty + 1) * TILE_SIZE, fb.height)
+        };
+
+        // Clear the G-buffer of the tile
+        if (fb.gBuffer)
+        {
+            for (int y = tileRect.yMin; y < tileRect.yMax; y++)
+            {
+                for (int x = tileRect.xMin; x < tileRect.xMax; x++)
+                    fb.gBuffer[y * fb.width + x].drawState = nullptr;
+            }
+        }
+
+        // Without deferred shading all the triangles are drawn in this pass
+        rasterTile(renderer, tileIndex, tileRect, false);
+
+        if (fb.gBuffer)
+        {
+            {
+                ProfileScope scope(&renderer->profiler, PS_FRAGMENT_SHADING);
+                shadeGBuffer(fb, tileRect);
+            }
+
+            // Transparent triangles are blended with the lit pixels
+            rasterTile(renderer, tileIndex, tileRect, true);
+        }
+    });
+
+    fb.gBuffer = nullptr;
+
+    // Draw the wireframe on top of the triangles
+    for (const WireframeLine& line : renderer->binnedLines)
+        drawLine(fb, line.p0, line.p1, renderer->lineColor, isMSAAEnabled(renderer));
+
+    // Empty the bins but keep their memory for the next frame
+    for (std::vector<int>& bin : renderer->tileBins)
+        bin.clear();
+
+    renderer->binnedTriangles.clear();
+    renderer->binnedLines.clear();
+    renderer->drawStates.clear();
+}
+
+void drawTriangle(rdrImpl* renderer, const float4 clipCoords[3], const Varying varying[3])
 {
-    #pragma region Varyings, clip coords, outputPoints and outputCodes
-    Varying         varying[3];
-    float4          clipCoords[3];
+    // The rasterization of the triangle is not part of its setup
+    Profiler& profiler = renderer->profiler;
+    ProfileScope setupScope(&profiler, PS_CULLING);
+
+    if (profiler.enabled)
+        profiler.count(PC_TRIANGLES, 1);
+
+    #pragma region OutputPoints and outputCodes
     clipPoint       outputPoints[9];
     unsigned char   outputCodes[3];
 
     for (int i = 0; i < 3; i++)
     {
-        // Local space (v3) -> Clip space (v4) (apply vertex shader, set the current varying values)
-        clipCoords[i] = vertexShader(vertices[i], renderer->uniform, varying[i]);
-
         // Link clip coords and his weight
         outputPoints[i] = { clipCoords[i] };
         outputPoints[i].weights.e[i] = 1.f;
@@ -845,8 +2045,32 @@ void drawTriangle(rdrImpl* renderer, const rdrVertex vertices[3])
     if (outputCodes[0] & outputCodes[1] & outputCodes[2])
         return;
 
-    // Clip the triangle and get the new vertex count
-    int pointCount = clipTriangle(outputPoints, outputCodes[0] | outputCodes[1] | outputCodes[2]);
+    int  pointCount = 3;
+    bool isClipped  = false;
+
+    if (outputCodes[0] | outputCodes[1] | outputCodes[2])
+    {
+        // Guard band: the triangles only crossing the x/y planes near the screen are rasterized without clipping,
+        // the rasterizer only walks their pixels inside the viewport
+        float guardBandX = 1.f + 2.f * GUARD_BAND_SIZE / max(1, renderer->viewport.width  - renderer->viewport.x);
+        float guardBandY = 1.f + 2.f * GUARD_BAND_SIZE / max(1, renderer->viewport.height - renderer->viewport.y);
+
+        unsigned char guardBandCodes = 0;
+        for (int i = 0; i < 3; i++)
+            guardBandCodes |= computeGuardBandOutcodes(clipCoords[i], guardBandX, guardBandY);
+
+        // Clip the triangle and get the new vertex count (crossing near/far planes or outside the guard band)
+        if (guardBandCodes)
+        {
+            ProfileScope clipScope(&profiler, PS_CLIPPING, PS_CULLING);
+
+            pointCount = clipTriangle(outputPoints, outputCodes[0] | outputCodes[1] | outputCodes[2]);
+            isClipped  = true;
+
+            if (profiler.enabled)
+                profiler.count(PC_TRIANGLES_CLIPPED, 1);
+        }
+    }
 
     if (pointCount < 3) // Exit if there is not enough vertice in the screen
         return;
@@ -883,8 +2107,14 @@ void drawTriangle(rdrImpl* renderer, const rdrVertex vertices[3])
         screenCoords[i] = { ndcToScreenCoords(ndcCoords[i], renderer->viewport), invertedW[i] };
 
         // Get new varyings after clipping
-        clippedVaryings[i] = interpolateVarying(varying, outputPoints[i].weights);
+        clippedVaryings[i] = isClipped ? interpolateVarying(varying, outputPoints[i].weights) : varying[i];
     }
+
+    // The other triangles have been culled
+    if (profiler.enabled)
+        profiler.count(PC_TRIANGLES_ACCEPTED, 1);
+
+    setupScope.stop();
     #pragma endregion
 
     #pragma region Rasterization and Wireframe
@@ -896,26 +2126,331 @@ void drawTriangle(rdrImpl* renderer, const rdrVertex vertices[3])
         if (renderer->fillTriangle)
         {
             const Varying varyings[3] = { clippedVaryings[index0], clippedVaryings[index1], clippedVaryings[index2] };
-            rasterTriangle(renderer->fb, pointCoords, varyings, renderer->uniform);
+
+            if (isBinningEnabled(renderer))
+                binTriangle(renderer, pointCoords, varyings);
+            else
+                rasterTriangle(renderer->fb, pointCoords, varyings, renderer->uniform, { 0, 0, renderer->fb.width, renderer->fb.height });
         }
 
         if (renderer->wireframeMode)
         {
             for (int i = 0; i < 3; i++)
-                drawLine(renderer->fb, pointCoords[i].xyz, pointCoords[(i + 1) % 3].xyz, renderer->lineColor, renderer->uniform.msaa);
+            {
+                // Lines are drawn after the binned triangles to stay visible
+                if (isBinningEnabled(renderer))
+                    renderer->binnedLines.push_back({ pointCoords[i].xyz, pointCoords[(i + 1) % 3].xyz });
+                else
+                    drawLine(renderer->fb, pointCoords[i].xyz, pointCoords[(i + 1) % 3].xyz, renderer->lineColor, isMSAAEnabled(renderer));
+            }
         }
     }
     #pragma endregion
 }
 
-void rdrDrawTriangles(rdrImpl* renderer, const rdrVertex* vertices, int count)
+// True if some fragments of the draw can have an alpha under 1 (blended, or cut out by the alpha test)
+bool hasDrawAlpha(const Uniform& drawState, const rdrVertex* vertices, int count)
 {
+    // The alpha of the fragments is the product of these alphas (the lights keep it over 1)
+    if (drawState.globalColor.a < 1.f || drawState.globalAmbient.a < 1.f ||
+        drawState.material.ambientColor.a < 1.f || drawState.material.diffuseColor.a < 1.f)
+        return true;
+
+    if (isTextureValid(drawState.texture) && drawState.texture.hasAlpha)
+        return true;
+
+    // The vertices are only read if the caller doesn't give their alpha
+    if (drawState.vertexAlpha != VertexAlpha::UNKNOWN)
+        return drawState.vertexAlpha == VertexAlpha::UNDER_ONE;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (vertices[i].a < 1.f)
+            return true;
+    }
+
+    return false;
+}
+
+void beginDraw(rdrImpl* renderer, const rdrVertex* vertices, int count)
+{
+    renderer->isFrameEmpty = false;
+
     // Pre-compute view proj for the current triangle
     renderer->uniform.viewProj = renderer->uniform.projection * renderer->uniform.view;
 
+    // Binned triangles are rasterized later, so keep the uniform of this draw call
+    if (isBinningEnabled(renderer))
+        renderer->drawStates.push_back(renderer->uniform);
+
+    if (renderer->deferredShading)
+    {
+        Uniform& drawState = renderer->drawStates.back();
+
+        // The G-buffer only keeps one sample per pixel
+        drawState.msaa = false;
+
+        // Transparent draws are blended with the lit pixels, so they are drawn with the forward path after the lighting
+        // Without blending, the draws with alpha are also drawn with the forward path (in order), where the alpha test skips the depth of the cut out pixels
+        bool hasAlpha = hasDrawAlpha(drawState, vertices, count);
+        drawState.isTransparent = hasAlpha && drawState.blending;
+
+        // Only the per-pixel lighting is deferred, the other opaque draws are directly shaded
+        drawState.deferredLighting = !hasAlpha && drawState.lighting && drawState.phongModel;
+    }
+}
+
+void transformVertices(rdrImpl* renderer, const rdrVertex* vertices, int count)
+{
+    ProfileScope scope(&renderer->profiler, PS_VERTEX_SHADING);
+
+    // The transformed vertices of the previous draw are overwritten
+    if (renderer->vertexCache.size() < (size_t)count)
+        renderer->vertexCache.resize(count);
+
+    const Uniform& uniform = renderer->uniform;
+    TransformedVertex* transformed = renderer->vertexCache.data();
+
+    // Local space (v3) -> Clip space (v4) (apply vertex shader to all the vertices of the draw)
+    switch (uniform.shadingPath)
+    {
+        case ShadingPath::AVX2:  transformVerticesAVX2(vertices, count, uniform, transformed);  break;
+        case ShadingPath::SSE41: transformVerticesSSE41(vertices, count, uniform, transformed); break;
+
+        default:
+            for (int i = 0; i < count; i++)
+            {
+                // The lighting of the vertex shader adds to the varying colors
+                transformed[i].varying    = Varying();
+                transformed[i].clipCoords = vertexShader(vertices[i], uniform, transformed[i].varying);
+            }
+            break;
+    }
+
+    #pragma region Reference check
+    // Compare the SIMD vertices with the scalar vertex shader ones
+    if (uniform.shadingReferenceCheck && uniform.shadingPath != ShadingPath::SCALAR)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            TransformedVertex reference;
+            reference.clipCoords = vertexShader(vertices[i], uniform, reference.varying);
+
+            const float* values          = (const float*)&transformed[i];
+            const float* referenceValues = (const float*)&reference;
+
+            for (int j = 0; j < (int)(sizeof(TransformedVertex) / sizeof(float)); j++)
+            {
+                if (!isWithinTolerance(values[j], referenceValues[j]))
+                {
+                    (*uniform.shadingMismatches)++;
+                    break;
+                }
+            }
+        }
+    }
+    #pragma endregion
+
+    if (renderer->profiler.enabled)
+        renderer->profiler.count(PC_VERTICES, count);
+}
+
+void rdrDrawTriangles(rdrImpl* renderer, const rdrVertex* vertices, int count)
+{
+    beginDraw(renderer, vertices, count);
+    transformVertices(renderer, vertices, count);
+
     // Transform vertex list to triangles into colorBuffer
-    for (int i = 0; i < count; i += 3)
-        drawTriangle(renderer, &vertices[i]);
+    for (int i = 0; i + 2 < count; i += 3)
+    {
+        Varying varying[3];
+        float4  clipCoords[3];
+
+        for (int j = 0; j < 3; j++)
+        {
+            clipCoords[j] = renderer->vertexCache[i + j].clipCoords;
+            varying[j]    = renderer->vertexCache[i + j].varying;
+        }
+
+        drawTriangle(renderer, clipCoords, varying);
+    }
+}
+
+void rdrDrawIndexed(rdrImpl* renderer, const rdrVertex* vertices, int vertexCount, const void* indices, int indexCount, rdrIndexType indexType)
+{
+    if (!vertices || !indices || vertexCount <= 0)
+        return;
+
+    beginDraw(renderer, vertices, vertexCount);
+
+    // Each vertex is shaded once, then the triangles read the post-transform cache
+    transformVertices(renderer, vertices, vertexCount);
+
+    for (int i = 0; i + 2 < indexCount; i += 3)
+    {
+        Varying varying[3];
+        float4  clipCoords[3];
+        bool    isValid = true;
+
+        for (int j = 0; j < 3 && isValid; j++)
+        {
+            int index = indexType == IT_UINT16 ? ((const uint16_t*)indices)[i + j] : (int)((const uint32_t*)indices)[i + j];
+
+            // Skip the triangles with an invalid index
+            isValid = index >= 0 && index < vertexCount;
+            if (!isValid)
+                break;
+
+            clipCoords[j] = renderer->vertexCache[index].clipCoords;
+            varying[j]    = renderer->vertexCache[index].varying;
+        }
+
+        if (isValid)
+            drawTriangle(renderer, clipCoords, varying);
+    }
+}
+
+// Draw the triangles of renderer->instanceIndices for each instance
+void drawInstances(rdrImpl* renderer, const rdrVertex* vertices, int vertexCount, const float* modelMatrices, const float* colors, int instanceCount)
+{
+    Uniform& uniform = renderer->uniform;
+    const mat4x4 model       = uniform.model;
+    const float4 globalColor = uniform.globalColor;
+
+    // The model and the global color are only read by the vertex stage, so the instances share the state of the draw
+    // It is transparent if one of them is: the state is pushed with the most transparent color
+    if (colors)
+    {
+        int transparentInstance = 0;
+        for (int i = 1; i < instanceCount; i++)
+        {
+            if (colors[i * 4 + 3] < colors[transparentInstance * 4 + 3])
+                transparentInstance = i;
+        }
+        uniform.globalColor = globalColor * float4(colors[transparentInstance * 4 + 0], colors[transparentInstance * 4 + 1],
+                                                   colors[transparentInstance * 4 + 2], colors[transparentInstance * 4 + 3]);
+    }
+
+    beginDraw(renderer, vertices, vertexCount);
+
+    const std::vector<int>& indices = renderer->instanceIndices;
+    for (int instance = 0; instance < instanceCount; instance++)
+    {
+        memcpy(uniform.model.e, modelMatrices + instance * 16, sizeof(mat4x4));
+        if (colors)
+            uniform.globalColor = globalColor * float4(colors[instance * 4 + 0], colors[instance * 4 + 1], colors[instance * 4 + 2], colors[instance * 4 + 3]);
+
+        // The vertices are shaded again with the matrix of the instance, then the triangles read the post-transform cache
+        transformVertices(renderer, vertices, vertexCount);
+
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            Varying varying[3];
+            float4  clipCoords[3];
+
+            for (int j = 0; j < 3; j++)
+            {
+                clipCoords[j] = renderer->vertexCache[indices[i + j]].clipCoords;
+                varying[j]    = renderer->vertexCache[indices[i + j]].varying;
+            }
+
+            drawTriangle(renderer, clipCoords, varying);
+        }
+    }
+
+    uniform.model = model;
+    uniform.globalColor = globalColor;
+}
+
+void rdrDrawTrianglesInstanced(rdrImpl* renderer, const rdrVertex* vertices, int vertexCount, const float* modelMatrices, const float* colors, int instanceCount)
+{
+    if (!vertices || vertexCount <= 0 || !modelMatrices || instanceCount <= 0)
+        return;
+
+    // Each 3 vertices are a triangle
+    renderer->instanceIndices.clear();
+    for (int i = 0; i < vertexCount - vertexCount % 3; i++)
+        renderer->instanceIndices.push_back(i);
+
+    drawInstances(renderer, vertices, vertexCount, modelMatrices, colors, instanceCount);
+}
+
+void rdrDrawIndexedInstanced(rdrImpl* renderer, const rdrVertex* vertices, int vertexCount, const void* indices, int indexCount, rdrIndexType indexType,
+                             const float* modelMatrices, const float* colors, int instanceCount)
+{
+    if (!vertices || !indices || vertexCount <= 0 || !modelMatrices || instanceCount <= 0)
+        return;
+
+    // The indices are read and checked once for all the instances
+    std::vector<int>& instanceIndices = renderer->instanceIndices;
+    instanceIndices.clear();
+
+    for (int i = 0; i + 2 < indexCount; i += 3)
+    {
+        int triangle[3];
+        bool isValid = true;
+
+        for (int j = 0; j < 3 && isValid; j++)
+        {
+            triangle[j] = indexType == IT_UINT16 ? ((const uint16_t*)indices)[i + j] : (int)((const uint32_t*)indices)[i + j];
+
+            // Skip the triangles with an invalid index
+            isValid = triangle[j] >= 0 && triangle[j] < vertexCount;
+        }
+
+        if (isValid)
+            instanceIndices.insert(instanceIndices.end(), triangle, triangle + 3);
+    }
+
+    drawInstances(renderer, vertices, vertexCount, modelMatrices, colors, instanceCount);
+}
+
+bool rdrIsBoxOccluded(rdrImpl* renderer, const float* boxMin, const float* boxMax)
+{
+    // The depths of the binned triangles are not written yet
+    // The rasterization leaves stale min depths in the ranges, they are computed again from the depth buffer when needed
+    if (!renderer->binnedTriangles.empty() || !renderer->binnedLines.empty())
+    {
+        flushTiles(renderer);
+        invalidateAllDepthRanges(renderer->fb);
+    }
+
+    const Framebuffer& fb = renderer->fb;
+    mat4x4 viewProj = renderer->uniform.projection * renderer->uniform.view;
+
+    #pragma region Screen rect and nearest depth of the box
+    float xMin =  FLT_MAX, yMin =  FLT_MAX;
+    float xMax = -FLT_MAX, yMax = -FLT_MAX;
+    float maxZ = -FLT_MAX;
+
+    for (int i = 0; i < 8; i++)
+    {
+        float4 corner = { (i & 1) ? boxMax[0] : boxMin[0], (i & 2) ? boxMax[1] : boxMin[1], (i & 4) ? boxMax[2] : boxMin[2], 1.f };
+        float4 clipCoords = viewProj * corner;
+
+        // A box crossing the near plane covers the camera, it can't be hidden
+        if (clipCoords.w <= 0.f || clipCoords.z < -clipCoords.w)
+            return false;
+
+        float3 screenCoords = ndcToScreenCoords(clipCoords.xyz / clipCoords.w, renderer->viewport);
+        xMin = min(xMin, screenCoords.x);
+        yMin = min(yMin, screenCoords.y);
+        xMax = max(xMax, screenCoords.x);
+        yMax = max(yMax, screenCoords.y);
+        maxZ = max(maxZ, screenCoords.z);
+    }
+    #pragma endregion
+
+    // Only the pixels inside the scissor can have a depth
+    int pixelXMin = max((int)floorf(xMin), renderer->uniform.scissor.xMin);
+    int pixelYMin = max((int)floorf(yMin), renderer->uniform.scissor.yMin);
+    int pixelXMax = min((int)ceilf(xMax),  renderer->uniform.scissor.xMax - 1);
+    int pixelYMax = min((int)ceilf(yMax),  renderer->uniform.scissor.yMax - 1);
+
+    if (pixelXMin > pixelXMax || pixelYMin > pixelYMax)
+        return true;
+
+    return isRectOccluded(fb, fb.msaaSampleCount > 1, pixelXMin, pixelYMin, pixelXMax, pixelYMax, maxZ);
 }
 
 void rdrSetImGuiContext(rdrImpl* renderer, struct ImGuiContext* context)
@@ -927,6 +2462,31 @@ void rdrShowImGuiControls(rdrImpl* renderer)
 {
     ImGui::Checkbox("MSAA", &renderer->uniform.msaa);
 
+    // The sample counts are powers of two, from 1x to 16x
+    const char* sampleCounts[] = { "1x", "2x", "4x", "8x", "16x" };
+    int sampleCountIndex = 0;
+    while ((1 << sampleCountIndex) < renderer->msaaSampleCount)
+        sampleCountIndex++;
+
+    if (ImGui::Combo("MSAA samples", &sampleCountIndex, sampleCounts, IM_ARRAYSIZE(sampleCounts)))
+        rdrSetMSAASampleCount(renderer, 1 << sampleCountIndex);
+
+    #pragma region Tiled rendering tree
+    if (ImGui::TreeNode("Tiled rendering"))
+    {
+        ImGui::Checkbox("Tiled rendering", &renderer->tiledRendering);
+
+        if (renderer->tiledRendering && ImGui::SliderInt("Threads", &renderer->threadCount, 1, 64))
+        {
+            // Recreate the workers with the new thread count
+            delete renderer->threadPool;
+            renderer->threadPool = new ThreadPool(renderer->threadCount);
+        }
+
+        ImGui::TreePop();
+    }
+    #pragma endregion
+
     #pragma region Lighting tree
     if (ImGui::TreeNode("Lighting"))
     {
@@ -935,6 +2495,9 @@ void rdrShowImGuiControls(rdrImpl* renderer)
         if (renderer->uniform.lighting)
         {
             ImGui::Checkbox("Phong model", &renderer->uniform.phongModel);
+
+            // Only the draws with the Phong model are lit by the deferred pass
+            ImGui::Checkbox("Deferred shading", &renderer->deferredShading);
             ImGui::ColorEdit4("Global ambient", renderer->uniform.globalAmbient.e, ImGuiColorEditFlags_Float);
         }
 
@@ -956,9 +2519,26 @@ void rdrShowImGuiControls(rdrImpl* renderer)
             }
             #pragma endregion
 
+            #pragma region Shading path
+            {
+                const char* shadingPathStr[] = { "Scalar", "SSE4.1 (2x2 quads)", "AVX2 (2 quads)" };
+                int shadingPathIndex = (int)renderer->uniform.shadingPath;
+                if (ImGui::Combo("Shading path", &shadingPathIndex, shadingPathStr, IM_ARRAYSIZE(shadingPathStr)))
+                    renderer->uniform.shadingPath = ShadingPath(min(shadingPathIndex, (int)getBestShadingPath()));
+
+                if (renderer->uniform.shadingPath != ShadingPath::SCALAR)
+                {
+                    ImGui::Checkbox("SIMD reference check", &renderer->uniform.shadingReferenceCheck);
+
+                    if (renderer->uniform.shadingReferenceCheck)
+                        ImGui::Text("Mismatching fragments and vertices: %d", renderer->shadingMismatches.load());
+                }
+            }
+            #pragma endregion
+
             #pragma region Texture filtering
             {
-                const char* filterTypeStr[] = { "NEAREST", "BILINEAR" };
+                const char* filterTypeStr[] = { "NEAREST", "BILINEAR", "TRILINEAR" };
                 int filterTypeIndex = (int)renderer->uniform.textureFilter;
                 if (ImGui::Combo("Texture filter", &filterTypeIndex, filterTypeStr, IM_ARRAYSIZE(filterTypeStr)))
                     renderer->uniform.textureFilter = FilterType(filterTypeIndex);
@@ -1001,6 +2581,7 @@ void rdrShowImGuiControls(rdrImpl* renderer)
 
             ImGui::Checkbox("Perspective correction", &renderer->uniform.perspectiveCorrection);
             ImGui::Checkbox("Depthtest", &renderer->uniform.depthTest);
+            ImGui::Checkbox("Hierarchical Z", &renderer->uniform.hierarchicalZ);
 
             ImGui::ColorEdit4("Global color", renderer->uniform.globalColor.e, ImGuiColorEditFlags_Float);
         }
@@ -1027,9 +2608,62 @@ void rdrShowImGuiControls(rdrImpl* renderer)
         ImGui::Checkbox("Box blur", &renderer->boxBlur);
         ImGui::Checkbox("Gaussian blur", &renderer->gaussianBlur);
         ImGui::Checkbox("Light bloom", &renderer->lightBloom);
+        ImGui::SliderInt("Blur radius", &renderer->blurRadius, 1, 32);
+        ImGui::SliderFloat("Bloom threshold", &renderer->bloomThreshold, 0.f, 4.f);
+        ImGui::SliderFloat("Bloom intensity", &renderer->bloomIntensity, 0.f, 4.f);
+
+        const char* toneMappings[] = { "None", "Reinhard", "ACES" };
+        ImGui::Combo("Tonemapping", (int*)&renderer->toneMapping, toneMappings, IM_ARRAYSIZE(toneMappings));
 
-        if (ImGui::SliderFloat("Gamma", &renderer->gamma, 0.01f, 10.f));
-            renderer->iGamma = 1.f / renderer->gamma;
+        ImGui::Checkbox("sRGB output", &renderer->sRGBOutput);
+        if (!renderer->sRGBOutput)
+            ImGui::SliderFloat("Gamma", &renderer->gamma, 0.01f, 10.f);
+
+        ImGui::TreePop();
+    }
+    #pragma endregion
+
+    #pragma region Profiler tree
+    if (ImGui::TreeNode("Profiler"))
+    {
+        bool profilerEnabled = renderer->profiler.enabled;
+        if (ImGui::Checkbox("Enable profiler", &profilerEnabled))
+            rdrEnableProfiler(renderer, profilerEnabled);
+
+        if (profilerEnabled)
+        {
+            const Profiler& profiler = renderer->profiler;
+            const rdrStats& stats = profiler.lastFrame;
+
+            const char* stageNames[PS_COUNT] =
+            {
+                "Vertex shading", "Clipping", "Culling", "Binning", "Rasterization",
+                "Fragment shading", "MSAA resolve", "Post-process", "Output"
+            };
+
+            // The history is a ring buffer, its oldest frame is the next one written
+            char overlay[64];
+            snprintf(overlay, sizeof(overlay), "Frame: %.2f ms", stats.frameMs);
+            ImGui::PlotLines("##Frame", profiler.frameHistory, PROFILER_HISTORY_SIZE, profiler.historyIndex, overlay, 0.f, FLT_MAX, ImVec2(0.f, 60.f));
+
+            // The stages run by the workers show the time of all the threads
+            for (int i = 0; i < PS_COUNT; i++)
+            {
+                ImGui::PushID(i);
+                snprintf(overlay, sizeof(overlay), "%s: %.2f ms", stageNames[i], stats.stageMs[i]);
+                ImGui::PlotLines("##Stage", profiler.stageHistory[i], PROFILER_HISTORY_SIZE, profiler.historyIndex, overlay, 0.f, FLT_MAX, ImVec2(0.f, 30.f));
+                ImGui::PopID();
+            }
+
+            // The vertex stage uses the same path as the fragments
+            if (stats.stageMs[PS_VERTEX_SHADING] > 0.f)
+                ImGui::Text("Vertex shading: %.1f M vertices/s", stats.vertices / stats.stageMs[PS_VERTEX_SHADING] * 1e-3f);
+
+            ImGui::Text("Triangles: %d (culled: %d, clipped: %d)", stats.triangles, stats.trianglesCulled, stats.trianglesClipped);
+            ImGui::Text("Rasterized by tile: %d (occluded: %d)", stats.trianglesRasterized, stats.trianglesOccluded);
+            ImGui::Text("Fragments tested: %d (killed by depth: %d)", stats.fragmentsTested, stats.fragmentsDepthKilled);
+            ImGui::Text("Fragments shaded: %d (overdraw: %.2f)", stats.fragmentsShaded, stats.overdraw);
+        }
 
         ImGui::TreePop();
     }
@@ -1,8 +1,24 @@
 #pragma once
 
+#include <cstdint>
+#include <vector>
+
 #include <rdr/renderer.h>
 
 #include <common/types.hpp>
+#include <common/thread_pool.hpp>
+
+#include "post_process.hpp"
+#include "profiler.hpp"
+
+// Size in pixels of the square screen tiles used by the tiled rendering
+#define TILE_SIZE 64
+
+// Size in pixels of the square blocks of the hierarchical Z buffer (a tile is made of 8x8 blocks)
+#define HIZ_BLOCK_SIZE 8
+
+// Greatest number of samples per pixel of the MSAA (the sample count is chosen at runtime: 1, 2, 4, 8 or 16)
+#define MAX_SAMPLES 16
 
 enum class FaceOrientation
 {
@@ -21,15 +37,87 @@ enum class FaceType
 enum class FilterType
 {
     NEAREST,
-    BILINEAR
+    BILINEAR,
+    TRILINEAR
+};
+
+// Alpha of the vertices of a draw (the deferred shading reads the vertices if it is unknown)
+enum class VertexAlpha
+{
+    UNKNOWN,
+    ONE,
+    UNDER_ONE
+};
+
+enum class ShadingPath
+{
+    SCALAR,
+    SSE41,
+    AVX2
 };
 
+// Enough levels for a 32768x32768 texture
+#define MAX_MIP_LEVELS 16
+
+// Size of the levels of a mipmapped texture, the levels are stored after each other (level 0 first)
+struct MipChain
+{
+    int levelCount = 1;
+    int widths[MAX_MIP_LEVELS];
+    int heights[MAX_MIP_LEVELS];
+    int offsets[MAX_MIP_LEVELS]; // Index of the first texel of each level
+};
+
+// 8 bits textures are stored by blocks of 4x4 texels (64 bytes, one cache line)
+#define TEXTURE_BLOCK_SIZE 4
+
 struct rdrTexture
 {
     int width = 0, height = 0;
-    float4* data = nullptr;
+    float4* data = nullptr;                 // 32 bits float texels, stored row by row
+    const uint32_t* packedData = nullptr;   // 8 bits RGBA texels, stored by swizzled blocks (see getSwizzledIndex)
+    bool isSRGB = false;                    // The RGB channels of the packed texels are sRGB encoded
+    const MipChain* mips = nullptr;         // Only set for the textures uploaded with rdrCreateTexture
+    bool hasAlpha = false;                  // Some texels have an alpha under 1
 };
 
+// Texture uploaded with rdrCreateTexture
+struct TextureStorage
+{
+    float4*   texels = nullptr;
+    uint32_t* packedTexels = nullptr;
+    bool      isSRGB = false;
+    bool      hasAlpha = false;
+    MipChain  mips;
+};
+
+inline bool isTextureValid(const rdrTexture& texture)
+{
+    return (texture.data || texture.packedData) && texture.width > 0 && texture.height > 0;
+}
+
+// Get the index of a texel in a level stored by 4x4 blocks, the blocks are stored row by row
+// and the texels of a block are in Morton order, so the bilinear neighbours are mostly in the same block
+inline int getSwizzledIndex(int s, int t, int width)
+{
+    int blockCountX = (width + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+    int block = (t >> 2) * blockCountX + (s >> 2);
+
+    return (block << 4) | (s & 1) | ((t & 1) << 1) | ((s & 2) << 1) | ((t & 2) << 2);
+}
+
+// Get the texel count of a level stored by 4x4 blocks (the last blocks are padded)
+inline int getSwizzledTexelCount(int width, int height)
+{
+    int blockCountX = (width  + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+    int blockCountY = (height + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+
+    return blockCountX * blockCountY * TEXTURE_BLOCK_SIZE * TEXTURE_BLOCK_SIZE;
+}
+
+// Linear value of each 8 bits sRGB value
+const float* getSRGBToLinearTable();
+
 struct Light
 {
     bool    isEnable = false;
@@ -44,6 +132,15 @@ struct Light
     float   quadraticAttenuation = 0.f;
 };
 
+// Screen area (max excluded) where a triangle can be rasterized
+struct ClipRect
+{
+    int xMin;
+    int yMin;
+    int xMax;
+    int yMax;
+};
+
 struct Material
 {
     float4 ambientColor  = { 0.2f, 0.2f, 0.2f, 1.0f };
@@ -75,12 +172,16 @@ struct Uniform
     mat4x4 view;
     mat4x4 projection;
 
+    // Pixels of the viewport, the triangles kept by the guard band are only rasterized inside it
+    ClipRect scissor = { 0, 0, 0, 0 };
+
     bool vertexEffect = false;
     bool pixelEffect = false;
 
     bool msaa = true;
 
     bool depthTest = true;
+    bool hierarchicalZ = true;
 
     bool blending = true;
     float cutout = 0.5f;
@@ -89,10 +190,23 @@ struct Uniform
     FaceType faceToCull = FaceType::BACK;
 
     FilterType textureFilter = FilterType::NEAREST;
+    VertexAlpha vertexAlpha = VertexAlpha::UNKNOWN;
+
+    // Fragments are shaded by batches of 2x2 quads with SIMD instructions if available
+    ShadingPath shadingPath = ShadingPath::SCALAR;
+    bool shadingReferenceCheck = false;
+    std::atomic<int>* shadingMismatches = nullptr;
+
+    // Times and counts the stages of the triangles drawn with this uniform (if it is enabled)
+    Profiler* profiler = nullptr;
 
     bool lighting = true;
     bool phongModel = false;
     bool perspectiveCorrection = true;
+
+    // Deferred shading: the lighting of the draw is computed once per pixel in rdrFinish
+    bool deferredLighting = false;
+    bool isTransparent = false; // Drawn with the forward path after the deferred lighting
 };
 
 struct Varying
@@ -106,6 +220,40 @@ struct Varying
     float4 specularColor = { 0.f, 0.f, 0.f, 0.f };
 };
 
+// Output of the vertex shader, kept by the post-transform cache of the indexed draws
+struct TransformedVertex
+{
+    float4  clipCoords;
+    Varying varying;
+};
+
+// Pixel of the G-buffer, the inputs of the fragment shader of the closest fragment
+struct GBufferTexel
+{
+    float3 coords;
+    float3 normal;
+    float4 color;
+    float2 uv;
+    float  lod;
+
+    // Draw state (material, texture and lights) of the fragment, nullptr if the pixel is not lit by the deferred pass
+    const Uniform* drawState;
+};
+
+// Triangle in screen coords ready to be rasterized, with the uniform of its draw call
+struct RasterTriangle
+{
+    float4  screenCoords[3];
+    Varying varyings[3];
+    int     stateIndex;
+};
+
+struct WireframeLine
+{
+    float3 p0;
+    float3 p1;
+};
+
 struct Viewport
 {
     int x;
@@ -114,18 +262,72 @@ struct Viewport
     int height;
 };
 
+// Conservative depth range of a region of the depth buffer, the depth test keeps the greatest depths
+// The depths only grow during a frame, so after a write minZ is still a lower bound (but may be refreshed)
+struct DepthRange
+{
+    float minZ;
+    float maxZ;
+    bool  isValid;      // False if the range has not been computed since the depth buffer was cleared
+    bool  isMinStale;   // True if depths have been written since minZ was computed
+};
+
+// Samples of the MSAA edge pixels of a tile (pixels partially covered by a triangle, their samples can have different colors and depths)
+// Each edge pixel has msaaSampleCount consecutive colors and depths
+struct MsaaTileSamples
+{
+    std::vector<int>    fbIndices;
+    std::vector<float4> colors;
+    std::vector<float>  depths;
+};
+
+// Samples of one edge pixel, null if the pixel is not split into samples
+struct MsaaEdgePixel
+{
+    float4* colors;
+    float*  depths;
+};
+
 struct Framebuffer
 {
     int width;
     int height;
     float4** colorBufferRef;
     float*  depthBuffer;
-    float4* msaaColorBuffer;
-    float*  msaaDepthBuffer;
+
+    // Compressed MSAA: the samples of a pixel only covered by whole fragments share the color and the depth of the pixel
+    // The edge pixels keep all their samples in the list of their tile (to be written by the thread of the tile),
+    // msaaEdgeIndices gives their index in this list (-1 for the other pixels)
+    int msaaSampleCount;
+    int* msaaEdgeIndices;
+    MsaaTileSamples* msaaTileSamples;
+
+    // Hierarchical Z: depth ranges of the 8x8 blocks and of the tiles
+    DepthRange* hiZBlocks;
+    DepthRange* hiZTiles;
+
+    // Only set while the triangles are rasterized with the deferred shading
+    GBufferTexel* gBuffer;
 };
 
+inline int getHiZBlockCountX(const Framebuffer& fb) { return (fb.width  + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE; }
+inline int getHiZBlockCountY(const Framebuffer& fb) { return (fb.height + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE; }
+inline int getHiZTileCountX(const Framebuffer& fb)  { return (fb.width  + TILE_SIZE - 1) / TILE_SIZE; }
+inline int getHiZTileCountY(const Framebuffer& fb)  { return (fb.height + TILE_SIZE - 1) / TILE_SIZE; }
+
+// Get the tile of a pixel, it owns the MSAA edge pixel of this pixel
+inline int getPixelTileIndex(const Framebuffer& fb, int fbIndex)
+{
+    int y = fbIndex / fb.width;
+    int x = fbIndex - y * fb.width;
+
+    return (y / TILE_SIZE) * getHiZTileCountX(fb) + x / TILE_SIZE;
+}
+
 struct rdrImpl
 {
+    unsigned int instanceId = 0u;   // Given by rdrInit
+
     Framebuffer fb;
     Viewport viewport;
 
@@ -137,8 +339,59 @@ struct rdrImpl
     bool gaussianBlur = false;
     bool lightBloom = false;
 
+    // Post-process settings, the blurs and the bloom use the buffers of postProcess
+    int   blurRadius = 1;
+    float bloomThreshold = 1.f;
+    float bloomIntensity = 1.f;
+    PostProcessBuffers postProcess;
+
+    // Output stage: the gamma (or the sRGB curve) is applied with a table, after the tonemapping
     float gamma = 2.2f;
-    float iGamma = 1.f / 2.2f;
+    bool  sRGBOutput = false;
+    ToneMapping toneMapping = ToneMapping::NONE;
+    OutputTable outputTable;
+
+    // Optional copy of the final colors quantized to RGBA8
+    uint32_t* colorBuffer8Bits = nullptr;
 
     Uniform uniform;
+
+    // Samples per pixel of the MSAA, applied to the frame buffer at the end of the frame (or at once if nothing was drawn in the frame)
+    int msaaSampleCount = 4;
+    bool isFrameEmpty = true;   // No draw since the last rdrFinish
+
+    // Number of SIMD fragments different from the scalar path ones
+    std::atomic<int> shadingMismatches { 0 };
+
+    // Tiled rendering: triangles are binned during the draw calls and rasterized by tiles in rdrFinish
+    bool tiledRendering = true;
+    int  threadCount = 0;
+    ThreadPool* threadPool = nullptr;
+
+    int tileCountX = 0;
+    int tileCountY = 0;
+
+    // Copies of the uniform used by the draw calls of the current frame
+    std::vector<Uniform> drawStates;
+    std::vector<RasterTriangle> binnedTriangles;
+    std::vector<WireframeLine> binnedLines;
+
+    // For each tile, the indices of the binned triangles overlapping it (in draw order)
+    std::vector<std::vector<int>> tileBins;
+
+    // Deferred shading: opaque lit draws fill the G-buffer, then each pixel is lit once by tile
+    // The draws are binned (even without tiled rendering) and MSAA is not used
+    bool deferredShading = false;
+    GBufferTexel* gBuffer = nullptr;
+
+    // Textures uploaded with rdrCreateTexture, indexed by their id
+    std::vector<TextureStorage*> textures;
+
+    // Post-transform cache: the vertices of the current draw, shaded once by the vertex stage
+    std::vector<TransformedVertex> vertexCache;
+
+    // Indices of the valid triangles of the current instanced draw, fetched once for all its instances
+    std::vector<int> instanceIndices;
+
+    Profiler profiler;
 };
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "renderer_impl.hpp"
+
+// Lanes of the widest shading path (2 quads of 2x2 pixels)
+#define MAX_BATCH_LANES 8
+
+// Fragments of a triangle waiting to be shaded together, stored as structure of arrays
+// Lanes are grouped by 2x2 quads, lanes of a quad not covered by the triangle are only helpers
+struct FragmentBatch
+{
+    int count = 0;
+    unsigned int liveMask = 0u;     // Lanes covered by the triangle and passing the depth test
+
+    // Interpolation weights (with perspective correction)
+    float w0[MAX_BATCH_LANES];
+    float w1[MAX_BATCH_LANES];
+    float w2[MAX_BATCH_LANES];
+
+    // Informations needed to write the shaded fragments
+    int   fbIndex[MAX_BATCH_LANES];
+    float depth[MAX_BATCH_LANES];
+    uint16_t sampleBits[MAX_BATCH_LANES];
+
+    // Mipmap level of detail, the same for the 4 lanes of a quad (only computed for the trilinear filter)
+    float lod[MAX_BATCH_LANES];
+};
+
+// Shade the live lanes of the batch, return the mask of the lanes written in outColors
+typedef unsigned int (*ShadeBatchFunc)(const FragmentBatch& batch, const Varying varyings[3], const Uniform& uniform, float4 outColors[MAX_BATCH_LANES]);
+
+unsigned int shadeBatchSSE41(const FragmentBatch& batch, const Varying varyings[3], const Uniform& uniform, float4 outColors[MAX_BATCH_LANES]);
+unsigned int shadeBatchAVX2(const FragmentBatch& batch, const Varying varyings[3], const Uniform& uniform, float4 outColors[MAX_BATCH_LANES]);
+
+// Vertex stage: apply the vertex shader to a whole draw by SoA batches of 4 or 8 vertices
+void transformVerticesSSE41(const rdrVertex* vertices, int count, const Uniform& uniform, TransformedVertex* out);
+void transformVerticesAVX2(const rdrVertex* vertices, int count, const Uniform& uniform, TransformedVertex* out);
+
+// Get the widest shading path supported by the CPU
+ShadingPath getBestShadingPath();
+
+// Get the number of lanes shaded at once by a shading path
+inline int getLaneCount(ShadingPath path)
+{
+    return path == ShadingPath::AVX2 ? 8 : 4;
+}
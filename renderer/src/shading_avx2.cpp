@@ -0,0 +1,111 @@
+#include <cstddef>
+
+#include <immintrin.h>
+
+#include <common/maths.hpp>
+
+#include "shading.hpp"
+
+// 8-wide shading path (two 2x2 quads per call), only called if the CPU supports AVX2 and FMA
+// Only the functions of this file use AVX2: the file is not compiled with /arch:AVX2 (MSVC accepts the intrinsics without it),
+// else the inline functions of the shared headers compiled here could replace the other copies of the DLL when they are linked
+#if defined(__GNUC__)
+#define SIMD_FUNC __attribute__((target("avx2,fma")))
+#else
+#define SIMD_FUNC
+#endif
+
+namespace
+{
+    struct i32x8
+    {
+        __m256i v;
+
+        static SIMD_FUNC i32x8 set(int value) { return { _mm256_set1_epi32(value) }; }
+    };
+
+    struct f32x8
+    {
+        static constexpr int width = 8;
+
+        __m256 v;
+
+        static SIMD_FUNC f32x8 set(float value)         { return { _mm256_set1_ps(value) }; }
+        static SIMD_FUNC f32x8 load(const float* values) { return { _mm256_loadu_ps(values) }; }
+    };
+
+    SIMD_FUNC f32x8 operator+(f32x8 a, f32x8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+    SIMD_FUNC f32x8 operator-(f32x8 a, f32x8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    SIMD_FUNC f32x8 operator*(f32x8 a, f32x8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    SIMD_FUNC f32x8 operator/(f32x8 a, f32x8 b) { return { _mm256_div_ps(a.v, b.v) }; }
+    SIMD_FUNC f32x8 operator&(f32x8 a, f32x8 b) { return { _mm256_and_ps(a.v, b.v) }; }
+
+    SIMD_FUNC f32x8 operator< (f32x8 a, f32x8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    SIMD_FUNC f32x8 operator> (f32x8 a, f32x8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+    SIMD_FUNC f32x8 operator==(f32x8 a, f32x8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) }; }
+
+    SIMD_FUNC i32x8 operator+ (i32x8 a, i32x8 b) { return { _mm256_add_epi32(a.v, b.v) }; }
+    SIMD_FUNC i32x8 operator- (i32x8 a, i32x8 b) { return { _mm256_sub_epi32(a.v, b.v) }; }
+    SIMD_FUNC i32x8 operator* (i32x8 a, i32x8 b) { return { _mm256_mullo_epi32(a.v, b.v) }; }
+    SIMD_FUNC i32x8 operator& (i32x8 a, i32x8 b) { return { _mm256_and_si256(a.v, b.v) }; }
+    SIMD_FUNC i32x8 operator| (i32x8 a, i32x8 b) { return { _mm256_or_si256(a.v, b.v) }; }
+    SIMD_FUNC i32x8 operator==(i32x8 a, i32x8 b) { return { _mm256_cmpeq_epi32(a.v, b.v) }; }
+
+    SIMD_FUNC f32x8 vmin(f32x8 a, f32x8 b) { return { _mm256_min_ps(a.v, b.v) }; }
+    SIMD_FUNC f32x8 vmax(f32x8 a, f32x8 b) { return { _mm256_max_ps(a.v, b.v) }; }
+    SIMD_FUNC f32x8 vsqrt(f32x8 a)         { return { _mm256_sqrt_ps(a.v) }; }
+    SIMD_FUNC f32x8 vfloor(f32x8 a)        { return { _mm256_floor_ps(a.v) }; }
+
+    SIMD_FUNC f32x8 vselect(f32x8 mask, f32x8 a, f32x8 b) { return { _mm256_blendv_ps(b.v, a.v, mask.v) }; }
+    SIMD_FUNC i32x8 vselect(f32x8 mask, i32x8 a, i32x8 b) { return { _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b.v), _mm256_castsi256_ps(a.v), mask.v)) }; }
+    SIMD_FUNC i32x8 vselect(i32x8 mask, i32x8 a, i32x8 b) { return { _mm256_blendv_epi8(b.v, a.v, mask.v) }; }
+
+    SIMD_FUNC i32x8 asInt(f32x8 a)   { return { _mm256_castps_si256(a.v) }; }
+    SIMD_FUNC f32x8 asFloat(i32x8 a) { return { _mm256_castsi256_ps(a.v) }; }
+    SIMD_FUNC i32x8 toInt(f32x8 a)   { return { _mm256_cvttps_epi32(a.v) }; }
+    SIMD_FUNC f32x8 toFloat(i32x8 a) { return { _mm256_cvtepi32_ps(a.v) }; }
+
+    template<int shift> SIMD_FUNC i32x8 vsll(i32x8 a) { return { _mm256_slli_epi32(a.v, shift) }; }
+    template<int shift> SIMD_FUNC i32x8 vsrl(i32x8 a) { return { _mm256_srli_epi32(a.v, shift) }; }
+
+    SIMD_FUNC void store(float* values, f32x8 a) { _mm256_storeu_ps(values, a.v); }
+
+    template<typename F>
+    SIMD_FUNC F laneMask(unsigned int bits)
+    {
+        const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        __m256i mask = _mm256_and_si256(_mm256_set1_epi32((int)bits), laneBits);
+        return { _mm256_castsi256_ps(_mm256_cmpeq_epi32(mask, laneBits)) };
+    }
+
+    SIMD_FUNC void gatherTexels(const float4* data, i32x8 index, f32x8 outColor[4])
+    {
+        // Gather each channel of the texels, a texel is 4 floats
+        __m256i offset = _mm256_slli_epi32(index.v, 2);
+
+        for (int c = 0; c < 4; c++)
+            outColor[c] = { _mm256_i32gather_ps(data->e + c, offset, 4) };
+    }
+
+    SIMD_FUNC i32x8 gatherInts(const int* table, i32x8 index)
+    {
+        return { _mm256_i32gather_epi32(table, index.v, 4) };
+    }
+
+    SIMD_FUNC f32x8 gatherFloats(const float* table, i32x8 index)
+    {
+        return { _mm256_i32gather_ps(table, index.v, 4) };
+    }
+
+    #include "shading_simd.hpp"
+}
+
+SIMD_FUNC unsigned int shadeBatchAVX2(const FragmentBatch& batch, const Varying varyings[3], const Uniform& uniform, float4 outColors[MAX_BATCH_LANES])
+{
+    return shadeBatch<f32x8, i32x8>(batch, varyings, uniform, outColors);
+}
+
+SIMD_FUNC void transformVerticesAVX2(const rdrVertex* vertices, int count, const Uniform& uniform, TransformedVertex* out)
+{
+    transformVertices<f32x8, i32x8>(vertices, count, uniform, out);
+}
@@ -0,0 +1,497 @@
+#pragma once
+
+// Fragment shading kernel shared by the SIMD paths
+// The including file defines SIMD_FUNC (target instruction set) and the vector types:
+// F (floats), I (ints) with the same lane count, and the functions used below (vadd, vselect, gather...)
+// The math is the same as interpolateVarying, fragmentShader, getLightColor and getTextureColor, one lane per fragment
+
+template<typename F>
+SIMD_FUNC F safeDivisor(F value)
+{
+    // Same as the maths operators: a null divisor is replaced by epsilon
+    return vselect(value == F::set(0.f), F::set(std::numeric_limits<float>::epsilon()), value);
+}
+
+template<typename F>
+SIMD_FUNC void normalize3(F v[3])
+{
+    F magn = safeDivisor(vsqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]));
+
+    for (int i = 0; i < 3; i++)
+        v[i] = v[i] / magn;
+}
+
+template<typename F, typename I>
+SIMD_FUNC F vlog(F x)
+{
+    // Natural logarithm (cephes polynomial), x has to be positive
+    x = vmax(x, asFloat(I::set(0x00800000)));
+
+    I exponent = vsrl<23>(asInt(x)) - I::set(0x7f);
+    x = asFloat((asInt(x) & I::set(~0x7f800000)) | asInt(F::set(0.5f)));
+
+    F e = toFloat(exponent) + F::set(1.f);
+
+    // Keep the mantissa in [sqrt(1/2), sqrt(2)[
+    F isSmall = x < F::set(0.707106781186547524f);
+    F tmp = x & isSmall;
+    x = x - F::set(1.f);
+    e = e - (F::set(1.f) & isSmall);
+    x = x + tmp;
+
+    F z = x * x;
+    F y = F::set(7.0376836292E-2f);
+    y = y * x + F::set(-1.1514610310E-1f);
+    y = y * x + F::set( 1.1676998740E-1f);
+    y = y * x + F::set(-1.2420140846E-1f);
+    y = y * x + F::set( 1.4249322787E-1f);
+    y = y * x + F::set(-1.6668057665E-1f);
+    y = y * x + F::set( 2.0000714765E-1f);
+    y = y * x + F::set(-2.4999993993E-1f);
+    y = y * x + F::set( 3.3333331174E-1f);
+    y = y * x * z;
+
+    y = y + e * F::set(-2.12194440e-4f);
+    y = y - z * F::set(0.5f);
+    x = x + y;
+    return x + e * F::set(0.693359375f);
+}
+
+template<typename F, typename I>
+SIMD_FUNC F vexp(F x)
+{
+    // Exponential (cephes polynomial)
+    x = vmin(vmax(x, F::set(-88.3762626647949f)), F::set(88.3762626647949f));
+
+    F fx = vfloor(x * F::set(1.44269504088896341f) + F::set(0.5f));
+    x = x - fx * F::set(0.693359375f);
+    x = x - fx * F::set(-2.12194440e-4f);
+
+    F z = x * x;
+    F y = F::set(1.9875691500E-4f);
+    y = y * x + F::set(1.3981999507E-3f);
+    y = y * x + F::set(8.3334519073E-3f);
+    y = y * x + F::set(4.1665795894E-2f);
+    y = y * x + F::set(1.6666665459E-1f);
+    y = y * x + F::set(5.0000001201E-1f);
+    y = y * z + x + F::set(1.f);
+
+    // Multiply by 2^fx
+    return y * asFloat(vsll<23>(toInt(fx) + I::set(0x7f)));
+}
+
+template<typename F, typename I>
+SIMD_FUNC F vpow(F base, float exponent)
+{
+    if (exponent == 0.f)
+        return F::set(1.f);
+
+    // Same as powf for the positive bases, 0 else (bases are clamped to 0 by the lighting)
+    return vselect(base > F::set(0.f), vexp<F, I>(vlog<F, I>(base) * F::set(exponent)), F::set(0.f));
+}
+
+template<typename F>
+SIMD_FUNC F wrap01(F value)
+{
+    F f = value - vfloor(value) + F::set(1.f);
+    return f - vfloor(f);
+}
+
+template<typename I>
+SIMD_FUNC I getSwizzledIndex(I s, I t, I width)
+{
+    // Same layout as getSwizzledIndex() of the renderer
+    I blockCountX = vsrl<2>(width + I::set(TEXTURE_BLOCK_SIZE - 1));
+    I block = vsrl<2>(t) * blockCountX + vsrl<2>(s);
+
+    return vsll<4>(block) | (s & I::set(1)) | vsll<1>(t & I::set(1)) | vsll<1>(s & I::set(2)) | vsll<2>(t & I::set(2));
+}
+
+template<typename F, typename I>
+SIMD_FUNC void fetchTexels(const rdrTexture& texture, I offset, I width, I s, I t, F live, F outColor[4])
+{
+    // Dead lanes can have any value, only fetch the first texel for them
+    if (!texture.packedData)
+    {
+        gatherTexels(texture.data, vselect(live, offset + t * width + s, I::set(0)), outColor);
+        return;
+    }
+
+    I texels = gatherInts((const int*)texture.packedData, vselect(live, offset + getSwizzledIndex(s, t, width), I::set(0)));
+
+    // Convert the 8 bits channels to floats like unpackTexel()
+    I channels[4] = { texels & I::set(0xff), vsrl<8>(texels) & I::set(0xff), vsrl<16>(texels) & I::set(0xff), vsrl<24>(texels) };
+
+    for (int c = 0; c < 4; c++)
+    {
+        if (texture.isSRGB && c < 3)
+            outColor[c] = gatherFloats(getSRGBToLinearTable(), channels[c]);
+        else
+            outColor[c] = toFloat(channels[c]) * F::set(1.f / 255.f);
+    }
+}
+
+template<typename F, typename I>
+SIMD_FUNC void textureFiltering(const rdrTexture& texture, I width, I height, I offset, F u, F v, F live, F outColor[4])
+{
+    F texelS = toFloat(width)  * u - u;
+    F texelT = toFloat(height) * v - v;
+
+    I si = toInt(texelS);
+    I ti = toInt(texelT);
+
+    // Neighbour texels wrap like the UVs
+    I nextS = si + I::set(1);
+    I nextT = ti + I::set(1);
+    nextS = vselect(nextS == width,  I::set(0), nextS);
+    nextT = vselect(nextT == height, I::set(0), nextT);
+
+    I rows[2] = { ti, nextT };
+    I cols[2] = { si, nextS };
+
+    F colors[4][4];
+    for (int k = 0; k < 4; k++)
+        fetchTexels(texture, offset, width, cols[k & 1], rows[k >> 1], live, colors[k]);
+
+    F lambda1 = texelS - toFloat(si);
+    F lambda2 = texelT - toFloat(ti);
+
+    // Interpolate the colors like bilinear()
+    for (int c = 0; c < 4; c++)
+    {
+        F top    = lambda1 * colors[1][c] + (F::set(1.f) - lambda1) * colors[0][c];
+        F bottom = lambda1 * colors[3][c] + (F::set(1.f) - lambda1) * colors[2][c];
+        outColor[c] = lambda2 * bottom + (F::set(1.f) - lambda2) * top;
+    }
+}
+
+template<typename F, typename I>
+SIMD_FUNC void getTextureColor(const Uniform& uniform, const F uv[2], F lod, F live, F outColor[4])
+{
+    const rdrTexture& texture = uniform.texture;
+
+    // If there is no texture return a white color
+    if (!isTextureValid(texture))
+    {
+        for (int c = 0; c < 4; c++)
+            outColor[c] = F::set(1.f);
+        return;
+    }
+
+    // Get correct UVs
+    F u = wrap01(uv[0]);
+    F v = wrap01(uv[1]);
+
+    if (uniform.textureFilter == FilterType::TRILINEAR && texture.mips)
+    {
+        const MipChain& mips = *texture.mips;
+
+        // Get the two levels around the level of detail, each lane can use different levels
+        F levelLod = vmin(vmax(lod, F::set(0.f)), F::set((float)(mips.levelCount - 1)));
+
+        I levels[2];
+        levels[0] = toInt(levelLod);
+        levels[1] = levels[0] + I::set(1);
+        levels[1] = vselect(levels[1] == I::set(mips.levelCount), levels[0], levels[1]);
+
+        F colors[2][4];
+        for (int i = 0; i < 2; i++)
+            textureFiltering(texture, gatherInts(mips.widths, levels[i]), gatherInts(mips.heights, levels[i]), gatherInts(mips.offsets, levels[i]), u, v, live, colors[i]);
+
+        // Interpolate the two levels like lerp()
+        F lambda = levelLod - toFloat(levels[0]);
+        for (int c = 0; c < 4; c++)
+            outColor[c] = lambda * colors[1][c] + (F::set(1.f) - lambda) * colors[0][c];
+    }
+    else if (uniform.textureFilter != FilterType::NEAREST)
+    {
+        textureFiltering(texture, I::set(texture.width), I::set(texture.height), I::set(0), u, v, live, outColor);
+    }
+    else
+    {
+        // Get the nearest texel
+        F s = F::set((float)texture.width)  * u;
+        F t = F::set((float)texture.height) * v;
+
+        fetchTexels(texture, I::set(0), I::set(texture.width), toInt(s), toInt(t), live, outColor);
+    }
+}
+
+template<typename F, typename I>
+SIMD_FUNC void getLightColor(const Uniform& uniform, const F coords[3], const F inNormal[3], F shadedColor[4], F specularColor[4])
+{
+    F ambientColorSum[4] = { F::set(0.f), F::set(0.f), F::set(0.f), F::set(0.f) };
+    F diffuseColorSum[4] = { F::set(0.f), F::set(0.f), F::set(0.f), F::set(0.f) };
+
+    F normal[3] = { inNormal[0], inNormal[1], inNormal[2] };
+    normalize3(normal);
+
+    // The view direction does not depend on the light
+    F viewDir[3];
+    for (int i = 0; i < 3; i++)
+        viewDir[i] = F::set(uniform.cameraPos.e[i]) - coords[i];
+    normalize3(viewDir);
+
+    for (int i = 0; i < (int)(sizeof(uniform.lights) / sizeof(Light)); i++)
+    {
+        if (!uniform.lights[i].isEnable)
+            continue;
+
+        const Light& currLight = uniform.lights[i];
+
+        #pragma region Get light direction and attenuation
+        F lightDir[3];
+        F attenuation;
+        if (currLight.lightPos.w == 0.f)
+        {
+            // A directionnal light has the same direction for every fragment
+            float3 direction = currLight.lightPos.xyz / currLight.lightPos.w;
+            direction /= magnitude(direction);
+            direction *= -1.f;
+
+            for (int j = 0; j < 3; j++)
+                lightDir[j] = F::set(direction.e[j]);
+
+            attenuation = F::set(1.f);
+        }
+        else
+        {
+            for (int j = 0; j < 3; j++)
+                lightDir[j] = F::set(currLight.lightPos.e[j] / currLight.lightPos.w) - F::set(currLight.lightPos.w) * coords[j];
+
+            F distance = vsqrt(lightDir[0] * lightDir[0] + lightDir[1] * lightDir[1] + lightDir[2] * lightDir[2]);
+
+            F safeDistance = safeDivisor(distance);
+            for (int j = 0; j < 3; j++)
+                lightDir[j] = lightDir[j] / safeDistance;
+
+            // Calculate attenuation with c + l * d + q * d²
+            attenuation = F::set(currLight.constantAttenuation) +
+                          F::set(currLight.linearAttenuation) * distance +
+                          F::set(currLight.quadraticAttenuation) * distance * distance;
+        }
+        attenuation = safeDivisor(attenuation);
+        #pragma endregion
+
+        F NdotL = lightDir[0] * normal[0] + lightDir[1] * normal[1] + lightDir[2] * normal[2];
+        F diffuseFactor = vmax(F::set(0.f), NdotL);
+
+        #pragma region Get specular factor
+        F R[3];
+        for (int j = 0; j < 3; j++)
+            R[j] = F::set(2.f) * NdotL * normal[j] - lightDir[j];
+        normalize3(R);
+
+        F RdotV = R[0] * viewDir[0] + R[1] * viewDir[1] + R[2] * viewDir[2];
+        F specularFactor = vpow<F, I>(vmax(F::set(0.f), RdotV), uniform.material.shininess);
+        #pragma endregion
+
+        for (int c = 0; c < 4; c++)
+        {
+            ambientColorSum[c] = ambientColorSum[c] + F::set(currLight.ambient.e[c]) / attenuation;
+            diffuseColorSum[c] = diffuseColorSum[c] + diffuseFactor * F::set(currLight.diffuse.e[c]) / attenuation;
+            specularColor[c]   = specularColor[c] + specularFactor * F::set(currLight.specular.e[c]) / attenuation;
+        }
+    }
+
+    // Get the final color after all lighting application except the specular
+    for (int c = 0; c < 4; c++)
+    {
+        shadedColor[c] = F::set(uniform.material.ambientColor.e[c]) * (F::set(uniform.globalAmbient.e[c]) + ambientColorSum[c]) +
+                         F::set(uniform.material.diffuseColor.e[c]) * diffuseColorSum[c] +
+                         F::set(uniform.material.emissionColor.e[c]);
+
+        specularColor[c] = specularColor[c] * F::set(uniform.material.specularColor.e[c]);
+    }
+}
+
+template<typename F>
+SIMD_FUNC F interpolateLanes(const Varying varyings[3], const F weights[3], int offset)
+{
+    // Interpolate one float of the varyings
+    const float* v0 = (const float*)&varyings[0];
+    const float* v1 = (const float*)&varyings[1];
+    const float* v2 = (const float*)&varyings[2];
+
+    return F::set(v0[offset]) * weights[0] + F::set(v1[offset]) * weights[1] + F::set(v2[offset]) * weights[2];
+}
+
+template<typename F, typename I>
+SIMD_FUNC void shadeLanes(const FragmentBatch& batch, int first, const Varying varyings[3], const Uniform& uniform, float4 outColors[MAX_BATCH_LANES])
+{
+    constexpr int width = F::width;
+
+    F weights[3] = { F::load(&batch.w0[first]), F::load(&batch.w1[first]), F::load(&batch.w2[first]) };
+    F live = laneMask<F>((batch.liveMask >> first) & ((1u << width) - 1u));
+
+    // Interpolate the varying attributes used by the fragment shader
+    const int colorOffset = offsetof(Varying, color) / sizeof(float);
+    const int uvOffset    = offsetof(Varying, uv) / sizeof(float);
+
+    F color[4], uv[2], texColor[4];
+    for (int c = 0; c < 4; c++)
+        color[c] = interpolateLanes(varyings, weights, colorOffset + c);
+    for (int c = 0; c < 2; c++)
+        uv[c] = interpolateLanes(varyings, weights, uvOffset + c);
+
+    getTextureColor<F, I>(uniform, uv, F::load(&batch.lod[first]), live, texColor);
+
+    F result[4];
+
+    // If there is no lighting, return the color with no more modification
+    if (!uniform.lighting)
+    {
+        for (int c = 0; c < 4; c++)
+            result[c] = texColor[c] * color[c];
+    }
+    else
+    {
+        const int shadedOffset   = offsetof(Varying, shadedColor) / sizeof(float);
+        const int specularOffset = offsetof(Varying, specularColor) / sizeof(float);
+
+        F shadedColor[4], specularColor[4];
+        for (int c = 0; c < 4; c++)
+        {
+            shadedColor[c]   = interpolateLanes(varyings, weights, shadedOffset + c);
+            specularColor[c] = interpolateLanes(varyings, weights, specularOffset + c);
+        }
+
+        // If the phong model is used, compute the shaded color and the specular for each pixel
+        if (uniform.phongModel)
+        {
+            const int coordsOffset = offsetof(Varying, coords) / sizeof(float);
+            const int normalOffset = offsetof(Varying, normal) / sizeof(float);
+
+            F coords[3], normal[3];
+            for (int c = 0; c < 3; c++)
+            {
+                coords[c] = interpolateLanes(varyings, weights, coordsOffset + c);
+                normal[c] = interpolateLanes(varyings, weights, normalOffset + c);
+            }
+
+            getLightColor<F, I>(uniform, coords, normal, shadedColor, specularColor);
+        }
+
+        for (int c = 0; c < 4; c++)
+            result[c] = texColor[c] * color[c] * shadedColor[c] + specularColor[c];
+    }
+
+    // Transpose the result to one color per lane
+    alignas(32) float channels[4][width];
+    for (int c = 0; c < 4; c++)
+        store(channels[c], result[c]);
+
+    for (int l = 0; l < width; l++)
+        outColors[first + l] = { channels[0][l], channels[1][l], channels[2][l], channels[3][l] };
+}
+
+template<typename F, typename I>
+SIMD_FUNC unsigned int shadeBatch(const FragmentBatch& batch, const Varying varyings[3], const Uniform& uniform, float4 outColors[MAX_BATCH_LANES])
+{
+    for (int first = 0; first < batch.count; first += F::width)
+        shadeLanes<F, I>(batch, first, varyings, uniform, outColors);
+
+    // Without the pixel effect, the fragment shader never discards a fragment
+    return batch.liveMask;
+}
+
+template<typename F>
+SIMD_FUNC void transformLanes(const mat4x4& m, const F v[4], F out[4])
+{
+    // Same sum order as mat4x4 * float4
+    for (int i = 0; i < 4; i++)
+        out[i] = F::set(m.c[i].e[0]) * v[0] + F::set(m.c[i].e[1]) * v[1] + F::set(m.c[i].e[2]) * v[2] + F::set(m.c[i].e[3]) * v[3];
+}
+
+// Vertex stage: same math as vertexShader(), one lane per vertex
+template<typename F, typename I>
+SIMD_FUNC void transformVertexLanes(const rdrVertex* vertices, int laneCount, const Uniform& uniform, TransformedVertex* out)
+{
+    constexpr int width = F::width;
+    constexpr int attributeCount = sizeof(rdrVertex) / sizeof(float);
+
+    #pragma region Load the vertices as SoA
+    // One register per vertex attribute, the missing lanes repeat the last vertex
+    alignas(32) float attributes[attributeCount][width];
+    for (int l = 0; l < width; l++)
+    {
+        const rdrVertex& vertex = vertices[l < laneCount ? l : laneCount - 1];
+        const float* values = (const float*)&vertex;
+
+        for (int a = 0; a < attributeCount; a++)
+            attributes[a][l] = values[a];
+
+        // The vertex effect moves the vertices before their transform
+        if (uniform.vertexEffect)
+            attributes[1][l] = vertex.y + sin(uniform.time + vertex.x - vertex.z) * 0.5f;
+    }
+
+    F position[4] = { F::load(attributes[0]), F::load(attributes[1]), F::load(attributes[2]), F::set(1.f) };
+    F normal[4]   = { F::load(attributes[3]), F::load(attributes[4]), F::load(attributes[5]), F::set(0.f) };
+    #pragma endregion
+
+    #pragma region Vertex shader
+    // Get the world coords and world normals like vertexShader()
+    F localCoords[4], worldNormal[4], clipCoords[4];
+    transformLanes(uniform.model, position, localCoords);
+    transformLanes(uniform.model, normal, worldNormal);
+    transformLanes(uniform.viewProj, localCoords, clipCoords);
+
+    F coords[3];
+    for (int i = 0; i < 3; i++)
+        coords[i] = localCoords[i] / localCoords[3];
+
+    // Get the vertex color multiplied with the global color
+    F color[4];
+    for (int c = 0; c < 4; c++)
+        color[c] = F::load(attributes[6 + c]) * F::set(uniform.globalColor.e[c]);
+
+    // With the Gouraud model, the lighting of all the lanes is computed at once
+    F shadedColor[4], specularColor[4];
+    for (int c = 0; c < 4; c++)
+    {
+        shadedColor[c]   = F::set(0.f);
+        specularColor[c] = F::set(0.f);
+    }
+
+    if (!uniform.phongModel && uniform.lighting)
+        getLightColor<F, I>(uniform, coords, worldNormal, shadedColor, specularColor);
+    #pragma endregion
+
+    #pragma region Store the transformed vertices as AoS
+    alignas(32) float outClip[4][width], outCoords[3][width], outNormal[3][width];
+    alignas(32) float outColor[4][width], outShaded[4][width], outSpecular[4][width];
+
+    for (int i = 0; i < 4; i++)
+    {
+        store(outClip[i],     clipCoords[i]);
+        store(outColor[i],    color[i]);
+        store(outShaded[i],   shadedColor[i]);
+        store(outSpecular[i], specularColor[i]);
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        store(outCoords[i], coords[i]);
+        store(outNormal[i], worldNormal[i]);
+    }
+
+    for (int l = 0; l < laneCount; l++)
+    {
+        TransformedVertex& vertex = out[l];
+        vertex.clipCoords            = { outClip[0][l],     outClip[1][l],     outClip[2][l],     outClip[3][l] };
+        vertex.varying.coords        = { outCoords[0][l],   outCoords[1][l],   outCoords[2][l] };
+        vertex.varying.normal        = { outNormal[0][l],   outNormal[1][l],   outNormal[2][l] };
+        vertex.varying.color         = { outColor[0][l],    outColor[1][l],    outColor[2][l],    outColor[3][l] };
+        vertex.varying.uv            = { attributes[10][l], attributes[11][l] };
+        vertex.varying.shadedColor   = { outShaded[0][l],   outShaded[1][l],   outShaded[2][l],   outShaded[3][l] };
+        vertex.varying.specularColor = { outSpecular[0][l], outSpecular[1][l], outSpecular[2][l], outSpecular[3][l] };
+    }
+    #pragma endregion
+}
+
+template<typename F, typename I>
+SIMD_FUNC void transformVertices(const rdrVertex* vertices, int count, const Uniform& uniform, TransformedVertex* out)
+{
+    for (int first = 0; first < count; first += F::width)
+        transformVertexLanes<F, I>(&vertices[first], count - first < F::width ? count - first : F::width, uniform, &out[first]);
+}
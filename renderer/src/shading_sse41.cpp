@@ -0,0 +1,124 @@
+#include <cstddef>
+
+#include <immintrin.h>
+
+#include <common/maths.hpp>
+
+#include "shading.hpp"
+
+// 4-wide shading path (one 2x2 quad per call), only called if the CPU supports SSE4.1
+#if defined(__GNUC__)
+#define SIMD_FUNC __attribute__((target("sse4.1")))
+#else
+#define SIMD_FUNC
+#endif
+
+namespace
+{
+    struct i32x4
+    {
+        __m128i v;
+
+        static SIMD_FUNC i32x4 set(int value) { return { _mm_set1_epi32(value) }; }
+    };
+
+    struct f32x4
+    {
+        static constexpr int width = 4;
+
+        __m128 v;
+
+        static SIMD_FUNC f32x4 set(float value)         { return { _mm_set1_ps(value) }; }
+        static SIMD_FUNC f32x4 load(const float* values) { return { _mm_loadu_ps(values) }; }
+    };
+
+    SIMD_FUNC f32x4 operator+(f32x4 a, f32x4 b) { return { _mm_add_ps(a.v, b.v) }; }
+    SIMD_FUNC f32x4 operator-(f32x4 a, f32x4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+    SIMD_FUNC f32x4 operator*(f32x4 a, f32x4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+    SIMD_FUNC f32x4 operator/(f32x4 a, f32x4 b) { return { _mm_div_ps(a.v, b.v) }; }
+    SIMD_FUNC f32x4 operator&(f32x4 a, f32x4 b) { return { _mm_and_ps(a.v, b.v) }; }
+
+    SIMD_FUNC f32x4 operator< (f32x4 a, f32x4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+    SIMD_FUNC f32x4 operator> (f32x4 a, f32x4 b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+    SIMD_FUNC f32x4 operator==(f32x4 a, f32x4 b) { return { _mm_cmpeq_ps(a.v, b.v) }; }
+
+    SIMD_FUNC i32x4 operator+ (i32x4 a, i32x4 b) { return { _mm_add_epi32(a.v, b.v) }; }
+    SIMD_FUNC i32x4 operator- (i32x4 a, i32x4 b) { return { _mm_sub_epi32(a.v, b.v) }; }
+    SIMD_FUNC i32x4 operator* (i32x4 a, i32x4 b) { return { _mm_mullo_epi32(a.v, b.v) }; }
+    SIMD_FUNC i32x4 operator& (i32x4 a, i32x4 b) { return { _mm_and_si128(a.v, b.v) }; }
+    SIMD_FUNC i32x4 operator| (i32x4 a, i32x4 b) { return { _mm_or_si128(a.v, b.v) }; }
+    SIMD_FUNC i32x4 operator==(i32x4 a, i32x4 b) { return { _mm_cmpeq_epi32(a.v, b.v) }; }
+
+    SIMD_FUNC f32x4 vmin(f32x4 a, f32x4 b) { return { _mm_min_ps(a.v, b.v) }; }
+    SIMD_FUNC f32x4 vmax(f32x4 a, f32x4 b) { return { _mm_max_ps(a.v, b.v) }; }
+    SIMD_FUNC f32x4 vsqrt(f32x4 a)         { return { _mm_sqrt_ps(a.v) }; }
+    SIMD_FUNC f32x4 vfloor(f32x4 a)        { return { _mm_floor_ps(a.v) }; }
+
+    SIMD_FUNC f32x4 vselect(f32x4 mask, f32x4 a, f32x4 b) { return { _mm_blendv_ps(b.v, a.v, mask.v) }; }
+    SIMD_FUNC i32x4 vselect(f32x4 mask, i32x4 a, i32x4 b) { return { _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(b.v), _mm_castsi128_ps(a.v), mask.v)) }; }
+    SIMD_FUNC i32x4 vselect(i32x4 mask, i32x4 a, i32x4 b) { return { _mm_blendv_epi8(b.v, a.v, mask.v) }; }
+
+    SIMD_FUNC i32x4 asInt(f32x4 a)   { return { _mm_castps_si128(a.v) }; }
+    SIMD_FUNC f32x4 asFloat(i32x4 a) { return { _mm_castsi128_ps(a.v) }; }
+    SIMD_FUNC i32x4 toInt(f32x4 a)   { return { _mm_cvttps_epi32(a.v) }; }
+    SIMD_FUNC f32x4 toFloat(i32x4 a) { return { _mm_cvtepi32_ps(a.v) }; }
+
+    template<int shift> SIMD_FUNC i32x4 vsll(i32x4 a) { return { _mm_slli_epi32(a.v, shift) }; }
+    template<int shift> SIMD_FUNC i32x4 vsrl(i32x4 a) { return { _mm_srli_epi32(a.v, shift) }; }
+
+    SIMD_FUNC void store(float* values, f32x4 a) { _mm_storeu_ps(values, a.v); }
+
+    template<typename F>
+    SIMD_FUNC F laneMask(unsigned int bits)
+    {
+        const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+        __m128i mask = _mm_and_si128(_mm_set1_epi32((int)bits), laneBits);
+        return { _mm_castsi128_ps(_mm_cmpeq_epi32(mask, laneBits)) };
+    }
+
+    SIMD_FUNC void gatherTexels(const float4* data, i32x4 index, f32x4 outColor[4])
+    {
+        // Load each texel and transpose them to one register per channel
+        alignas(16) int indices[4];
+        _mm_store_si128((__m128i*)indices, index.v);
+
+        __m128 t0 = _mm_loadu_ps(data[indices[0]].e);
+        __m128 t1 = _mm_loadu_ps(data[indices[1]].e);
+        __m128 t2 = _mm_loadu_ps(data[indices[2]].e);
+        __m128 t3 = _mm_loadu_ps(data[indices[3]].e);
+        _MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+
+        outColor[0] = { t0 };
+        outColor[1] = { t1 };
+        outColor[2] = { t2 };
+        outColor[3] = { t3 };
+    }
+
+    SIMD_FUNC i32x4 gatherInts(const int* table, i32x4 index)
+    {
+        alignas(16) int indices[4];
+        _mm_store_si128((__m128i*)indices, index.v);
+
+        return { _mm_setr_epi32(table[indices[0]], table[indices[1]], table[indices[2]], table[indices[3]]) };
+    }
+
+    SIMD_FUNC f32x4 gatherFloats(const float* table, i32x4 index)
+    {
+        alignas(16) int indices[4];
+        _mm_store_si128((__m128i*)indices, index.v);
+
+        return { _mm_setr_ps(table[indices[0]], table[indices[1]], table[indices[2]], table[indices[3]]) };
+    }
+
+    #include "shading_simd.hpp"
+}
+
+SIMD_FUNC unsigned int shadeBatchSSE41(const FragmentBatch& batch, const Varying varyings[3], const Uniform& uniform, float4 outColors[MAX_BATCH_LANES])
+{
+    return shadeBatch<f32x4, i32x4>(batch, varyings, uniform, outColors);
+}
+
+SIMD_FUNC void transformVerticesSSE41(const rdrVertex* vertices, int count, const Uniform& uniform, TransformedVertex* out)
+{
+    transformVertices<f32x4, i32x4>(vertices, count, uniform, out);
+}
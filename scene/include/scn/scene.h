@@ -1,10 +1,14 @@
 #pragma once
 
+#if defined(_WIN32)
 #ifdef SCN_EXPORTS
 #define SCN_API __declspec(dllexport)
 #else
 #define SCN_API __declspec(dllimport)
 #endif
+#else
+#define SCN_API __attribute__((visibility("default")))
+#endif
 
 #ifdef __cplusplus
 extern "C"
@@ -18,12 +22,25 @@ typedef struct rdrImpl rdrImpl;
 SCN_API scnImpl* scnCreate(void);
 SCN_API void scnDestroy(scnImpl* scene);
 
+// The assets are loaded in the background and added by the updates (placeholders are drawn meanwhile)
+// Wait until all of them are added, for the tools that need the complete scene from the first frame
+SCN_API void scnWaitForAssets(scnImpl* scene);
+
+// Count of the .obj files and the textures that could not be loaded (once their loads are done), the scene is drawn without them
+SCN_API int scnGetFailedLoadCount(scnImpl* scene);
+
 // Set camera position
 SCN_API void scnSetCameraPosition(scnImpl* scene, float* cameraPosition);
 
+// Set camera matrices (same layout as rdrSetProjection/rdrSetView), the objects outside the view are not drawn
+SCN_API void scnSetCameraMatrices(scnImpl* scene, float* projection, float* view);
+
 // Update scene and renders it
 SCN_API void scnUpdate(scnImpl* scene, float deltaTime, rdrImpl* renderer);
 
+// Index of the nearest object hit by the world space ray (-1 if none), it is selected in the ImGui controls
+SCN_API int scnPickObject(scnImpl* scene, float* rayOrigin, float* rayDirection);
+
 struct ImGuiContext;
 SCN_API void scnSetImGuiContext(scnImpl* scene, struct ImGuiContext* context);
 SCN_API void scnShowImGuiControls(scnImpl* scene);
@@ -0,0 +1,133 @@
+#include "bounds.hpp"
+
+void AABB::add(const float3& point)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        min.e[i] = ::min(min.e[i], point.e[i]);
+        max.e[i] = ::max(max.e[i], point.e[i]);
+    }
+}
+
+void AABB::add(const AABB& box)
+{
+    if (box.isEmpty())
+        return;
+
+    add(box.min);
+    add(box.max);
+}
+
+AABB AABB::transform(const mat4x4& model) const
+{
+    if (isEmpty())
+        return *this;
+
+    // Arvo's method: the extents of the new box are the extents projected on the absolute values of the matrix
+    float3 center  = getCenter();
+    float3 extents = getExtents();
+
+    AABB result;
+    for (int i = 0; i < 3; i++)
+    {
+        const float4& row = model.c[i];
+
+        float newCenter  = row.e[0] * center.x + row.e[1] * center.y + row.e[2] * center.z + row.e[3];
+        float newExtents = fabsf(row.e[0]) * extents.x + fabsf(row.e[1]) * extents.y + fabsf(row.e[2]) * extents.z;
+
+        result.min.e[i] = newCenter - newExtents;
+        result.max.e[i] = newCenter + newExtents;
+    }
+
+    return result;
+}
+
+BoundingSphere BoundingSphere::transform(const mat4x4& model) const
+{
+    if (radius < 0.f)
+        return *this;
+
+    // Length of the transformed axes
+    float scale = 0.f;
+    for (int j = 0; j < 3; j++)
+    {
+        float3 axis = { model.c[0].e[j], model.c[1].e[j], model.c[2].e[j] };
+        scale = ::max(scale, sqMagnitude(axis));
+    }
+
+    BoundingSphere result;
+    result.center = (model * float4(center, 1.f)).xyz;
+    result.radius = radius * sqrtf(scale);
+
+    return result;
+}
+
+Frustum::Frustum(const mat4x4& viewProjection)
+{
+    // The clip coordinates are inside if -w <= x, y, z <= w, so each plane is the last row plus or minus another one
+    const float4* rows = viewProjection.c;
+
+    planes[0] = rows[3] + rows[0];  // Left
+    planes[1] = rows[3] - rows[0];  // Right
+    planes[2] = rows[3] + rows[1];  // Bottom
+    planes[3] = rows[3] - rows[1];  // Top
+    planes[4] = rows[3] + rows[2];  // Near
+    planes[5] = rows[3] - rows[2];  // Far
+
+    // Normalize them to compare the distances with the radius of the spheres
+    for (float4& plane : planes)
+    {
+        float length = magnitude(plane.xyz);
+        if (length > 0.f)
+            plane = plane / length;
+    }
+}
+
+bool Frustum::isOutside(const BoundingSphere& sphere) const
+{
+    if (sphere.radius < 0.f)
+        return true;
+
+    for (const float4& plane : planes)
+    {
+        if (dot(plane.xyz, sphere.center) + plane.w < -sphere.radius)
+            return true;
+    }
+
+    return false;
+}
+
+bool Frustum::isOutside(const AABB& box) const
+{
+    if (box.isEmpty())
+        return true;
+
+    for (const float4& plane : planes)
+    {
+        // Test the corner of the box the most inside the plane
+        float3 corner = { plane.x >= 0.f ? box.max.x : box.min.x,
+                          plane.y >= 0.f ? box.max.y : box.min.y,
+                          plane.z >= 0.f ? box.max.z : box.min.z };
+
+        if (dot(plane.xyz, corner) + plane.w < 0.f)
+            return true;
+    }
+
+    return false;
+}
+
+bool Frustum::contains(const AABB& box) const
+{
+    for (const float4& plane : planes)
+    {
+        // Test the corner of the box the most outside the plane
+        float3 corner = { plane.x >= 0.f ? box.min.x : box.max.x,
+                          plane.y >= 0.f ? box.min.y : box.max.y,
+                          plane.z >= 0.f ? box.min.z : box.max.z };
+
+        if (dot(plane.xyz, corner) + plane.w < 0.f)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <common/maths.hpp>
+
+// Axis aligned bounding box, empty while min > max
+struct AABB
+{
+    float3 min = {  INFINITY,  INFINITY,  INFINITY };
+    float3 max = { -INFINITY, -INFINITY, -INFINITY };
+
+    bool isEmpty() const { return min.x > max.x; }
+
+    float3 getCenter()  const { return (min + max) * 0.5f; }
+    float3 getExtents() const { return (max - min) * 0.5f; }
+
+    void add(const float3& point);
+    void add(const AABB& box);
+
+    // Box around the transformed corners of this box
+    AABB transform(const mat4x4& model) const;
+};
+
+struct BoundingSphere
+{
+    float3 center = { 0.f, 0.f, 0.f };
+    float  radius = -1.f;   // Negative for an empty sphere
+
+    // Sphere around the transformed sphere (the radius is scaled by the greatest scale of the matrix)
+    BoundingSphere transform(const mat4x4& model) const;
+};
+
+// Planes of the view volume, extracted from the view-projection matrix (Gribb & Hartmann)
+// The normals point inside, so a point is inside when dot(plane.xyz, point) + plane.w >= 0 for the 6 planes
+struct Frustum
+{
+    float4 planes[6];
+
+    Frustum() = default;
+    Frustum(const mat4x4& viewProjection);
+
+    // Conservative tests, in world space: a volume crossing a corner of the frustum can be kept
+    bool isOutside(const BoundingSphere& sphere) const;
+    bool isOutside(const AABB& box) const;
+
+    // True if the box is inside all the planes
+    bool contains(const AABB& box) const;
+};
@@ -0,0 +1,149 @@
+#include <algorithm>
+
+#include <rdr/renderer.h>
+
+#include "bvh.hpp"
+
+// Nodes fully inside the frustum are pushed with this flag, their descendants are not tested against the planes again
+#define INSIDE_FRUSTUM_FLAG (1 << 30)
+
+static float3 getCenter(const AABB& box)
+{
+    return box.isEmpty() ? float3(0.f, 0.f, 0.f) : box.getCenter();
+}
+
+void ObjectBVH::build(const std::vector<AABB>& objectBounds)
+{
+    nodes.clear();
+    leaves.assign(objectBounds.size(), -1);
+
+    if (objectBounds.empty())
+        return;
+
+    // A binary tree with a leaf by object has 2n - 1 nodes
+    nodes.reserve(objectBounds.size() * 2 - 1);
+
+    buildIndices.resize(objectBounds.size());
+    for (int i = 0; i < (int)buildIndices.size(); i++)
+        buildIndices[i] = i;
+
+    buildNode(buildIndices, 0, (int)buildIndices.size(), objectBounds, -1);
+}
+
+int ObjectBVH::buildNode(std::vector<int>& objectIndices, int first, int last, const std::vector<AABB>& objectBounds, int parent)
+{
+    int nodeIndex = (int)nodes.size();
+    nodes.push_back(BVHNode());
+    nodes[nodeIndex].parent = parent;
+
+    if (last - first == 1)
+    {
+        int objectIndex = objectIndices[first];
+        nodes[nodeIndex].bounds = objectBounds[objectIndex];
+        nodes[nodeIndex].objectIndex = objectIndex;
+        leaves[objectIndex] = nodeIndex;
+        return nodeIndex;
+    }
+
+    // Split at the median of the centers on the axis where they are the most spread
+    AABB centerBounds;
+    for (int i = first; i < last; i++)
+        centerBounds.add(getCenter(objectBounds[objectIndices[i]]));
+
+    float3 size = centerBounds.max - centerBounds.min;
+    int axis = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+
+    int middle = (first + last) / 2;
+    std::nth_element(objectIndices.begin() + first, objectIndices.begin() + middle, objectIndices.begin() + last,
+        [&objectBounds, axis](int a, int b)
+    {
+        return getCenter(objectBounds[a]).e[axis] < getCenter(objectBounds[b]).e[axis];
+    });
+
+    // The vector of nodes grows during the recursion, so the node is only accessed by index
+    int child0 = buildNode(objectIndices, first, middle, objectBounds, nodeIndex);
+    int child1 = buildNode(objectIndices, middle, last, objectBounds, nodeIndex);
+
+    BVHNode& node = nodes[nodeIndex];
+    node.children[0] = child0;
+    node.children[1] = child1;
+    node.bounds = nodes[child0].bounds;
+    node.bounds.add(nodes[child1].bounds);
+
+    return nodeIndex;
+}
+
+void ObjectBVH::refit(int objectIndex, const AABB& objectBounds)
+{
+    int nodeIndex = leaves[objectIndex];
+    nodes[nodeIndex].bounds = objectBounds;
+
+    // The bounds of the ancestors are merged again, so they can also shrink
+    for (nodeIndex = nodes[nodeIndex].parent; nodeIndex >= 0; nodeIndex = nodes[nodeIndex].parent)
+    {
+        BVHNode& node = nodes[nodeIndex];
+        node.bounds = nodes[node.children[0]].bounds;
+        node.bounds.add(nodes[node.children[1]].bounds);
+    }
+}
+
+void ObjectBVH::queryVisible(const Frustum& frustum, rdrImpl* occlusionRenderer, std::vector<int>& visibleObjects) const
+{
+    if (nodes.empty())
+        return;
+
+    stack.clear();
+    stack.push_back(0);
+
+    while (!stack.empty())
+    {
+        int nodeIndex = stack.back() & ~INSIDE_FRUSTUM_FLAG;
+        bool isInside = (stack.back() & INSIDE_FRUSTUM_FLAG) != 0;
+        stack.pop_back();
+
+        const BVHNode& node = nodes[nodeIndex];
+        if (node.bounds.isEmpty())
+            continue;
+
+        if (!isInside)
+        {
+            if (frustum.isOutside(node.bounds))
+                continue;
+
+            isInside = frustum.contains(node.bounds);
+        }
+
+        if (occlusionRenderer && rdrIsBoxOccluded(occlusionRenderer, node.bounds.min.e, node.bounds.max.e))
+            continue;
+
+        if (node.isLeaf())
+        {
+            visibleObjects.push_back(node.objectIndex);
+            continue;
+        }
+
+        int flag = isInside ? INSIDE_FRUSTUM_FLAG : 0;
+        stack.push_back(node.children[1] | flag);
+        stack.push_back(node.children[0] | flag);
+    }
+}
+
+float ObjectBVH::intersectRay(const AABB& box, const float3& origin, const float3& invDirection, float maxDistance)
+{
+    if (box.isEmpty())
+        return -1.f;
+
+    float tMin = 0.f;
+    float tMax = maxDistance;
+
+    for (int i = 0; i < 3; i++)
+    {
+        float t0 = (box.min.e[i] - origin.e[i]) * invDirection.e[i];
+        float t1 = (box.max.e[i] - origin.e[i]) * invDirection.e[i];
+
+        tMin = max(tMin, min(t0, t1));
+        tMax = min(tMax, max(t0, t1));
+    }
+
+    return tMin <= tMax ? tMin : -1.f;
+}
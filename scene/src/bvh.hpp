@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+
+#include "bounds.hpp"
+
+typedef struct rdrImpl rdrImpl;
+
+struct BVHNode
+{
+    AABB bounds;
+    int parent = -1;
+    int children[2] = { -1, -1 };
+    int objectIndex = -1;           // Only set on the leaves
+
+    bool isLeaf() const { return objectIndex >= 0; }
+};
+
+// Bounding volume hierarchy over the world bounds of the objects, one object by leaf
+// It is built once, then refitted when objects move: only the nodes above the moved leaves are updated
+struct ObjectBVH
+{
+    std::vector<BVHNode> nodes;     // The root is the first node
+    std::vector<int> leaves;        // Leaf node of each object
+
+    // Top-down build, the nodes are split at the median of the longest axis of their centers
+    void build(const std::vector<AABB>& objectBounds);
+
+    // Set the new bounds of the object and grow or shrink its ancestors
+    void refit(int objectIndex, const AABB& objectBounds);
+
+    // Add the objects not outside the frustum to visibleObjects
+    // With a renderer, the subtrees hidden behind its depth buffer are skipped (see rdrIsBoxOccluded)
+    void queryVisible(const Frustum& frustum, rdrImpl* occlusionRenderer, std::vector<int>& visibleObjects) const;
+
+    // Index of the nearest object hit by the ray, -1 if none
+    // hitObject(objectIndex, maxDistance) returns the distance of the hit on the object, or a negative value if it is missed
+    template<typename HitFunction>
+    int raycast(const float3& origin, const float3& direction, HitFunction hitObject, float* hitDistance = nullptr) const;
+
+    private:
+        int  buildNode(std::vector<int>& objectIndices, int first, int last, const std::vector<AABB>& objectBounds, int parent);
+
+        // Distance of the entry of the ray in the box (slab test), negative if it is missed
+        static float intersectRay(const AABB& box, const float3& origin, const float3& invDirection, float maxDistance);
+
+        std::vector<int> buildIndices;   // Objects sorted by the build, kept for the next one
+        mutable std::vector<int> stack;  // Traversal stack, kept between the queries
+};
+
+template<typename HitFunction>
+int ObjectBVH::raycast(const float3& origin, const float3& direction, HitFunction hitObject, float* hitDistance) const
+{
+    int nearestObject = -1;
+    float nearestDistance = INFINITY;
+
+    if (nodes.empty())
+        return -1;
+
+    float3 invDirection = { 1.f / direction.x, 1.f / direction.y, 1.f / direction.z };
+
+    stack.clear();
+    stack.push_back(0);
+
+    while (!stack.empty())
+    {
+        const BVHNode& node = nodes[stack.back()];
+        stack.pop_back();
+
+        // Skip the nodes behind the nearest hit
+        if (intersectRay(node.bounds, origin, invDirection, nearestDistance) < 0.f)
+            continue;
+
+        if (node.isLeaf())
+        {
+            float distance = hitObject(node.objectIndex, nearestDistance);
+            if (distance >= 0.f && distance < nearestDistance)
+            {
+                nearestDistance = distance;
+                nearestObject = node.objectIndex;
+            }
+            continue;
+        }
+
+        // Visit the nearest child first, so it can prune the farthest one
+        float distance0 = intersectRay(nodes[node.children[0]].bounds, origin, invDirection, nearestDistance);
+        float distance1 = intersectRay(nodes[node.children[1]].bounds, origin, invDirection, nearestDistance);
+        bool isFirstNearest = distance1 < 0.f || (distance0 >= 0.f && distance0 <= distance1);
+
+        if ((isFirstNearest ? distance1 : distance0) >= 0.f)
+            stack.push_back(node.children[isFirstNearest ? 1 : 0]);
+        if ((isFirstNearest ? distance0 : distance1) >= 0.f)
+            stack.push_back(node.children[isFirstNearest ? 0 : 1]);
+    }
+
+    if (hitDistance)
+        *hitDistance = nearestDistance;
+
+    return nearestObject;
+}
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <cstring>
+
+#include "draw_queue.hpp"
+
+// The bits of a positive float are ordered like the float, the upper ones (exponent and 3 bits of mantissa) give 8 buckets by octave
+#define DISTANCE_BUCKET_SHIFT 20
+#define STATE_INDEX_MASK 0x3ff
+
+static uint32_t getDistanceBits(float distance)
+{
+    // Also maps the NaN to 0
+    distance = distance > 0.f ? distance : 0.f;
+
+    uint32_t bits;
+    memcpy(&bits, &distance, sizeof(bits));
+    return bits;
+}
+
+void DrawQueue::clear()
+{
+    opaque.clear();
+    transparent.clear();
+    instances.clear();
+    opaqueInstances.clear();
+}
+
+void DrawQueue::clearOpaque()
+{
+    // The transparent commands still point in the instances
+    opaque.clear();
+    opaqueInstances.clear();
+}
+
+void DrawQueue::addOpaque(int objectIndex, int meshIndex, int textureIndex, int materialIndex, float distance)
+{
+    // The command is created once the instances of the mesh are grouped
+    opaqueInstances.push_back({ { 0, meshIndex, textureIndex, materialIndex, 0, 1 }, { objectIndex, distance } });
+}
+
+void DrawQueue::addTransparent(int objectIndex, int meshIndex, int textureIndex, int materialIndex, float distance)
+{
+    // The farthest first, whatever their state
+    uint64_t sortKey = ~getDistanceBits(distance);
+
+    transparent.push_back({ sortKey, meshIndex, textureIndex, materialIndex, (int)instances.size(), 1 });
+    instances.push_back({ objectIndex, distance });
+}
+
+void DrawQueue::sort()
+{
+    // The instances of a mesh are contiguous, from the nearest
+    std::sort(opaqueInstances.begin(), opaqueInstances.end(), [](const OpaqueInstance& a, const OpaqueInstance& b)
+    {
+        if (a.command.meshIndex != b.command.meshIndex)
+            return a.command.meshIndex < b.command.meshIndex;
+        return a.instance.distance < b.instance.distance;
+    });
+
+    for (size_t first = 0, last; first < opaqueInstances.size(); first = last)
+    {
+        DrawCommand command = opaqueInstances[first].command;
+        command.firstInstance = (int)instances.size();
+
+        for (last = first; last < opaqueInstances.size() && opaqueInstances[last].command.meshIndex == command.meshIndex; last++)
+            instances.push_back(opaqueInstances[last].instance);
+
+        command.instanceCount = (int)(last - first);
+
+        // Distance bucket (12 bits) | texture (10 bits) | material (10 bits) | exact distance (32 bits)
+        uint32_t distanceBits = getDistanceBits(instances[command.firstInstance].distance);
+        command.sortKey = (uint64_t)(distanceBits >> DISTANCE_BUCKET_SHIFT) << 52
+                        | (uint64_t)((command.textureIndex + 1) & STATE_INDEX_MASK) << 42
+                        | (uint64_t)(command.materialIndex & STATE_INDEX_MASK) << 32
+                        | distanceBits;
+
+        opaque.push_back(command);
+    }
+
+    auto compare = [](const DrawCommand& a, const DrawCommand& b) { return a.sortKey < b.sortKey; };
+
+    std::sort(opaque.begin(), opaque.end(), compare);
+    std::sort(transparent.begin(), transparent.end(), compare);
+}
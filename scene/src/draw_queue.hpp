@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Object drawn by a command
+struct DrawInstance
+{
+    int   objectIndex;
+    float distance;
+};
+
+// Mesh to draw in the frame, once for each of its instances
+struct DrawCommand
+{
+    uint64_t sortKey;   // Commands are drawn by increasing key
+    int meshIndex;
+    int textureIndex;
+    int materialIndex;
+    int firstInstance;  // In the instances of the queue
+    int instanceCount;
+};
+
+// Meshes to draw in the frame, in two passes:
+// - The opaque meshes from the nearest to the farthest, so the depth test kills the hidden fragments before they are shaded
+//   The distances are bucketed, so inside a bucket the meshes with the same texture and material are drawn together
+//   The objects sharing a mesh are drawn by the same command, at the place of the nearest one
+// - Then the transparent meshes from the farthest to the nearest, so they are blended over what is behind them (one command by object)
+struct DrawQueue
+{
+    // The lists keep their memory between the frames
+    std::vector<DrawCommand> opaque;
+    std::vector<DrawCommand> transparent;
+    std::vector<DrawInstance> instances;
+
+    void clear();
+
+    // Remove the opaque meshes once they are drawn, the transparent ones are kept for the end of the frame
+    void clearOpaque();
+
+    // distance is the distance of the mesh to the camera (the nearest point of its bounds for the opaque ones, its center for the transparent ones)
+    void addOpaque(int objectIndex, int meshIndex, int textureIndex, int materialIndex, float distance);
+    void addTransparent(int objectIndex, int meshIndex, int textureIndex, int materialIndex, float distance);
+
+    // Group the opaque instances by mesh, then sort the commands
+    void sort();
+
+    private:
+        struct OpaqueInstance
+        {
+            DrawCommand  command;
+            DrawInstance instance;
+        };
+
+        std::vector<OpaqueInstance> opaqueInstances;
+};
@@ -0,0 +1,392 @@
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#include "mesh_cache.hpp"
+
+#pragma region File layout
+// Header, then the tables (each one aligned on 16 bytes), then the vertices and the indices of each mesh
+struct MeshCacheHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t vertexSize;
+    float    scale;
+    uint32_t dependencyCount;
+    uint32_t textureCount;
+    uint32_t materialCount;
+    uint32_t meshCount;
+};
+
+// Source file of the cache (the .obj and its .mtl files)
+struct MeshCacheDependency
+{
+    char     filePath[256];
+    int64_t  modificationTime;
+    uint64_t size;
+    uint64_t hash;
+};
+
+struct MeshCacheTexture
+{
+    char filePath[256];
+};
+
+struct MeshCacheMesh
+{
+    int32_t  textureIndex;
+    int32_t  materialIndex;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint64_t vertexOffset;  // From the start of the file
+    uint64_t indexOffset;
+};
+
+static const char MESH_CACHE_MAGIC[8] = "RDRMESH";
+
+static size_t alignOffset(size_t offset)
+{
+    return (offset + 15) & ~(size_t)15;
+}
+#pragma endregion
+
+#pragma region Dependencies
+static std::string getCacheFilePath(const std::string& objFilePath)
+{
+    return objFilePath + ".meshcache";
+}
+
+static bool readFile(const std::string& filePath, std::vector<char>& content)
+{
+    FILE* file = fopen(filePath.c_str(), "rb");
+    if (!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    content.resize(size > 0 ? size : 0);
+    bool isRead = fread(content.data(), 1, content.size(), file) == content.size();
+    fclose(file);
+
+    return isRead;
+}
+
+// FNV-1a
+static uint64_t hashContent(const std::vector<char>& content)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : content)
+    {
+        hash ^= (unsigned char)c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static bool getDependency(const std::string& filePath, MeshCacheDependency& dependency, const std::vector<char>* content = nullptr)
+{
+    if (filePath.size() >= sizeof(dependency.filePath))
+        return false;
+
+    std::error_code error;
+    std::filesystem::file_time_type modificationTime = std::filesystem::last_write_time(filePath, error);
+    if (error)
+        return false;
+
+    std::vector<char> readContent;
+    if (!content)
+    {
+        if (!readFile(filePath, readContent))
+            return false;
+        content = &readContent;
+    }
+
+    memset(&dependency, 0, sizeof(dependency));
+    strcpy(dependency.filePath, filePath.c_str());
+    dependency.modificationTime = modificationTime.time_since_epoch().count();
+    dependency.size = content->size();
+    dependency.hash = hashContent(*content);
+
+    return true;
+}
+
+static bool isUpToDate(const MeshCacheDependency& dependency)
+{
+    std::error_code error;
+    std::filesystem::file_time_type modificationTime = std::filesystem::last_write_time(dependency.filePath, error);
+    if (error)
+        return false;
+
+    uintmax_t size = std::filesystem::file_size(dependency.filePath, error);
+    if (error || size != dependency.size)
+        return false;
+
+    if (modificationTime.time_since_epoch().count() == dependency.modificationTime)
+        return true;
+
+    // The file was touched (or copied again), the cache is still valid if its content didn't change
+    std::vector<char> content;
+    return readFile(dependency.filePath, content) && hashContent(content) == dependency.hash;
+}
+#pragma endregion
+
+bool MeshCacheFile::open(const std::string& objFilePath, float scale)
+{
+    close();
+
+    std::string cacheFilePath = getCacheFilePath(objFilePath);
+
+    #pragma region Map the file
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(cacheFilePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    HANDLE fileMapping = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+        fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    // The view keeps a reference to the mapping and to the file
+    if (fileMapping)
+    {
+        mapping = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+        mappingSize = (size_t)fileSize.QuadPart;
+        CloseHandle(fileMapping);
+    }
+    CloseHandle(file);
+#else
+    int file = ::open(cacheFilePath.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat fileStat;
+    if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0)
+    {
+        mapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        mappingSize = fileStat.st_size;
+
+        if (mapping == MAP_FAILED)
+            mapping = nullptr;
+    }
+    ::close(file);
+#endif
+    #pragma endregion
+
+    if (!mapping || !readTables(scale))
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool MeshCacheFile::readTables(float scale)
+{
+    const char* data = (const char*)mapping;
+
+    // Check each table is inside the file before reading it
+    size_t offset = 0;
+    auto getTable = [&](size_t count, size_t size) -> const char*
+    {
+        offset = alignOffset(offset);
+        if (offset > mappingSize || count > (mappingSize - offset) / size)
+            return nullptr;
+
+        const char* table = data + offset;
+        offset += count * size;
+        return table;
+    };
+
+    const MeshCacheHeader* header = (const MeshCacheHeader*)getTable(1, sizeof(MeshCacheHeader));
+    if (!header || memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+        header->version != MESH_CACHE_VERSION || header->vertexSize != sizeof(rdrVertex) || header->scale != scale)
+        return false;
+
+    const MeshCacheDependency* dependencies = (const MeshCacheDependency*)getTable(header->dependencyCount, sizeof(MeshCacheDependency));
+    const MeshCacheTexture*    textures     = (const MeshCacheTexture*)getTable(header->textureCount, sizeof(MeshCacheTexture));
+    const CachedMaterial*      materialData = (const CachedMaterial*)getTable(header->materialCount, sizeof(CachedMaterial));
+    const MeshCacheMesh*       meshData     = (const MeshCacheMesh*)getTable(header->meshCount, sizeof(MeshCacheMesh));
+    if (!dependencies || !textures || !materialData || !meshData)
+        return false;
+
+    for (uint32_t i = 0; i < header->dependencyCount; i++)
+    {
+        if (strnlen(dependencies[i].filePath, sizeof(dependencies[i].filePath)) == sizeof(dependencies[i].filePath) ||
+            !isUpToDate(dependencies[i]))
+            return false;
+    }
+
+    for (uint32_t i = 0; i < header->textureCount; i++)
+        textureFileNames.push_back(std::string(textures[i].filePath, strnlen(textures[i].filePath, sizeof(textures[i].filePath))));
+
+    materials.assign(materialData, materialData + header->materialCount);
+
+    for (uint32_t i = 0; i < header->meshCount; i++)
+    {
+        const MeshCacheMesh& mesh = meshData[i];
+
+        bool isValid = mesh.textureIndex  >= -1 && mesh.textureIndex  < (int)header->textureCount &&
+                       mesh.materialIndex >= -1 && mesh.materialIndex < (int)header->materialCount &&
+                       mesh.vertexOffset <= mappingSize && mesh.vertexCount <= (mappingSize - mesh.vertexOffset) / sizeof(rdrVertex) &&
+                       mesh.indexOffset  <= mappingSize && mesh.indexCount  <= (mappingSize - mesh.indexOffset)  / sizeof(uint32_t);
+        if (!isValid)
+            return false;
+
+        // The indices are read by the draws and the picking without a check, a corrupted one would read outside of the vertices
+        const uint32_t* indices = (const uint32_t*)(data + mesh.indexOffset);
+        for (uint32_t j = 0; j < mesh.indexCount; j++)
+        {
+            if (indices[j] >= mesh.vertexCount)
+                return false;
+        }
+
+        meshes.push_back({ mesh.textureIndex, mesh.materialIndex,
+                           (const rdrVertex*)(data + mesh.vertexOffset), (const uint32_t*)(data + mesh.indexOffset),
+                           (int)mesh.vertexCount, (int)mesh.indexCount });
+    }
+
+    return true;
+}
+
+void MeshCacheFile::close()
+{
+    if (mapping)
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(mapping);
+#else
+        munmap(mapping, mappingSize);
+#endif
+    }
+
+    mapping = nullptr;
+    mappingSize = 0;
+
+    textureFileNames.clear();
+    materials.clear();
+    meshes.clear();
+}
+
+bool MeshCacheFile::write(const std::string& objFilePath, const std::string& mtlBasedir, float scale) const
+{
+    #pragma region Dependencies
+    std::vector<char> objContent;
+    if (!readFile(objFilePath, objContent))
+        return false;
+
+    std::vector<MeshCacheDependency> dependencies(1);
+    if (!getDependency(objFilePath, dependencies[0], &objContent))
+        return false;
+
+    // The .mtl files are given by the mtllib lines of the .obj
+    for (size_t lineStart = 0; lineStart < objContent.size(); )
+    {
+        size_t lineEnd = lineStart;
+        while (lineEnd < objContent.size() && objContent[lineEnd] != '\n')
+            lineEnd++;
+
+        std::string line(objContent.data() + lineStart, lineEnd - lineStart);
+        if (line.compare(0, 7, "mtllib ") == 0)
+        {
+            std::string mtlFileName = line.substr(7, line.find_last_not_of(" \t\r") - 6);
+
+            MeshCacheDependency dependency;
+            if (getDependency(mtlBasedir + mtlFileName, dependency))
+                dependencies.push_back(dependency);
+        }
+
+        lineStart = lineEnd + 1;
+    }
+    #pragma endregion
+
+    #pragma region Layout
+    MeshCacheHeader header = {};
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+    header.version         = MESH_CACHE_VERSION;
+    header.vertexSize      = sizeof(rdrVertex);
+    header.scale           = scale;
+    header.dependencyCount = (uint32_t)dependencies.size();
+    header.textureCount    = (uint32_t)textureFileNames.size();
+    header.materialCount   = (uint32_t)materials.size();
+    header.meshCount       = (uint32_t)meshes.size();
+
+    size_t dependenciesOffset = alignOffset(sizeof(MeshCacheHeader));
+    size_t texturesOffset     = alignOffset(dependenciesOffset + dependencies.size() * sizeof(MeshCacheDependency));
+    size_t materialsOffset    = alignOffset(texturesOffset + textureFileNames.size() * sizeof(MeshCacheTexture));
+    size_t meshesOffset       = alignOffset(materialsOffset + materials.size() * sizeof(CachedMaterial));
+    size_t dataOffset         = alignOffset(meshesOffset + meshes.size() * sizeof(MeshCacheMesh));
+
+    std::vector<MeshCacheMesh> meshTable;
+    for (const CachedMesh& mesh : meshes)
+    {
+        uint64_t vertexOffset = dataOffset;
+        uint64_t indexOffset  = alignOffset(vertexOffset + mesh.vertexCount * sizeof(rdrVertex));
+        dataOffset            = alignOffset(indexOffset + mesh.indexCount * sizeof(uint32_t));
+
+        MeshCacheMesh entry = { mesh.textureIndex, mesh.materialIndex, (uint32_t)mesh.vertexCount, (uint32_t)mesh.indexCount, vertexOffset, indexOffset };
+
+        meshTable.push_back(entry);
+    }
+    #pragma endregion
+
+    #pragma region Write
+    std::vector<char> content(dataOffset, 0);
+    memcpy(content.data(), &header, sizeof(header));
+    memcpy(content.data() + dependenciesOffset, dependencies.data(), dependencies.size() * sizeof(MeshCacheDependency));
+
+    for (size_t i = 0; i < textureFileNames.size(); i++)
+    {
+        if (textureFileNames[i].size() >= sizeof(MeshCacheTexture::filePath))
+            return false;
+
+        memcpy(content.data() + texturesOffset + i * sizeof(MeshCacheTexture), textureFileNames[i].c_str(), textureFileNames[i].size());
+    }
+
+    memcpy(content.data() + materialsOffset, materials.data(), materials.size() * sizeof(CachedMaterial));
+    memcpy(content.data() + meshesOffset, meshTable.data(), meshTable.size() * sizeof(MeshCacheMesh));
+
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        memcpy(content.data() + meshTable[i].vertexOffset, meshes[i].vertices, meshes[i].vertexCount * sizeof(rdrVertex));
+        memcpy(content.data() + meshTable[i].indexOffset, meshes[i].indices, meshes[i].indexCount * sizeof(uint32_t));
+    }
+
+    // Written beside, then renamed, so a reader never maps a partial file
+    std::string cacheFilePath = getCacheFilePath(objFilePath);
+    std::string tempFilePath = cacheFilePath + ".tmp";
+
+    FILE* file = fopen(tempFilePath.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool isWritten = fwrite(content.data(), 1, content.size(), file) == content.size();
+    isWritten &= fclose(file) == 0;
+
+    std::error_code error;
+    if (isWritten)
+        std::filesystem::rename(tempFilePath, cacheFilePath, error);
+
+    if (!isWritten || error)
+    {
+        std::filesystem::remove(tempFilePath, error);
+        return false;
+    }
+    #pragma endregion
+
+    return true;
+}
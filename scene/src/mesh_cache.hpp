@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <rdr/renderer.h>
+
+// Changed when the layout of the file or the loading of the .obj change, the older caches are written again
+#define MESH_CACHE_VERSION 2
+
+// Material of the .obj, with the values given to scnImpl::loadMaterial
+struct CachedMaterial
+{
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float emission[3];
+    float shininess;
+};
+
+struct CachedMesh
+{
+    int textureIndex;   // In the texture file names, -1 without texture
+    int materialIndex;  // In the materials, -1 for the default material of the scene
+
+    // Indexed triangles, in the mapped file once it is opened
+    const rdrVertex* vertices;
+    const uint32_t*  indices;
+    int vertexCount;
+    int indexCount;
+};
+
+// Binary copy of a parsed .obj, written next to it (<file>.obj.meshcache) and mapped in memory on the next loads
+// It is keyed by the path, the modification time, the size and the hash of the .obj and of its .mtl files:
+// if one of them changed (and its content too when only the time changed), the cache is outdated
+struct MeshCacheFile
+{
+    std::vector<std::string> textureFileNames;
+    std::vector<CachedMaterial> materials;
+    std::vector<CachedMesh> meshes;
+
+    // Map the cache of the .obj loaded with this scale, false if it is missing or outdated
+    // The vertices and the indices of the meshes stay valid until close()
+    bool open(const std::string& objFilePath, float scale);
+    void close();
+
+    bool isOpen() const { return mapping != nullptr; }
+
+    // Write the tables and the meshes of this file as the cache of the .obj, its .mtl files are found in mtlBasedir
+    bool write(const std::string& objFilePath, const std::string& mtlBasedir, float scale) const;
+
+    private:
+        void*  mapping = nullptr;
+        size_t mappingSize = 0;
+
+        bool readTables(float scale);
+};
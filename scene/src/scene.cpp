@@ -13,6 +13,63 @@
 
 #include <iostream>
 #include <algorithm>
+#include <map>
+#include <tuple>
+
+// Nearest objects in the view drawn before the occlusion queries
+#define OCCLUDER_COUNT 16
+
+void Mesh::computeBounds()
+{
+    const rdrVertex* vertexData = getVertices();
+    int vertexCount = getVertexCount();
+
+    bounds = AABB();
+    hasVertexAlpha = false;
+    for (int i = 0; i < vertexCount; i++)
+    {
+        bounds.add({ vertexData[i].x, vertexData[i].y, vertexData[i].z });
+        hasVertexAlpha |= vertexData[i].a < 1.f;
+    }
+
+    if (bounds.isEmpty())
+    {
+        boundingSphere = BoundingSphere();
+        return;
+    }
+
+    // Sphere centered on the box, with the farthest vertex on it (tighter than the sphere around the box)
+    boundingSphere.center = bounds.getCenter();
+
+    float sqRadius = 0.f;
+    for (int i = 0; i < vertexCount; i++)
+        sqRadius = max(sqRadius, sqMagnitude(float3(vertexData[i].x, vertexData[i].y, vertexData[i].z) - boundingSphere.center));
+
+    boundingSphere.radius = sqrtf(sqRadius);
+}
+
+void Object::computeBounds(const std::vector<Mesh>& sceneMeshes)
+{
+    bounds = AABB();
+    for (int meshIndex : meshes)
+        bounds.add(sceneMeshes[meshIndex].bounds);
+
+    if (bounds.isEmpty())
+    {
+        boundingSphere = BoundingSphere();
+        return;
+    }
+
+    // Sphere centered on the box, containing the sphere of each mesh
+    boundingSphere.center = bounds.getCenter();
+    boundingSphere.radius = 0.f;
+    for (int meshIndex : meshes)
+    {
+        const Mesh& m = sceneMeshes[meshIndex];
+        if (m.boundingSphere.radius >= 0.f)
+            boundingSphere.radius = max(boundingSphere.radius, magnitude(m.boundingSphere.center - boundingSphere.center) + m.boundingSphere.radius);
+    }
+}
 
 int scnImpl::loadTexture(const char* filePath)
 {
@@ -25,16 +82,17 @@ int scnImpl::loadTexture(const char* filePath)
     if (it != textures.end())
         return it - textures.begin();
 
-    // Else add load a new texture with stb and return the new index, only if the loaded texture is valid
-
+    // Else add a new texture and decode it with stb in the background, the index is kept if it can't be loaded (it is drawn without texture)
     Texture texture;
     texture.fileName = filePath;
-    texture.data = stbi_loadf(filePath, &texture.width, &texture.height, nullptr, STBI_rgb_alpha);
+    textures.push_back(texture);
 
-    if (!texture.data)
-        return -1;
+    TextureLoad* load = new TextureLoad();
+    load->fileName = filePath;
+    load->textureIndex = textures.size() - 1;
+    textureLoads.push_back(load);
 
-    textures.push_back(texture);
+    jobQueue.push([load]() { load->run(); });
 
     return textures.size() - 1;
 }
@@ -69,16 +127,70 @@ int scnImpl::loadMaterial(float ambient[3], float diffuse[3], float specular[3],
     return materials.size() - 1;
 }
 
-bool scnImpl::loadObject(Object& object, std::string filePath, std::string mtlBasedir, float scale)
+void TextureLoad::run()
+{
+    data = stbi_load(fileName.c_str(), &width, &height, nullptr, STBI_rgb_alpha);
+
+    // The meshes with a transparent texture are drawn after the opaque ones
+    for (int i = 0; data && i < width * height && !hasAlpha; i++)
+        hasAlpha = data[i * 4 + 3] < 255;
+
+    isDone = true;
+}
+
+void ObjectLoad::run()
+{
+    // Map the binary cache of the .obj if it is up to date
+    if (cache.open(filePath, scale))
+    {
+        textureFileNames = cache.textureFileNames;
+        materials = cache.materials;
+
+        // The geometry stays in the mapped file
+        for (const CachedMesh& cachedMesh : cache.meshes)
+        {
+            Mesh mesh(cachedMesh.textureIndex, cachedMesh.materialIndex);
+            mesh.mappedVertices    = cachedMesh.vertices;
+            mesh.mappedIndices     = cachedMesh.indices;
+            mesh.mappedVertexCount = cachedMesh.vertexCount;
+            mesh.mappedIndexCount  = cachedMesh.indexCount;
+            mesh.computeBounds();
+
+            meshes.push_back(std::move(mesh));
+        }
+    }
+    else if (parse())
+    {
+        // Tables of the cache
+        MeshCacheFile newCache;
+        newCache.textureFileNames = textureFileNames;
+        newCache.materials = materials;
+
+        for (Mesh& mesh : meshes)
+        {
+            mesh.computeBounds();
+            newCache.meshes.push_back({ mesh.textureIndex, mesh.materialIndex, mesh.getVertices(), mesh.getIndices(), mesh.getVertexCount(), mesh.getIndexCount() });
+        }
+
+        // The next loads don't parse the .obj anymore (the scene still loads if the cache can't be written)
+        newCache.write(filePath, mtlBasedir, scale);
+    }
+    else
+        isFailed = true;
+
+    isDone = true;
+}
+
+bool ObjectLoad::parse()
 {
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
+    std::vector<tinyobj::material_t> objMaterials;
 
     std::string warn;
     std::string err;
 
-    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filePath.c_str(), mtlBasedir.c_str(), true);
+    bool ret = tinyobj::LoadObj(&attrib, &shapes, &objMaterials, &warn, &err, filePath.c_str(), mtlBasedir.c_str(), true);
 
     if (!warn.empty())
         std::cerr << warn << std::endl;
@@ -88,22 +200,32 @@ bool scnImpl::loadObject(Object& object, std::string filePath, std::string mtlBa
 
     if (!ret) return 0;
 
-    if (!materials.empty())
+    if (!objMaterials.empty())
     {
-        // For each material of the .obj create a mesh with a texture and a material
-        for (size_t m = 0; m < materials.size(); m++)
+        // For each material of the .obj create a mesh with a texture and a material (the ones of the tables with the same index)
+        for (size_t m = 0; m < objMaterials.size(); m++)
         {
-            tinyobj::material_t& mat = materials[m];
+            tinyobj::material_t& mat = objMaterials[m];
 
-            int textureIndex  = loadTexture((mtlBasedir + mat.diffuse_texname).c_str());
-            int materialIndex = loadMaterial(mat.ambient, mat.diffuse, mat.specular, mat.emission, mat.shininess);
+            CachedMaterial material;
+            memcpy(material.ambient,  mat.ambient,  sizeof(material.ambient));
+            memcpy(material.diffuse,  mat.diffuse,  sizeof(material.diffuse));
+            memcpy(material.specular, mat.specular, sizeof(material.specular));
+            memcpy(material.emission, mat.emission, sizeof(material.emission));
+            material.shininess = mat.shininess;
 
-            object.mesh.push_back(Mesh(textureIndex, materialIndex));
+            textureFileNames.push_back(mtlBasedir + mat.diffuse_texname);
+            materials.push_back(material);
+
+            meshes.push_back(Mesh(mat.diffuse_texname.empty() ? -1 : (int)m, (int)m));
         }
     }
     // If there is no material, add only one mesh, without material nor texture
     else
-        object.mesh.push_back(Mesh(-1, 0));
+        meshes.push_back(Mesh(-1, -1));
+
+    // For each mesh, the index of the vertex of each position/normal/uv combination already added
+    std::vector<std::map<std::tuple<int, int, int>, uint32_t>> meshVertices(meshes.size());
 
     // Loop over shapes
     for (size_t s = 0; s < shapes.size(); s++)
@@ -114,18 +236,21 @@ bool scnImpl::loadObject(Object& object, std::string filePath, std::string mtlBa
         {
             // Get current mesh with material id (because the number of mesh is the number of material)
             int meshIndex = max(0, shapes[s].mesh.material_ids[f]);
+            Mesh& mesh = meshes[meshIndex];
 
             size_t fv = shapes[s].mesh.num_face_vertices[f];
                  
             if (attrib.vertices.empty())
                 continue;
 
-            Triangle face;
+            rdrVertex face[3];
+            tinyobj::index_t faceIndices[3];
 
             // Loop over vertices in the face.
             for (size_t v = 0; v < fv; v++)
             {
                 tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+                faceIndices[v] = idx;
 
                 rdrVertex vertice;
                 vertice.x = attrib.vertices[3 * idx.vertex_index + 0] * scale;
@@ -154,7 +279,7 @@ bool scnImpl::loadObject(Object& object, std::string filePath, std::string mtlBa
                     vertice.v = attrib.texcoords[2 * idx.texcoord_index + 1];
                 }
 
-                face.vertices[v] = vertice;
+                face[v] = vertice;
             }
 
             index_offset += fv;
@@ -164,23 +289,170 @@ bool scnImpl::loadObject(Object& object, std::string filePath, std::string mtlBa
             for (int i = 0; i < 3; i++)
             {
                 int nextIndex = (i + 1) % 3;
-                if (face.vertices[i].x == face.vertices[nextIndex].x &&
-                    face.vertices[i].y == face.vertices[nextIndex].y &&
-                    face.vertices[i].z == face.vertices[nextIndex].z)
+                if (face[i].x == face[nextIndex].x &&
+                    face[i].y == face[nextIndex].y &&
+                    face[i].z == face[nextIndex].z)
                 {
                     isAccepted = false;
                     break;
                 }
             }
 
-            if (isAccepted)
-                object.mesh[meshIndex].faces.push_back(face);
+            if (!isAccepted)
+                continue;
+
+            // Add the vertices the first time they are used by the mesh, then only their indices
+            for (int i = 0; i < 3; i++)
+            {
+                std::tuple<int, int, int> key = { faceIndices[i].vertex_index, faceIndices[i].normal_index, faceIndices[i].texcoord_index };
+
+                auto it = meshVertices[meshIndex].find(key);
+                if (it == meshVertices[meshIndex].end())
+                {
+                    it = meshVertices[meshIndex].insert({ key, (uint32_t)mesh.vertices.size() }).first;
+                    mesh.vertices.push_back(face[i]);
+                }
+
+                mesh.indices.push_back(it->second);
+            }
         }
     }
 
     return 1;
 }
 
+void scnImpl::loadObject(const std::vector<int>& objectIndices, std::string filePath, std::string mtlBasedir, float scale)
+{
+    ObjectLoad* load = new ObjectLoad();
+    load->objectIndices = objectIndices;
+    load->filePath = filePath;
+    load->mtlBasedir = mtlBasedir;
+    load->scale = scale;
+    objectLoads.push_back(load);
+
+    for (int objectIndex : objectIndices)
+        objects[objectIndex].meshes = { placeholderMesh };
+
+    jobQueue.push([load]() { load->run(); });
+}
+
+void scnImpl::publishObject(ObjectLoad& load)
+{
+    // The textures and the materials are added like when the .obj was loaded by the constructor, so they keep the same indices
+    std::vector<int> meshIndices;
+    for (Mesh& mesh : load.meshes)
+    {
+        if (mesh.textureIndex >= 0)
+            mesh.textureIndex = loadTexture(load.textureFileNames[mesh.textureIndex].c_str());
+
+        if (mesh.materialIndex >= 0)
+        {
+            CachedMaterial mat = load.materials[mesh.materialIndex];
+            mesh.materialIndex = loadMaterial(mat.ambient, mat.diffuse, mat.specular, mat.emission, mat.shininess);
+        }
+        else
+            mesh.materialIndex = 0;
+
+        meshIndices.push_back((int)meshes.size());
+        meshes.push_back(std::move(mesh));
+    }
+
+    if (load.cache.isOpen())
+        meshCacheFiles.push_back(load.cache);
+
+    // The objects are empty if the .obj can't be loaded
+    for (int objectIndex : load.objectIndices)
+    {
+        objects[objectIndex].meshes = meshIndices;
+        objects[objectIndex].computeBounds(meshes);
+        markObjectMoved(objectIndex);
+    }
+}
+
+void scnImpl::publishLoads()
+{
+    // The textures are given as soon as they are decoded
+    for (size_t i = 0; i < textureLoads.size(); )
+    {
+        TextureLoad* load = textureLoads[i];
+        if (!load->isDone)
+        {
+            i++;
+            continue;
+        }
+
+        Texture& texture = textures[load->textureIndex];
+        texture.data     = load->data;
+        texture.width    = load->width;
+        texture.height   = load->height;
+        texture.hasAlpha = load->hasAlpha;
+        texture.isLoaded = true;
+        failedLoadCount += load->data == nullptr;
+
+        delete load;
+        textureLoads.erase(textureLoads.begin() + i);
+    }
+
+    // The objects in the order of their loads, so the indices of their materials and textures don't depend on the timing of the jobs
+    while (!objectLoads.empty() && objectLoads.front()->isDone)
+    {
+        publishObject(*objectLoads.front());
+        failedLoadCount += objectLoads.front()->isFailed;
+
+        delete objectLoads.front();
+        objectLoads.pop_front();
+    }
+}
+
+void scnImpl::waitForLoads()
+{
+    // Adding an object starts the loads of its textures
+    while (!objectLoads.empty() || !textureLoads.empty())
+    {
+        jobQueue.waitIdle();
+        publishLoads();
+    }
+}
+
+void scnImpl::loadPlaceholderMesh()
+{
+    Mesh mesh;
+
+    // Unit cube, the faces have the winding of the quads
+    const float3 axes[6][3] =
+    {
+        //   normal              u                   v
+        { {  1.f, 0.f, 0.f }, { 0.f, 1.f, 0.f }, { 0.f, 0.f, 1.f } },
+        { { -1.f, 0.f, 0.f }, { 0.f, 0.f, 1.f }, { 0.f, 1.f, 0.f } },
+        { { 0.f,  1.f, 0.f }, { 0.f, 0.f, 1.f }, { 1.f, 0.f, 0.f } },
+        { { 0.f, -1.f, 0.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f, 1.f } },
+        { { 0.f, 0.f,  1.f }, { 1.f, 0.f, 0.f }, { 0.f, 1.f, 0.f } },
+        { { 0.f, 0.f, -1.f }, { 0.f, 1.f, 0.f }, { 1.f, 0.f, 0.f } },
+    };
+
+    for (const float3* face : axes)
+    {
+        uint32_t first = (uint32_t)mesh.vertices.size();
+        for (int corner = 0; corner < 4; corner++)
+        {
+            float u = (float)(corner & 1);
+            float v = (float)(corner >> 1);
+            float3 position = face[0] * 0.5f + face[1] * (u - 0.5f) + face[2] * (v - 0.5f);
+
+            mesh.vertices.push_back({ position.x, position.y, position.z,   face[0].x, face[0].y, face[0].z,   1.f, 1.f, 1.f, 1.f,   u, v });
+        }
+
+        // Corners 0 (0, 0), 1 (1, 0), 2 (0, 1) and 3 (1, 1)
+        mesh.indices.insert(mesh.indices.end(), { first, first + 1, first + 3 });
+        mesh.indices.insert(mesh.indices.end(), { first + 3, first + 2, first });
+    }
+
+    mesh.computeBounds();
+
+    placeholderMesh = (int)meshes.size();
+    meshes.push_back(mesh);
+}
+
 void scnImpl::loadQuad(Object& object, int textureIndex, int materialIndex, int hRes, int vRes)
 {
     Mesh mesh;
@@ -189,31 +461,38 @@ void scnImpl::loadQuad(Object& object, int textureIndex, int materialIndex, int
 
     float hGrad = 1.f / (float)hRes;
     float vGrad = 1.f / (float)vRes;
-    for (int i = 0; i < hRes; i++)
+
+    // Grid of (hRes + 1) x (vRes + 1) vertices shared by the faces
+    for (int i = 0; i <= hRes; i++)
     {
-        float u0 = i * hGrad;
-        float u1 = u0 + hGrad;
+        float u = i * hGrad;
 
-        for (int j = 0; j < vRes; j++)
+        for (int j = 0; j <= vRes; j++)
         {
-            float v0 = j * vGrad;
-            float v1 = v0 + vGrad;
-
-            Triangle face1, face2;
+            float v = j * vGrad;
 
-            //                                pos                       normal                  color                  uv
-            face1.vertices[0] = { u0 - 0.5f, v0 - 0.5f, 0.0f,     0.0f, 0.0f, 1.0f,      1.0f, 1.0f, 1.0f, 1.0f,     u0, v0 };
-            face1.vertices[1] = { u1 - 0.5f, v0 - 0.5f, 0.0f,     0.0f, 0.0f, 1.0f,      1.0f, 1.0f, 1.0f, 1.0f,     u1, v0 };
-            face1.vertices[2] = { u1 - 0.5f, v1 - 0.5f, 0.0f,     0.0f, 0.0f, 1.0f,      1.0f, 1.0f, 1.0f, 1.0f,     u1, v1 };
-            mesh.faces.push_back(face1);
+            //                            pos                     normal                  color                  uv
+            mesh.vertices.push_back({ u - 0.5f, v - 0.5f, 0.0f,     0.0f, 0.0f, 1.0f,      1.0f, 1.0f, 1.0f, 1.0f,     u, v });
+        }
+    }
 
-            face2.vertices[0] = { u1 - 0.5f, v1 - 0.5f, 0.0f,     0.0f, 0.0f, 1.0f,      1.0f, 1.0f, 1.0f, 1.0f,     u1, v1 };
-            face2.vertices[1] = { u0 - 0.5f, v1 - 0.5f, 0.0f,     0.0f, 0.0f, 1.0f,      1.0f, 1.0f, 1.0f, 1.0f,     u0, v1 };
-            face2.vertices[2] = { u0 - 0.5f, v0 - 0.5f, 0.0f,     0.0f, 0.0f, 1.0f,      1.0f, 1.0f, 1.0f, 1.0f,     u0, v0 };
-            mesh.faces.push_back(face2);
+    for (int i = 0; i < hRes; i++)
+    {
+        for (int j = 0; j < vRes; j++)
+        {
+            uint32_t i00 = i * (vRes + 1) + j;
+            uint32_t i10 = i00 + vRes + 1;
+            uint32_t i01 = i00 + 1;
+            uint32_t i11 = i10 + 1;
+
+            // Two faces for each cell
+            mesh.indices.insert(mesh.indices.end(), { i00, i10, i11 });
+            mesh.indices.insert(mesh.indices.end(), { i11, i01, i00 });
         }
     }
-    object.mesh.push_back(mesh);
+    mesh.computeBounds();
+    object.meshes.push_back((int)meshes.size());
+    meshes.push_back(mesh);
 }
 
 void scnImpl::loadTriangle(Object& object, int textureIndex, int materialIndex)
@@ -222,15 +501,15 @@ void scnImpl::loadTriangle(Object& object, int textureIndex, int materialIndex)
     mesh.textureIndex = textureIndex;
     mesh.materialIndex = materialIndex;
 
-    Triangle face;
-
     //                          pos                   normal                  color                     uv
-    face.vertices[0] = {-0.5f, -0.5f, 0.0f,      0.0f, 0.0f, 1.0f,      1.0f, 0.0f, 0.0f, 1.f,     0.0f, 0.0f };
-    face.vertices[1] = { 0.5f, -0.5f, 0.0f,      0.0f, 0.0f, 1.0f,      0.0f, 1.0f, 0.0f, 1.f,     0.5f, 0.5f };
-    face.vertices[2] = { 0.0f,  0.5f, 0.0f,      0.0f, 0.0f, 1.0f,      0.0f, 0.0f, 1.0f, 1.f,     0.0f, 1.0f };
-
-    mesh.faces.push_back(face);
-    object.mesh.push_back(mesh);
+    mesh.vertices.push_back({-0.5f, -0.5f, 0.0f,      0.0f, 0.0f, 1.0f,      1.0f, 0.0f, 0.0f, 1.f,     0.0f, 0.0f });
+    mesh.vertices.push_back({ 0.5f, -0.5f, 0.0f,      0.0f, 0.0f, 1.0f,      0.0f, 1.0f, 0.0f, 1.f,     0.5f, 0.5f });
+    mesh.vertices.push_back({ 0.0f,  0.5f, 0.0f,      0.0f, 0.0f, 1.0f,      0.0f, 0.0f, 1.0f, 1.f,     0.0f, 1.0f });
+
+    mesh.indices = { 0, 1, 2 };
+    mesh.computeBounds();
+    object.meshes.push_back((int)meshes.size());
+    meshes.push_back(mesh);
 }
 
 scnImpl* scnCreate()
@@ -243,16 +522,47 @@ void scnDestroy(scnImpl* scene)
     delete scene;
 }
 
+void scnWaitForAssets(scnImpl* scene)
+{
+    scene->waitForLoads();
+}
+
+int scnGetFailedLoadCount(scnImpl* scene)
+{
+    return scene->failedLoadCount;
+}
+
 void scnSetCameraPosition(scnImpl* scene, float* cameraPos)
 {
     memcpy(scene->cameraPos.e, cameraPos, sizeof(float3));
 }
 
+void scnSetCameraMatrices(scnImpl* scene, float* projection, float* view)
+{
+    mat4x4 projectionMatrix, viewMatrix;
+    memcpy(projectionMatrix.e, projection, sizeof(mat4x4));
+    memcpy(viewMatrix.e, view, sizeof(mat4x4));
+
+    scene->frustum = Frustum(projectionMatrix * viewMatrix);
+    scene->hasFrustum = true;
+}
+
 void scnUpdate(scnImpl* scene, float deltaTime, rdrImpl* renderer)
 {
     scene->update(deltaTime, renderer);
 }
 
+int scnPickObject(scnImpl* scene, float* rayOrigin, float* rayDirection)
+{
+    int objectIndex = scene->pickObject({ rayOrigin[0], rayOrigin[1], rayOrigin[2] }, { rayDirection[0], rayDirection[1], rayDirection[2] });
+
+    // Edit the picked object in the ImGui controls
+    if (objectIndex >= 0)
+        scene->selectedObject = objectIndex;
+
+    return objectIndex;
+}
+
 void scnSetImGuiContext(scnImpl* scene, struct ImGuiContext* context)
 {
     ImGui::SetCurrentContext(context);
@@ -284,44 +594,68 @@ scnImpl::scnImpl()
     lights[2].specular = { 0.f, 1.f, 0.f, 1.f };
     lights[2].lightPos = { 0.f, 0.f, 1.f, 0.f };
 
+    // Drawn until the meshes of the .obj are loaded
+    loadPlaceholderMesh();
+
     // Objects initialization
-    Object obj0({ 0.f, -3.f, -10.f });
-    loadObject(obj0, "assets/christmas-tree/christmas-tree.obj", "assets/christmas-tree/");
-    objects.push_back(obj0);
+    objects.push_back(Object({ 0.f, -3.f, -10.f }));
 
     Object obj1({ 0.f, 0.f, -0.5f });
     loadQuad(obj1, loadTexture("assets/window.png"), 0, 2, 2);
     objects.push_back(obj1);
 
-    Object obj2({ 0.f, 0.f, -15.f }, { 0.f, M_PI_2, 0.f });
-    loadObject(obj2, "assets/christmas-star/star.obj", "assets/christmas-star/", 0.1f);
-    objects.push_back(obj2);
+    // 3 stars sharing the same meshes, they are drawn as instances
+    objects.push_back(Object({ 0.f, 0.f, -15.f }, { 0.f, M_PI_2, 0.f }));
+    objects.push_back(Object({ -5.f, 0.f, -10.f }));
+    objects.push_back(Object({ 5.f, 0.f, -10.f }));
 
-    // Create 2 objects with the same mesh of the last one (star)
-    Object obj3({ -5.f, 0.f, -10.f });
-    obj3.mesh = obj2.mesh;
-    objects.push_back(obj3);
+    // 2 ornaments sharing the same meshes
+    objects.push_back(Object({ 10.f, 0.f, -15.f }));
+    objects.push_back(Object({ 20.f, 0.f, -15.f }, { 0.f, 0.f, 0.f }, {0.5f, 0.5f, 0.5f}));
 
-    Object obj4({ 5.f, 0.f, -10.f });
-    obj4.mesh = obj2.mesh;
-    objects.push_back(obj4);
+    // The .obj are loaded in the background, in this order
+    loadObject({ 0 }, "assets/christmas-tree/christmas-tree.obj", "assets/christmas-tree/");
+    loadObject({ 2, 3, 4 }, "assets/christmas-star/star.obj", "assets/christmas-star/", 0.1f);
+    loadObject({ 5, 6 }, "assets/christmas-ornament/ornament.obj", "assets/christmas-ornament/", 50.f);
 
-    Object obj5({ 10.f, 0.f, -15.f });
-    loadObject(obj5, "assets/christmas-ornament/ornament.obj", "assets/christmas-ornament/", 50.f);
-    objects.push_back(obj5);
+    for (Object& object : objects)
+    {
+        object.computeBounds(meshes);
+        object.model = object.getModel();
+        object.worldBounds = object.bounds.transform(object.model);
+    }
 
-    // Create 1 object with the same mesh of the last one (the ornament)
-    Object obj6({ 20.f, 0.f, -15.f }, { 0.f, 0.f, 0.f }, {0.5f, 0.5f, 0.5f});
-    obj6.mesh = obj5.mesh;
-    objects.push_back(obj6);
+    for (const Object& object : objects)
+        objectBounds.push_back(object.worldBounds);
+
+    bvh.build(objectBounds);
 }
 
 // Unload the scene
 scnImpl::~scnImpl()
 {
+    // Drop the loads that are not started and wait for the running ones
+    jobQueue.cancel();
+
+    for (TextureLoad* load : textureLoads)
+    {
+        stbi_image_free(load->data);
+        delete load;
+    }
+
+    for (ObjectLoad* load : objectLoads)
+    {
+        load->cache.close();
+        delete load;
+    }
+
     // Unload each texture
     for (Texture& texture : textures)
         stbi_image_free(texture.data);
+
+    // Unmap the meshes loaded from the caches
+    for (MeshCacheFile& cache : meshCacheFiles)
+        cache.close();
 }
 
 void editLights(scnImpl* scene)
@@ -373,74 +707,310 @@ void editObjects(scnImpl* scene)
     if (!scene)
         return;
 
-    static int selectedObject = 0;
+    int& selectedObject = scene->selectedObject;
     if (ImGui::TreeNode("Objects"))
     {
         ImGui::SliderInt("Selected object", &selectedObject, 0, scene->objects.size() - 1);
 
         ImGui::Checkbox("Is object enable", &scene->objects[selectedObject].isEnable);
 
-        ImGui::SliderFloat4("Object position", scene->objects[selectedObject].position.e, -10.f, 10.f);
-        ImGui::SliderFloat4("Rotation", scene->objects[selectedObject].rotation.e, -10.f, 10.f);
-        ImGui::SliderFloat4("Scale", scene->objects[selectedObject].scale.e, -10.f, 10.f);
+        bool isMoved = false;
+        isMoved |= ImGui::SliderFloat3("Object position", scene->objects[selectedObject].position.e, -10.f, 10.f);
+        isMoved |= ImGui::SliderFloat3("Rotation", scene->objects[selectedObject].rotation.e, -10.f, 10.f);
+        isMoved |= ImGui::SliderFloat3("Scale", scene->objects[selectedObject].scale.e, -10.f, 10.f);
+
+        if (isMoved)
+            scene->markObjectMoved(selectedObject);
+
+        ImGui::ColorEdit4("Object color", scene->objects[selectedObject].color.e, ImGuiColorEditFlags_Float);
 
-        if (!scene->objects[selectedObject].mesh.empty())
+        const std::vector<int>& meshes = scene->objects[selectedObject].meshes;
+        if (!meshes.empty())
         {
             static int selectedMesh = 0;
-            ImGui::SliderInt("Selected mesh", &selectedMesh, 0, scene->objects[selectedObject].mesh.size() - 1);
+            selectedMesh = min(selectedMesh, (int)meshes.size() - 1);
+            ImGui::SliderInt("Selected mesh", &selectedMesh, 0, meshes.size() - 1);
 
-            ImGui::SliderInt("Material index", &scene->objects[selectedObject].mesh[selectedMesh].materialIndex, 0, scene->materials.size() - 1);
-            ImGui::SliderInt("Texture index", &scene->objects[selectedObject].mesh[selectedMesh].textureIndex, -1, scene->textures.size() - 1);
+            // The meshes are shared by the objects with the same geometry
+            Mesh& mesh = scene->meshes[meshes[selectedMesh]];
+            ImGui::SliderInt("Material index", &mesh.materialIndex, 0, scene->materials.size() - 1);
+            ImGui::SliderInt("Texture index", &mesh.textureIndex, -1, scene->textures.size() - 1);
         }
         ImGui::TreePop();
     }
 }
 
-void scnImpl::drawObject(Object object, rdrImpl* renderer)
+void scnImpl::markObjectMoved(int objectIndex)
 {
-    if (!object.isEnable)
+    Object& object = objects[objectIndex];
+    if (object.isMoved)
         return;
 
-    // Get the model matrix of the current object
-    rdrSetModel(renderer, object.getModel().e);
+    object.isMoved = true;
+    movedObjects.push_back(objectIndex);
+}
 
-    // Then draw all his mesh
-    for (const Mesh& mesh : object.mesh)
+void scnImpl::updateHierarchy()
+{
+    for (int objectIndex : movedObjects)
     {
-        // Set the material and the texture of the current mesh
-        if (mesh.materialIndex >= 0)
-            rdrSetUniformMaterial(renderer, (rdrMaterial*)&materials[mesh.materialIndex]);
+        Object& object = objects[objectIndex];
+        object.model = object.getModel();
+        object.worldBounds = object.bounds.transform(object.model);
+        object.isMoved = false;
+    }
 
-        if (mesh.textureIndex >= 0 &&
-            textures[mesh.textureIndex].data &&
-            textures[mesh.textureIndex].height > 0 &&
-            textures[mesh.textureIndex].width > 0)
-            rdrSetTexture(renderer, textures[mesh.textureIndex].data, textures[mesh.textureIndex].width, textures[mesh.textureIndex].height);
-        else
-            rdrSetTexture(renderer, nullptr, 0, 0);
+    // Refitting keeps the tree but stretches its nodes, if most of the objects moved it is built again
+    if (movedObjects.size() * 4 > objects.size())
+    {
+        objectBounds.clear();
+        for (const Object& object : objects)
+            objectBounds.push_back(object.worldBounds);
 
-        // Then draw all his triangle
-        for (const Triangle& face : mesh.faces)
-            rdrDrawTriangles(renderer, face.vertices, 3);
+        bvh.build(objectBounds);
     }
+    else
+    {
+        for (int objectIndex : movedObjects)
+            bvh.refit(objectIndex, objects[objectIndex].worldBounds);
+    }
+
+    movedObjects.clear();
 }
 
-std::vector<Object> sortObjects(std::vector<Object> objects, const float3& cameraPos)
+// Distance along the ray of its intersection with the triangle (Moller-Trumbore), negative if it is missed
+static float intersectTriangle(const float3& origin, const float3& direction, const float3& p0, const float3& p1, const float3& p2)
 {
-    // Sort all objects with their distance to the camera by getting their model matrix
-    sort(objects.begin(), objects.end(),
-        [cameraPos](const Object& a, const Object& b)
+    float3 edge1 = p1 - p0;
+    float3 edge2 = p2 - p0;
+    float3 p = direction ^ edge2;
+
+    float determinant = dot(edge1, p);
+    if (fabsf(determinant) < 1e-8f)
+        return -1.f;
+
+    float invDeterminant = 1.f / determinant;
+    float3 t = origin - p0;
+
+    float u = dot(t, p) * invDeterminant;
+    if (u < 0.f || u > 1.f)
+        return -1.f;
+
+    float3 q = t ^ edge1;
+    float v = dot(direction, q) * invDeterminant;
+    if (v < 0.f || u + v > 1.f)
+        return -1.f;
+
+    return dot(edge2, q) * invDeterminant;
+}
+
+int scnImpl::pickObject(const float3& rayOrigin, const float3& rayDirection)
+{
+    updateHierarchy();
+
+    // The hierarchy gives the objects whose box is hit, then their triangles are tested in world space
+    return bvh.raycast(rayOrigin, rayDirection, [this, &rayOrigin, &rayDirection](int objectIndex, float maxDistance)
     {
-        float3 aPos = (a.getModel() * float4 { 0.f, 0.f, 0.f, 1.f }).xyz;
-        float3 bPos = (b.getModel() * float4 { 0.f, 0.f, 0.f, 1.f }).xyz;
-        return sqMagnitude(cameraPos - aPos) > sqMagnitude(cameraPos - bPos);
+        const Object& object = objects[objectIndex];
+        if (!object.isEnable)
+            return -1.f;
+
+        float nearestDistance = -1.f;
+        for (int meshIndex : object.meshes)
+        {
+            const Mesh& mesh = meshes[meshIndex];
+            const rdrVertex* vertices = mesh.getVertices();
+            const uint32_t*  indices  = mesh.getIndices();
+
+            for (int i = 0; i + 2 < mesh.getIndexCount(); i += 3)
+            {
+                float3 points[3];
+                for (int j = 0; j < 3; j++)
+                {
+                    const rdrVertex& vertex = vertices[indices[i + j]];
+                    points[j] = (object.model * float4(vertex.x, vertex.y, vertex.z, 1.f)).xyz;
+                }
+
+                float distance = intersectTriangle(rayOrigin, rayDirection, points[0], points[1], points[2]);
+                if (distance >= 0.f && distance < maxDistance)
+                {
+                    maxDistance = distance;
+                    nearestDistance = distance;
+                }
+            }
+        }
+
+        return nearestDistance;
     });
+}
+
+bool scnImpl::isVisible(const AABB& bounds, const BoundingSphere& boundingSphere, const mat4x4& model) const
+{
+    if (!hasFrustum || !isFrustumCullingEnabled)
+        return true;
 
-    return objects;
+    return !frustum.isOutside(boundingSphere.transform(model)) && !frustum.isOutside(bounds.transform(model));
+}
+
+bool scnImpl::isTransparent(const Mesh& mesh) const
+{
+    if (mesh.hasVertexAlpha)
+        return true;
+
+    if (mesh.materialIndex >= 0)
+    {
+        const Material& material = materials[mesh.materialIndex];
+        if (material.ambientColor.a < 1.f || material.diffuseColor.a < 1.f)
+            return true;
+    }
+
+    return mesh.textureIndex >= 0 && textures[mesh.textureIndex].hasAlpha;
+}
+
+int scnImpl::getTextureId(int textureIndex, rdrImpl* renderer)
+{
+    if (textureIndex < 0)
+        return -1;
+
+    Texture& texture = textures[textureIndex];
+
+    // The ids are only valid in the renderer which created them
+    unsigned int rendererInstanceId = rdrGetInstanceId(renderer);
+    std::vector<RendererTextures>::iterator it = std::find_if(rendererTextures.begin(), rendererTextures.end(),
+                                                 [rendererInstanceId](const RendererTextures& r)
+                                                 { return r.rendererInstanceId == rendererInstanceId; });
+    if (it == rendererTextures.end())
+    {
+        rendererTextures.push_back(RendererTextures());
+        it = rendererTextures.end() - 1;
+        it->rendererInstanceId = rendererInstanceId;
+    }
+
+    RendererTextures& uploaded = *it;
+    if (uploaded.ids.size() < textures.size())
+        uploaded.ids.resize(textures.size(), -1);
+
+    // Grey checker while the texture is decoded
+    if (!texture.isLoaded)
+    {
+        if (uploaded.placeholderId < 0)
+        {
+            const unsigned char texels[2 * 2 * 4] =
+            {
+                160, 160, 160, 255,    96,  96,  96, 255,
+                 96,  96,  96, 255,   160, 160, 160, 255,
+            };
+            uploaded.placeholderId = rdrCreateTexture(renderer, texels, 2, 2, TF_SRGB8);
+        }
+        return uploaded.placeholderId;
+    }
+
+    // The renderer keeps its own copy with the mipmaps
+    int& id = uploaded.ids[textureIndex];
+    if (id < 0 && texture.data && texture.height > 0 && texture.width > 0)
+        id = rdrCreateTexture(renderer, texture.data, texture.width, texture.height, TF_SRGB8);
+
+    return id;
+}
+
+void scnImpl::queueObject(int objectIndex)
+{
+    const Object& object = objects[objectIndex];
+    if (!object.isEnable)
+        return;
+
+    // Skip the object if it is outside the view, before transforming any vertex
+    if (!isVisible(object.bounds, object.boundingSphere, object.model))
+        return;
+
+    drawnObjectCount++;
+
+    for (int meshIndex : object.meshes)
+    {
+        const Mesh& mesh = meshes[meshIndex];
+
+        // The bounds of a single mesh are the ones of the object
+        if (object.meshes.size() > 1 && !isVisible(mesh.bounds, mesh.boundingSphere, object.model))
+            continue;
+
+        BoundingSphere sphere = mesh.boundingSphere.transform(object.model);
+        float distance = magnitude(sphere.center - cameraPos);
+
+        if (object.color.a < 1.f || isTransparent(mesh))
+            drawQueue.addTransparent(objectIndex, meshIndex, mesh.textureIndex, mesh.materialIndex, distance);
+        else
+            drawQueue.addOpaque(objectIndex, meshIndex, mesh.textureIndex, mesh.materialIndex, distance - sphere.radius);
+    }
+}
+
+void scnImpl::drawQueuedMeshes(rdrImpl* renderer, bool opaqueOnly)
+{
+    // The renderer state can be changed between two updates, so it is set again for the first mesh
+    int materialIndex = -1;
+    int textureIndex = -2;
+
+    for (const std::vector<DrawCommand>* commands : { &drawQueue.opaque, &drawQueue.transparent })
+    {
+        if (opaqueOnly && commands == &drawQueue.transparent)
+            break;
+
+        for (const DrawCommand& command : *commands)
+        {
+            const Mesh& mesh = meshes[command.meshIndex];
+
+            // Without material, the mesh keeps the last one
+            if (command.materialIndex >= 0 && command.materialIndex != materialIndex)
+            {
+                rdrSetUniformMaterial(renderer, (rdrMaterial*)&materials[command.materialIndex]);
+                materialIndex = command.materialIndex;
+                stateChangeCount++;
+            }
+
+            if (command.textureIndex != textureIndex)
+            {
+                rdrBindTexture(renderer, getTextureId(command.textureIndex, renderer));
+                textureIndex = command.textureIndex;
+                stateChangeCount++;
+            }
+
+            // Then draw all the triangles of its objects with one call
+            instanceModels.clear();
+            instanceColors.clear();
+            for (int i = command.firstInstance; i < command.firstInstance + command.instanceCount; i++)
+            {
+                const Object& object = objects[drawQueue.instances[i].objectIndex];
+                instanceModels.push_back(object.model);
+                instanceColors.push_back(object.color);
+            }
+
+            // The alpha of the vertices is known since the load of the mesh, the renderer doesn't read them again
+            rdrSetUniformInt(renderer, UT_VERTEX_ALPHA, mesh.hasVertexAlpha ? VA_UNDER_ONE : VA_ONE);
+
+            rdrDrawIndexedInstanced(renderer, mesh.getVertices(), mesh.getVertexCount(), mesh.getIndices(), mesh.getIndexCount(), IT_UINT32,
+                                    (const float*)instanceModels.data(), (const float*)instanceColors.data(), command.instanceCount);
+
+            drawnMeshCount += command.instanceCount;
+            drawCallCount++;
+        }
+    }
+
+    // The next draws of the caller have other vertices
+    rdrSetUniformInt(renderer, UT_VERTEX_ALPHA, VA_UNKNOWN);
+}
+
+static float getDistanceToBox(const AABB& box, const float3& point)
+{
+    float3 nearest;
+    for (int i = 0; i < 3; i++)
+        nearest.e[i] = min(max(point.e[i], box.min.e[i]), box.max.e[i]);
+    return magnitude(nearest - point);
 }
 
 void scnImpl::update(float deltaTime, rdrImpl* renderer)
 {
+    // Add the assets loaded since the last frame
+    publishLoads();
+
     for (int i = 0; i < IM_ARRAYSIZE(lights); i++)
         rdrSetUniformLight(renderer, i, (rdrLight*)&lights[i]);
 
@@ -449,10 +1019,13 @@ void scnImpl::update(float deltaTime, rdrImpl* renderer)
     // Make the tree rotate on itself
     objects[0].rotation.y = time * 0.25f;
 
-    // Change stars ambient color
-    materials[12].ambientColor.r = (sin(time) + 1.f) * 0.5f;
-    materials[12].ambientColor.g = (cosf(time) + 1.f) * 0.5f;
-    materials[12].ambientColor.b = (1.f - sinf(time)) * 0.5f;
+    // Change stars ambient color (the material only exists if the tree is loaded)
+    if (materials.size() > 12)
+    {
+        materials[12].ambientColor.r = (sin(time) + 1.f) * 0.5f;
+        materials[12].ambientColor.g = (cosf(time) + 1.f) * 0.5f;
+        materials[12].ambientColor.b = (1.f - sinf(time)) * 0.5f;
+    }
 
     // Make the stars ossilate
     objects[2].position.y = sin(time * 2.f) * 3.f + 2.f;
@@ -470,16 +1043,74 @@ void scnImpl::update(float deltaTime, rdrImpl* renderer)
     objects[3].scale.z = sin(time);
     objects[4].scale.y = (sin(time) + 2.f) * 0.25f;
 
-    // Sort objects
-    std::vector<Object> sortedObjects = sortObjects(objects, cameraPos);
-    
-    // Draw all objects
-    for (const auto& object : sortedObjects)
-        drawObject(object, renderer);
+    for (int i : { 0, 2, 3, 4 })
+        markObjectMoved(i);
+
+    updateHierarchy();
+
+    drawnObjectCount = 0;
+    drawnMeshCount = 0;
+    drawCallCount = 0;
+    stateChangeCount = 0;
+
+    // Only the objects in the view are queued
+    bool isCulling = hasFrustum && isFrustumCullingEnabled;
+    visibleObjects.clear();
+    if (isCulling)
+        bvh.queryVisible(frustum, nullptr, visibleObjects);
+    else
+    {
+        for (int i = 0; i < (int)objects.size(); i++)
+            visibleObjects.push_back(i);
+    }
+
+    drawQueue.clear();
+
+    // The opaque meshes of the nearest objects are drawn first, then the hierarchy is traversed again with the occlusion queries of the renderer
+    // A query waits for the rasterization of the draws before it, so all the other objects are queued before they are drawn
+    if (isCulling && isOcclusionCullingEnabled && visibleObjects.size() > OCCLUDER_COUNT)
+    {
+        std::partial_sort(visibleObjects.begin(), visibleObjects.begin() + OCCLUDER_COUNT, visibleObjects.end(), [this](int a, int b)
+        {
+            return getDistanceToBox(objects[a].worldBounds, cameraPos) < getDistanceToBox(objects[b].worldBounds, cameraPos);
+        });
+
+        occluders.assign(visibleObjects.begin(), visibleObjects.begin() + OCCLUDER_COUNT);
+        for (int objectIndex : occluders)
+            queueObject(objectIndex);
+
+        drawQueue.sort();
+        drawQueuedMeshes(renderer, true);
+        drawQueue.clearOpaque();
+
+        visibleObjects.clear();
+        bvh.queryVisible(frustum, renderer, visibleObjects);
+        for (int objectIndex : visibleObjects)
+        {
+            if (std::find(occluders.begin(), occluders.end(), objectIndex) == occluders.end())
+                queueObject(objectIndex);
+        }
+    }
+    else
+    {
+        for (int objectIndex : visibleObjects)
+            queueObject(objectIndex);
+    }
+
+    drawQueue.sort();
+    drawQueuedMeshes(renderer);
+
+    drawnTransparentMeshCount = (int)drawQueue.transparent.size();
 }
 
 void scnImpl::showImGuiControls()
 {
+    ImGui::Checkbox("Frustum culling", &isFrustumCullingEnabled);
+    ImGui::Checkbox("Occlusion culling", &isOcclusionCullingEnabled);
+    ImGui::Text("Drawn objects: %d, meshes: %d (%d transparent)", drawnObjectCount, drawnMeshCount, drawnTransparentMeshCount);
+    ImGui::Text("Draw calls: %d, texture and material changes: %d", drawCallCount, stateChangeCount);
+    ImGui::Text("Loading objects: %d, textures: %d (%d failed)", (int)objectLoads.size(), (int)textureLoads.size(), failedLoadCount);
+
     editLights(this);
     editObjects(this);
     editMaterials(this);
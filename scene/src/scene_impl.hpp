@@ -1,42 +1,76 @@
 
+#include <atomic>
+#include <cstdint>
+#include <deque>
 #include <vector>
 
 #include <rdr/renderer.h>
 #include <scn/scene.h>
 
+#include <common/job_queue.hpp>
+
+#include "bounds.hpp"
+#include "bvh.hpp"
+#include "draw_queue.hpp"
+#include "mesh_cache.hpp"
+
 struct Texture
 {
     std::string fileName;
     int width = 0, height = 0;
-    float* data = nullptr;
-};
-
-struct Triangle
-{
-    rdrVertex vertices[3];
+    unsigned char* data = nullptr;  // Loaded sRGB texels, kept until the scene is destroyed to upload them in each renderer drawing it
+    bool hasAlpha = false;          // One of the texels is not opaque
+    bool isLoaded = false;          // Decoded by a job, the placeholder texture is drawn until then (nothing if it failed)
 };
 
 struct Mesh
 {
-    std::vector<Triangle> faces;
+    // Indexed triangles, the vertices shared by several faces are only stored once
+    // They are in the vectors, or in a mapped cache file for the meshes loaded from it
+    std::vector<rdrVertex> vertices;
+    std::vector<uint32_t>  indices;
+    const rdrVertex* mappedVertices = nullptr;
+    const uint32_t*  mappedIndices = nullptr;
+    int mappedVertexCount = 0;
+    int mappedIndexCount = 0;
     int textureIndex = -1;
     int materialIndex = 0;
 
+    // Bounds of the vertices in object space, computed once the mesh is loaded
+    AABB bounds;
+    BoundingSphere boundingSphere;
+    bool hasVertexAlpha = false;    // One of the vertices is not opaque, computed with the bounds
+
     Mesh() = default;
     Mesh(int textureIndex, int materialIndex)
         : textureIndex(textureIndex), materialIndex(materialIndex)
     {}
+
+    const rdrVertex* getVertices()    const { return mappedVertices ? mappedVertices : vertices.data(); }
+    const uint32_t*  getIndices()     const { return mappedIndices ? mappedIndices : indices.data(); }
+    int              getVertexCount() const { return mappedVertices ? mappedVertexCount : (int)vertices.size(); }
+    int              getIndexCount()  const { return mappedIndices ? mappedIndexCount : (int)indices.size(); }
+
+    void computeBounds();
 };
 
 struct Object
 {
     bool isEnable = true;
-    std::vector<Mesh> mesh;
+    std::vector<int> meshes;    // Handles of the meshes in the list of the scene, shared by the objects with the same geometry
+    float4 color = { 1.f, 1.f, 1.f, 1.f };  // Multiplies the colors of its meshes
     float3 position = { 0.f, 0.f, 0.f };
     float3 rotation = { 0.f, 0.f, 0.f };
     float3 scale    = { 1.f, 1.f, 1.f };
 
+    // Model matrix and world bounds, updated when the object is marked as moved
     mat4x4 model = mat4::identity();
+    AABB worldBounds;
+    bool isMoved = false;
+
+    // Bounds of all the meshes in object space
+    AABB bounds;
+    BoundingSphere boundingSphere;
 
     Object(float3 pos = { 0.f, 0.f, 0.f }, float3 rot = { 0.f, 0.f, 0.f }, float3 scale = { 1.f, 1.f, 1.f })
         : position(pos), rotation(rot), scale(scale) {}
@@ -46,6 +80,9 @@ struct Object
     {
         return mat4::translate(position) * mat4::rotateX(rotation.x) * mat4::rotateY(rotation.y) * mat4::rotateZ(rotation.z) * mat4::scale(scale);
     }
+
+    // Merge the bounds of the meshes, to call once they are loaded
+    void computeBounds(const std::vector<Mesh>& sceneMeshes);
 };
 
 struct Light
@@ -72,14 +109,64 @@ struct Material
     float shininess = 20.f;
 };
 
+// Texture decoded by a job, its texels are given to the texture of the scene once it is done
+struct TextureLoad
+{
+    std::string fileName;
+    int textureIndex = -1;
+
+    unsigned char* data = nullptr;
+    int width = 0, height = 0;
+    bool hasAlpha = false;
+
+    std::atomic<bool> isDone = { false };
+
+    void run();
+};
+
+// .obj read by a job, from its binary cache if it is up to date, else parsed by TinyObjLoader (then the cache is written)
+// The texture and the material indices of its meshes are in its tables, until they are added to the scene
+struct ObjectLoad
+{
+    std::vector<int> objectIndices;     // Objects drawn with the meshes
+    std::string filePath;
+    std::string mtlBasedir;
+    float scale = 1.f;
+
+    std::vector<Mesh> meshes;
+    std::vector<std::string> textureFileNames;
+    std::vector<CachedMaterial> materials;
+    MeshCacheFile cache;                // Open if the meshes are read from it
+
+    std::atomic<bool> isDone = { false };
+    bool isFailed = false;              // Neither in the cache nor parsed, set before isDone
+
+    void run();
+
+    private:
+        bool parse();
+};
+
+// Ids of the uploaded textures in a renderer drawing the scene
+struct RendererTextures
+{
+    unsigned int rendererInstanceId = 0u;
+    std::vector<int> ids;       // By texture index, -1 until the texture is uploaded (with its mipmaps)
+    int placeholderId = -1;     // Created the first time a texture still loading is drawn
+};
+
 struct scnImpl
 {
     scnImpl();
     ~scnImpl();
 
     std::vector<Object> objects;
+    std::vector<Mesh> meshes;
     std::vector<Texture> textures;
 
+    // Mapped until the scene is destroyed, the meshes loaded from them point in their memory
+    std::vector<MeshCacheFile> meshCacheFiles;
+
     Material defaultMaterial;
 
     std::vector<Material> materials = { defaultMaterial };
@@ -87,28 +174,103 @@ struct scnImpl
 
     float3 cameraPos = { 0.f, 0.f, 0.f };
 
+    // View volume of the camera, nothing is culled until the camera matrices are set
+    Frustum frustum;
+    bool hasFrustum = false;
+    bool isFrustumCullingEnabled = true;
+
+    // The nearest objects in the view are drawn first, the hierarchy then skips the objects hidden behind their depths
+    bool isOcclusionCullingEnabled = true;
+
+    // Count of the objects and meshes drawn during the last update
+    int drawnObjectCount = 0;
+    int drawnMeshCount = 0;
+    int drawnTransparentMeshCount = 0;
+    int drawCallCount = 0;          // Instanced draws
+    int stateChangeCount = 0;       // Textures and materials set
+
+    // Hierarchy of the world bounds of the objects, for the culling and the picking
+    ObjectBVH bvh;
+    std::vector<int> movedObjects;
+    std::vector<AABB> objectBounds;
+
+    // Lists built at each update, they keep their memory so a frame doesn't allocate
+    std::vector<int> visibleObjects;
+    std::vector<int> occluders;
+    DrawQueue drawQueue;
+    std::vector<mat4x4> instanceModels;
+    std::vector<float4> instanceColors;
+
+    // Object edited in the ImGui controls
+    int selectedObject = 0;
+
+    // Assets loaded in the background, they are added to the scene by the updates
+    JobQueue jobQueue;
+    std::deque<ObjectLoad*> objectLoads;
+    std::vector<TextureLoad*> textureLoads;
+    int placeholderMesh = -1;
+    int failedLoadCount = 0;            // Objects and textures, counted when their loads are added
+
+    // The scene can be drawn by several renderers, or by a new one
+    std::vector<RendererTextures> rendererTextures;
+
     void update(float deltaTime, rdrImpl* renderer);
 
+    // Add the assets loaded since the last call (the objects in the order of their loads)
+    void publishLoads();
+
+    // Wait for all the loads (and the loads of the textures of the objects) and add them
+    void waitForLoads();
+
+    // To call after changing the position, the rotation or the scale of an object, its bounds are updated in the hierarchy at the next update
+    void markObjectMoved(int objectIndex);
+
+    // Nearest enabled object hit by the ray (in world space), -1 if none
+    int pickObject(const float3& rayOrigin, const float3& rayDirection);
+
     void showImGuiControls();
 
     private:
-        // Draw each object in the list and call rendering functions (like rdrSetTexture...)
-        void drawObject(Object object, rdrImpl* renderer);
+        // Add the meshes of the object in the view to the draw queue
+        void queueObject(int objectIndex);
+
+        // Draw the opaque then the transparent meshes of the queue (only the opaque ones for the occluders), with one instanced draw by command
+        // The material and the texture are only set when they change
+        void drawQueuedMeshes(rdrImpl* renderer, bool opaqueOnly = false);
 
-        // Create a new texture loaded by stb using the input filepath (return the index of the texture in the list) 
+        // True if the material, the texture or the vertices of the mesh are not opaque
+        bool isTransparent(const Mesh& mesh) const;
+
+        // Id of the texture in the renderer, it is uploaded the first time it is drawn by this renderer (-1 without texture)
+        // The placeholder texture is given while it is loading
+        int  getTextureId(int textureIndex, rdrImpl* renderer);
+
+        // Update the model matrices and the world bounds of the moved objects, then refit or rebuild the hierarchy
+        void updateHierarchy();
+
+        // Check the world bounds of the volume against the frustum of the camera (sphere first, then the box)
+        bool isVisible(const AABB& bounds, const BoundingSphere& boundingSphere, const mat4x4& model) const;
+
+        // Create a new texture decoded by stb in the background using the input filepath (return the index of the texture in the list)
         int  loadTexture(const char* filePath);
 
         // Create a new material using the input values (return the index of the material in the list)
         int  loadMaterial(float ambient[3], float diffuse[3], float specular[3], float emissive[3], float shininess);
 
-        // Add to the input object several meshes loaded by TinyObjLoader using the input filepath
+        // Start the load of an .obj in the background, the input objects are drawn with the placeholder mesh until its meshes are added
         // The first string is the filepath of the .obj, the second one is the filepath of the material
-        bool loadObject(Object& object, std::string filePath, std::string mtlBasedir, float scale = 1.f);
+        void loadObject(const std::vector<int>& objectIndices, std::string filePath, std::string mtlBasedir, float scale = 1.f);
+
+        // Add the meshes of the loaded .obj to the scene, with their textures and materials, and give them to its objects
+        void publishObject(ObjectLoad& load);
+
+        // Cube drawn in place of the objects still loading
+        void loadPlaceholderMesh();
 
-        // Add to the input object a quad mesh with a customizable subdivision, a texture and a material
+        // Add to the scene (and to the input object) a quad mesh with a customizable subdivision, a texture and a material
         void loadQuad(Object& object, int textureIndex = -1, int materialIndex = 0, int hRes = 1, int vRes = 1);
 
-        // Add to the input object a triangle mesh with a texture and a material
+        // Add to the scene (and to the input object) a triangle mesh with a texture and a material
         void loadTriangle(Object& object, int textureIndex = -1, int materialIndex = 0);
 
         double time = 0.0;